@@ -5,13 +5,24 @@
 
 
 #include "ttree.h"
+#include "ttree_table.h"
+#include "ttree_partition.h"
+#include "ttree_mapped.h"
+#include "ttree_wal.h"
+#include "ttree_multi.h"
+#include "ttree_packed.h"
 #include <gtest/gtest.h>
 
 #include <algorithm>
 #include <random>
+#include <set>
 #include <chrono>
 
 #include <memory>
+#include <thread>
+#include <atomic>
+#include <fcntl.h>
+#include <unistd.h>
 
 struct Record
 {
@@ -40,6 +51,12 @@ bool CheckNode(TTreeNode* pNode, fnKeyComparator keyComp)
 		}
 	}
 
+	//子树key数
+	if(pNode->count != pNode->keyNum + TTREE_COUNT_OF(pNode->left) + TTREE_COUNT_OF(pNode->right))
+	{
+		return false;
+	}
+
 	//检查左右子树平衡度
 	int diff = TTREE_HEIGHT_OF(pNode->left) - TTREE_HEIGHT_OF(pNode->right);
 	if(diff > 1 || diff < -1)
@@ -62,6 +79,21 @@ bool CheckNode(TTreeNode* pNode, fnKeyComparator keyComp)
 	return ((pNode->left == nullptr) ? true : CheckNode(pNode->left, keyComp)) && ((pNode->right == nullptr) ? true : CheckNode(pNode->right, keyComp));
 }
 
+void CollectKeys(TTreeNode* pNode, std::vector<void*>& keys)
+{
+	if(pNode == nullptr)
+	{
+		return;
+	}
+
+	CollectKeys(pNode->left, keys);
+	for(unsigned int i = 0; i < pNode->keyNum; i++)
+	{
+		keys.push_back(pNode->keys[i]);
+	}
+	CollectKeys(pNode->right, keys);
+}
+
 TEST(LeftRotate, SingleNode)
 {
 	TTree tree(pkComparator, true, 3);
@@ -336,10 +368,2138 @@ TEST(Insert, Random)
 	ASSERT_TRUE(CheckNode(tree.m_pRootNode, pkComparator));
 }
 
+//各分裂策略：递增夹杂迟到的key、随机插入删除后结构正确；APPEND的节点按填充率装满
+TEST(Insert, SplitPolicy)
+{
+	struct Case
+	{
+		TTreeSplitPolicy	policy;
+		double				fill;
+	} cases[] = {
+		{TTREE_SPLIT_SHIFT, 1}, {TTREE_SPLIT_FILL, 0.5}, {TTREE_SPLIT_FILL, 0.75},
+		{TTREE_SPLIT_APPEND, 1}, {TTREE_SPLIT_APPEND, 0.9}, {TTREE_SPLIT_APPEND, 0.1},
+	};
+
+	for(const Case& c : cases)
+	{
+		std::mt19937 rng(23);
+		TTreeT<int> tree(true, 16);
+		std::set<int> expect;
 
-int main(int argc, char** argv)
+		tree.SetSplitPolicy(c.policy, c.fill);
+
+		for(int i = 0; i < 20000; i++)
+		{
+			int key = (rng() % 20 == 0 && i > 100) ? (i - (int)(rng() % 100)) * 2 + 1 : i * 2;
+			ASSERT_EQ(tree.Insert(key), expect.insert(key).second ? 0 : -1);
+		}
+		ASSERT_TRUE(tree.Verify());
+
+		for(int i = 0; i < 20000; i++)
+		{
+			int key = (int)(rng() % 50000);
+			if(rng() % 2)
+			{
+				ASSERT_EQ(tree.Delete(key), expect.erase(key) ? 0 : -1);
+			}
+			else
+			{
+				ASSERT_EQ(tree.Insert(key), expect.insert(key).second ? 0 : -1);
+			}
+		}
+		ASSERT_TRUE(tree.Verify());
+
+		std::vector<int> keys;
+		tree.ForEach([&](int key) { keys.push_back(key); return true; });
+		ASSERT_EQ(keys, std::vector<int>(expect.begin(), expect.end()));
+	}
+
+	//严格递增：APPEND 1.0与SHIFT一样全部装满，0.75时每个节点12个key
+	for(double fill : {1.0, 0.75})
+	{
+		TTreeT<int> tree(true, 16);
+		tree.SetSplitPolicy(TTREE_SPLIT_APPEND, fill);
+
+		for(int i = 0; i < 16 * 100; i++)
+		{
+			tree.Insert(i);
+		}
+
+		unsigned int keep = (unsigned int)(16 * fill);
+		size_t nodes = 0;
+		tree.ForEachNode([&](TTreeT<int>::Node*) { nodes++; });
+		ASSERT_EQ(nodes, (16 * 100 + keep - 1) / keep);
+	}
+}
+
+//递增插入走缓存的最右节点；InsertHint在正确、错误、失效位置的hint下结果都与Insert一致
+TEST(Insert, Hint)
 {
-	::testing::InitGoogleTest(&argc, argv);
-	
-	return RUN_ALL_TESTS();
-}
\ No newline at end of file
+	TTreeT<int> tree(true, 8);
+	for(int i = 0; i < 1000; i++)
+	{
+		ASSERT_EQ(tree.Insert(i * 10), 0);
+		ASSERT_TRUE(tree.m_pRightmost == nullptr || tree.m_pRightmost == tree.GetRight(tree.m_pRootNode));
+	}
+	ASSERT_EQ(tree.Insert(9990), -1);
+	ASSERT_TRUE(tree.Verify());
+
+	std::mt19937 rng(24);
+	std::set<int> expect;
+	tree.ForEach([&](int key) { expect.insert(key); return true; });
+
+	for(int i = 0; i < 20000; i++)
+	{
+		int key = (int)(rng() % 12000);
+		int near = (int)(rng() % 4) == 0 ? (int)(rng() % 12000) : key - (int)(rng() % 30);
+
+		TTreeT<int>::Cursor hint = (i % 7 == 0) ? TTreeT<int>::Cursor() : tree.LowerBound(near);
+		ASSERT_EQ(tree.InsertHint(hint, key), expect.insert(key).second ? 0 : -1) << key;
+
+		//删除使缓存的最右节点失效
+		if(i % 100 == 0)
+		{
+			int victim = *expect.rbegin();
+			ASSERT_EQ(tree.Delete(victim), 0);
+			expect.erase(victim);
+		}
+	}
+	ASSERT_TRUE(tree.Verify());
+
+	std::vector<int> keys;
+	tree.ForEach([&](int key) { keys.push_back(key); return true; });
+	ASSERT_EQ(keys, std::vector<int>(expect.begin(), expect.end()));
+
+	//同一个hint连续插入附近的key
+	TTreeT<int> local(false, 8);
+	for(int i = 0; i < 100; i++)
+	{
+		local.Insert(i * 100);
+	}
+	TTreeT<int>::Cursor hint = local.LowerBound(5000);
+	for(int i = 1; i < 100; i++)
+	{
+		ASSERT_EQ(local.InsertHint(hint, 5000 + i), 0);
+		ASSERT_EQ(local.InsertHint(hint, 5000), 0);
+	}
+	ASSERT_EQ(local.CountRange(5000, 5099), 199u);
+	ASSERT_TRUE(local.Verify());
+}
+
+//顺序删除全部
+TEST(Delete, Seq)
+{
+	int count = 10000;
+	Record* pRecords = new Record[count];
+	std::shared_ptr<Record[]> ptr(pRecords);
+
+	TTree tree(pkComparator, true, 3);
+
+	for(int i = 0; i < count; i++)
+	{
+		pRecords[i].pk = i;
+		tree.Insert(pRecords + i);
+	}
+
+	for(int i = 0; i < count; i++)
+	{
+		ASSERT_EQ(tree.Delete(pRecords + i), 0);
+		ASSERT_EQ(tree.Query(pRecords + i), nullptr);
+	}
+
+	ASSERT_EQ(tree.Count(), 0);
+	ASSERT_EQ(tree.m_pRootNode, nullptr);
+}
+
+//随机删除一半
+TEST(Delete, Random)
+{
+	int count = 100000;
+	std::vector<int> vec(count);
+
+	Record* pRecords = new Record[count];
+	std::shared_ptr<Record[]> ptr(pRecords);
+
+	TTree tree(pkComparator, true, 8);
+
+	for(int i = 0; i < count; i++)
+	{
+		vec[i] = i;
+	}
+
+	auto seed = std::chrono::system_clock::now().time_since_epoch().count();
+	std::default_random_engine engine(seed);
+	std::shuffle(vec.begin(), vec.end(), engine);
+
+	for(int i = 0; i < count; i++)
+	{
+		pRecords[i].pk = vec[i];
+		tree.Insert(pRecords + i);
+	}
+
+	std::shuffle(vec.begin(), vec.end(), engine);
+
+	for(int i = 0; i < count / 2; i++)
+	{
+		ASSERT_EQ(tree.Delete(pRecords + vec[i]), 0);
+	}
+
+	ASSERT_EQ(tree.Count(), count - count / 2);
+	ASSERT_TRUE(CheckNode(tree.m_pRootNode, pkComparator));
+
+	for(int i = 0; i < count; i++)
+	{
+		ASSERT_EQ(tree.Query(pRecords + vec[i]), i < count / 2 ? nullptr : pRecords + vec[i]);
+	}
+
+	//已删除的key再删返回-1
+	ASSERT_EQ(tree.Delete(pRecords + vec[0]), -1);
+}
+
+//非唯一索引删除指针相同的key
+TEST(Delete, Duplicate)
+{
+	int count = 1000;
+	Record* pRecords = new Record[count];
+	std::shared_ptr<Record[]> ptr(pRecords);
+
+	TTree tree(pkComparator, false, 4);
+
+	for(int i = 0; i < count; i++)
+	{
+		pRecords[i].pk = i % 10;
+		tree.Insert(pRecords + i);
+	}
+
+	for(int i = 0; i < count; i += 2)
+	{
+		ASSERT_EQ(tree.Delete(pRecords + i), 0);
+	}
+
+	ASSERT_EQ(tree.Count(), count / 2);
+	ASSERT_TRUE(CheckNode(tree.m_pRootNode, pkComparator));
+
+	std::vector<void*> keys;
+	CollectKeys(tree.m_pRootNode, keys);
+	for(void* pKey : keys)
+	{
+		ASSERT_EQ(((Record*)pKey - pRecords) % 2, 1);
+	}
+
+	for(int i = 1; i < count; i += 2)
+	{
+		ASSERT_EQ(tree.Delete(pRecords + i), 0);
+	}
+
+	ASSERT_EQ(tree.Count(), 0);
+}
+
+struct PkCompare
+{
+	int operator()(const Record* pa, const Record* pb) const
+	{
+		return pa->pk - pb->pk;
+	}
+};
+
+//模板版本，key直接存整数
+TEST(Template, IntKey)
+{
+	int count = 100000;
+	std::vector<int> vec(count);
+
+	for(int i = 0; i < count; i++)
+	{
+		vec[i] = i;
+	}
+
+	auto seed = std::chrono::system_clock::now().time_since_epoch().count();
+	std::shuffle(vec.begin(), vec.end(), std::default_random_engine(seed));
+
+	TTreeT<int> tree(true, 16);
+
+	for(int i = 0; i < count; i++)
+	{
+		ASSERT_EQ(tree.Insert(vec[i]), 0);
+	}
+
+	ASSERT_EQ(tree.Insert(vec[0]), -1);
+	ASSERT_EQ(tree.Count(), count);
+
+	for(int i = 0; i < count; i++)
+	{
+		const int* pKey = tree.Query(i);
+		ASSERT_NE(pKey, nullptr);
+		ASSERT_EQ(*pKey, i);
+	}
+
+	ASSERT_EQ(tree.Query(count), nullptr);
+
+	for(int i = 0; i < count; i += 2)
+	{
+		ASSERT_EQ(tree.Delete(i), 0);
+	}
+
+	ASSERT_EQ(tree.Count(), count / 2);
+	ASSERT_EQ(tree.Query(0), nullptr);
+	ASSERT_NE(tree.Query(1), nullptr);
+}
+
+//模板版本，key为记录指针，比较器可内联
+TEST(Template, RecordKey)
+{
+	int count = 10000;
+	Record* pRecords = new Record[count];
+	std::shared_ptr<Record[]> ptr(pRecords);
+
+	TTreeT<Record*, PkCompare> tree(true, 8);
+
+	for(int i = 0; i < count; i++)
+	{
+		pRecords[i].pk = count - i;
+		tree.Insert(pRecords + i);
+	}
+
+	ASSERT_EQ(tree.Count(), count);
+
+	for(int i = 0; i < count; i++)
+	{
+		Record* const* ppRecord = tree.Query(pRecords + i);
+		ASSERT_NE(ppRecord, nullptr);
+		ASSERT_EQ(*ppRecord, pRecords + i);
+	}
+}
+
+//区间遍历
+TEST(Cursor, Range)
+{
+	int count = 10000;
+	Record* pRecords = new Record[count];
+	std::shared_ptr<Record[]> ptr(pRecords);
+
+	TTree tree(pkComparator, true, 8);
+
+	//只插入偶数
+	for(int i = 0; i < count; i++)
+	{
+		pRecords[i].pk = i * 2;
+		tree.Insert(pRecords + i);
+	}
+
+	Record lo, hi;
+	lo.pk = 101;
+	hi.pk = 300;
+
+	int expect = 102;
+	for(TTreeIterator it = tree.Range(&lo, &hi); !it.IsEOF(); it.Next())
+	{
+		ASSERT_EQ(((Record*)*it.Get())->pk, expect);
+		expect += 2;
+	}
+	ASSERT_EQ(expect, 302);
+
+	TTreeIterator it = tree.LowerBound(&hi);
+	ASSERT_EQ(((Record*)*it.Get())->pk, 300);
+
+	it = tree.UpperBound(&hi);
+	ASSERT_EQ(((Record*)*it.Get())->pk, 302);
+
+	hi.pk = count * 2;
+	it = tree.LowerBound(&hi);
+	ASSERT_TRUE(it.IsEOF());
+	ASSERT_EQ(it.Get(), nullptr);
+
+	int n = 0;
+	for(it = tree.Begin(); !it.IsEOF(); it.Next())
+	{
+		ASSERT_EQ(((Record*)*it.Get())->pk, n * 2);
+		n++;
+	}
+	ASSERT_EQ(n, count);
+}
+
+//重复key跨节点时，LowerBound定位到第一个
+TEST(Cursor, Duplicate)
+{
+	TTreeT<int> tree(false, 4);
+
+	for(int i = 0; i < 1000; i++)
+	{
+		tree.Insert(i % 10);
+	}
+
+	for(int key = 0; key < 10; key++)
+	{
+		int n = 0;
+		for(TTreeT<int>::Cursor it = tree.Range(key, key); !it.IsEOF(); it.Next())
+		{
+			ASSERT_EQ(*it.Get(), key);
+			n++;
+		}
+		ASSERT_EQ(n, 100);
+
+		TTreeT<int>::Cursor it = tree.UpperBound(key);
+		if(key == 9)
+		{
+			ASSERT_TRUE(it.IsEOF());
+		}
+		else
+		{
+			ASSERT_EQ(*it.Get(), key + 1);
+		}
+	}
+}
+
+//各种节点内查找方式结果一致
+TEST(Search, Modes)
+{
+	TTreeSearchMode modes[] = {TTREE_SEARCH_LINEAR, TTREE_SEARCH_BINARY, TTREE_SEARCH_AUTO, TTREE_SEARCH_SIMD};
+
+	for(TTreeSearchMode mode : modes)
+	{
+		for(unsigned int keySize : {3, 8, 64, 128})
+		{
+			int count = 20000;
+			std::vector<int> vec(count);
+
+			for(int i = 0; i < count; i++)
+			{
+				vec[i] = i;
+			}
+
+			std::shuffle(vec.begin(), vec.end(), std::default_random_engine(keySize));
+
+			TTreeT<int> tree(false, keySize);
+			tree.SetSearchMode(mode);
+
+			for(int i = 0; i < count; i++)
+			{
+				ASSERT_EQ(tree.Insert(vec[i] / 2), 0);
+			}
+
+			for(int i = 0; i < count / 2; i++)
+			{
+				ASSERT_NE(tree.Query(i), nullptr);
+				ASSERT_NE(tree.Get(i), nullptr);
+			}
+
+			ASSERT_EQ(tree.Query(-1), nullptr);
+			ASSERT_EQ(tree.Query(count / 2), nullptr);
+
+			int n = 0, prev = -1;
+			for(TTreeT<int>::Cursor it = tree.Range(100, 199); !it.IsEOF(); it.Next())
+			{
+				ASSERT_LE(prev, *it.Get());
+				prev = *it.Get();
+				n++;
+			}
+			ASSERT_EQ(n, 200);
+
+			for(int i = 0; i < count; i++)
+			{
+				ASSERT_EQ(tree.Delete(vec[i] / 2), 0);
+			}
+			ASSERT_EQ(tree.Count(), 0);
+		}
+	}
+}
+
+//SIMD查找与二分查找结果一致，覆盖各级指令集、有无符号、边界值
+template <typename T>
+void CheckSimdRank()
+{
+	std::mt19937_64 rng(sizeof(T) * 10 + std::is_signed<T>::value);
+	T special[] = {std::numeric_limits<T>::min(), std::numeric_limits<T>::max(), 0, 1, (T)-1};
+
+	for(unsigned int n : {0, 1, 3, 4, 7, 8, 9, 31, 64, 65})
+	{
+		std::vector<T> keys;
+		for(unsigned int i = 0; i < n; i++)
+		{
+			keys.push_back(i < 5 ? special[i] : (T)(rng() % 64));
+		}
+		std::sort(keys.begin(), keys.end());
+
+		std::vector<T> probes(keys);
+		for(T key : special)
+		{
+			probes.push_back(key);
+			probes.push_back(key == std::numeric_limits<T>::max() ? key : (T)(key + 1));
+		}
+		for(int i = 0; i < 64; i++)
+		{
+			probes.push_back((T)i);
+		}
+
+		for(T key : probes)
+		{
+			typedef typename std::conditional<sizeof(T) == 4, int32_t, int64_t>::type Word;
+			Word flip = std::is_signed<T>::value ? 0 : std::numeric_limits<Word>::min();
+			unsigned int lower = std::lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+			unsigned int upper = std::upper_bound(keys.begin(), keys.end(), key) - keys.begin();
+
+			ASSERT_EQ(TTreeSimdRank(keys.data(), n, key, false, std::true_type()), lower);
+			ASSERT_EQ(TTreeSimdRank(keys.data(), n, key, true, std::true_type()), upper);
+			ASSERT_EQ(TTreeCountLessScalar((const Word*)keys.data(), n, (Word)key, flip), lower);
+#ifdef TTREE_SIMD_X86
+			if(TTreeSimdDetect() >= TTREE_SIMD_SSE42)
+			{
+				ASSERT_EQ(TTreeCountLessSse42((const Word*)keys.data(), n, (Word)key, flip), lower);
+			}
+			if(TTreeSimdDetect() >= TTREE_SIMD_AVX2)
+			{
+				ASSERT_EQ(TTreeCountLessAvx2((const Word*)keys.data(), n, (Word)key, flip), lower);
+			}
+#endif
+		}
+	}
+}
+
+TEST(Search, Simd)
+{
+	CheckSimdRank<int32_t>();
+	CheckSimdRank<uint32_t>();
+	CheckSimdRank<int64_t>();
+	CheckSimdRank<uint64_t>();
+	CheckSimdRank<long long>();
+
+	//节点内查找与二分一致
+	TTreeT<int64_t> tree(false, 64);
+	ASSERT_TRUE(tree.m_simdSearch);
+	tree.SetSearchMode(TTREE_SEARCH_BINARY);
+	ASSERT_FALSE(tree.m_simdSearch);
+
+	TTreeT<const char*, TTreeCompare<const char*> > pointers(false, 8);
+	pointers.SetSearchMode(TTREE_SEARCH_SIMD);
+	ASSERT_FALSE(pointers.m_simdSearch);
+
+	for(int i = 0; i < 5000; i++)
+	{
+		tree.Insert((i * 7919) % 1000 - 500);
+	}
+	tree.Insert(INT64_MAX);
+	tree.Insert(INT64_MIN);
+
+	tree.SetSearchMode(TTREE_SEARCH_SIMD);
+	for(int64_t key = -502; key <= 502; key++)
+	{
+		std::vector<int64_t> simd, binary;
+		for(TTreeT<int64_t>::Cursor it = tree.LowerBound(key); !it.IsEOF() && simd.size() < 8; it.Next())
+		{
+			simd.push_back(*it.Get());
+		}
+		ASSERT_EQ(tree.Query(key) != nullptr, key >= -500 && key < 500);
+
+		tree.SetSearchMode(TTREE_SEARCH_BINARY);
+		for(TTreeT<int64_t>::Cursor it = tree.LowerBound(key); !it.IsEOF() && binary.size() < 8; it.Next())
+		{
+			binary.push_back(*it.Get());
+		}
+		tree.SetSearchMode(TTREE_SEARCH_SIMD);
+
+		ASSERT_EQ(simd, binary);
+	}
+	ASSERT_NE(tree.Query(INT64_MAX), nullptr);
+	ASSERT_EQ(*tree.UpperBound(INT64_MIN).Get(), -500);
+	ASSERT_TRUE(tree.UpperBound(INT64_MAX).IsEOF());
+	ASSERT_TRUE(tree.Verify());
+}
+
+//空节点、首个key
+TEST(Search, Edge)
+{
+	TTreeT<int> tree(true, 8);
+	int insertPos = -1;
+
+	TTreeMallocAllocator allocator;
+	TTreeT<int>::Node* pNode = TTreeT<int>::Node::Create(&allocator, 8);
+	TTreeT<int>::Node& node = *pNode;
+	ASSERT_EQ(tree.BinarySeach(&node, 1, 0, &insertPos), -1);
+	ASSERT_EQ(insertPos, 0);
+
+	for(int i = 0; i < 5; i++)
+	{
+		node.keys[node.keyNum++] = i * 2;
+	}
+
+	for(int i = -1; i < 11; i++)
+	{
+		int linearPos, binaryPos;
+		ASSERT_EQ(tree.BinarySeach(&node, i, 0, &binaryPos), tree.SearchBackward(&node, i, 0, &linearPos));
+		ASSERT_EQ(binaryPos, linearPos);
+	}
+
+	TTreeT<int>::Node::Destroy(&allocator, pNode, 8);
+
+	//index为0的key也要能查到
+	tree.Insert(1);
+	ASSERT_NE(tree.Get(1), nullptr);
+}
+
+//CST布局：增删过程中Query与std::set一致，目录在节点集合变化后重建，分界过时时也能查到
+TEST(Layout, Cst)
+{
+	std::mt19937 rng(22);
+
+	for(int withPrefix = 0; withPrefix < 2; withPrefix++)
+	{
+		TTreeT<int, TTreeCompare<int>, TTreeKeyPrefix<int> > tree(true, 8);
+		std::set<int> expect;
+
+		if(withPrefix)
+		{
+			ASSERT_EQ(tree.SetPrefixMode(TTREE_PREFIX_BOUNDS), 0);
+		}
+		tree.SetLayout(TTREE_LAYOUT_CST);
+		ASSERT_EQ(tree.Query(1), nullptr);
+
+		for(int round = 0; round < 20; round++)
+		{
+			for(int i = 0; i < 500; i++)
+			{
+				int key = (int)(rng() % 4000) - 2000;
+				if(rng() % 3 == 0)
+				{
+					tree.Delete(key);
+					expect.erase(key);
+				}
+				else
+				{
+					tree.Insert(key);
+					expect.insert(key);
+				}
+			}
+
+			for(int key = -2001; key <= 2001; key++)
+			{
+				const int* pKey = tree.Query(key);
+				ASSERT_EQ(pKey != nullptr, expect.count(key) == 1) << key;
+				if(pKey)
+				{
+					ASSERT_EQ(*pKey, key);
+				}
+			}
+			ASSERT_TRUE(tree.m_dirValid.load());
+		}
+
+		ASSERT_GT(tree.m_dirLevels.size(), 1u);
+		ASSERT_EQ(tree.m_dirLevels[0].num, tree.m_dirNodes.size());
+		ASSERT_TRUE(tree.Verify());
+	}
+
+	//节点集合不变时插入比最小key更小的key，目录不重建，沿前驱修正
+	TTreeT<int> tree(false, 8);
+	for(int i = 0; i < 200; i++)
+	{
+		tree.Insert(i * 10);
+	}
+	tree.SetLayout(TTREE_LAYOUT_CST);
+	ASSERT_NE(tree.Query(500), nullptr);
+
+	tree.Delete(500);
+	tree.Insert(495);
+	ASSERT_TRUE(tree.m_dirValid.load());
+	ASSERT_NE(tree.Query(495), nullptr);
+	ASSERT_EQ(tree.Query(500), nullptr);
+
+	tree.Clear();
+	ASSERT_EQ(tree.Query(495), nullptr);
+}
+
+//顺序统计：Rank、Select、CountRange与有序数组的下标一致
+TEST(OrderStat, RankSelect)
+{
+	std::mt19937 rng(7);
+	TTreeT<int> tree(false, 8);
+	std::vector<int> expect;
+
+	for(int i = 0; i < 20000; i++)
+	{
+		int key = rng() % 5000;
+		tree.Insert(key);
+		expect.push_back(key);
+	}
+
+	std::vector<int> batch;
+	for(int i = 0; i < 5000; i++)
+	{
+		batch.push_back(rng() % 6000);
+	}
+	expect.insert(expect.end(), batch.begin(), batch.end());
+	tree.InsertBatch(batch.data(), batch.size());
+
+	for(int i = 0; i < 8000; i++)
+	{
+		int key = rng() % 5000;
+		if(tree.Delete(key) == 0)
+		{
+			expect.erase(std::find(expect.begin(), expect.end(), key));
+		}
+	}
+
+	std::sort(expect.begin(), expect.end());
+	ASSERT_EQ(tree.Count(), expect.size());
+	ASSERT_EQ(tree.Count(), tree.Count(tree.m_pRootNode));
+
+	for(int key = -1; key <= 6001; key++)
+	{
+		unsigned int lower = std::lower_bound(expect.begin(), expect.end(), key) - expect.begin();
+		ASSERT_EQ(tree.Rank(key), lower);
+	}
+
+	for(unsigned int i = 0; i < expect.size(); i += 7)
+	{
+		TTreeT<int>::Cursor it = tree.Select(i);
+		ASSERT_FALSE(it.IsEOF());
+		ASSERT_EQ(*it.Get(), expect[i]);
+	}
+	ASSERT_TRUE(tree.Select(expect.size()).IsEOF());
+
+	ASSERT_EQ(tree.CountRange(100, 200), std::upper_bound(expect.begin(), expect.end(), 200) - std::lower_bound(expect.begin(), expect.end(), 100));
+	ASSERT_EQ(tree.CountRange(200, 100), 0);
+
+	//批量构建
+	TTreeT<int> loaded(false, 8);
+	ASSERT_EQ(loaded.BulkLoad(expect.data(), expect.size(), 0.7), 0);
+	ASSERT_EQ(loaded.Count(), expect.size());
+	ASSERT_EQ(*loaded.Select(expect.size() / 2).Get(), expect[expect.size() / 2]);
+	ASSERT_EQ(loaded.Rank(2500), tree.Rank(2500));
+}
+
+//非递归遍历：ForEach按顺序，ForEachNode子节点先于父节点，Verify能发现损坏
+TEST(Traversal, Iterative)
+{
+	int count = 10000;
+	Record* pRecords = new Record[count];
+	std::shared_ptr<Record[]> ptr(pRecords);
+
+	TTreeMallocAllocator allocator;
+	TTree tree(pkComparator, false, 8, &allocator);
+
+	for(int i = 0; i < count; i++)
+	{
+		pRecords[i].pk = (i * 7919) % (count / 2);
+		tree.Insert(pRecords + i);
+	}
+	for(int i = 0; i < count; i += 3)
+	{
+		tree.Delete(pRecords + i);
+	}
+	ASSERT_TRUE(tree.Verify());
+
+	std::vector<void*> expect, keys;
+	CollectKeys(tree.m_pRootNode, expect);
+
+	ASSERT_EQ(tree.ForEach([&](void* pKey) { keys.push_back(pKey); return true; }), expect.size());
+	ASSERT_EQ(keys, expect);
+
+	//提前停止，返回false的那个key也算一次
+	size_t below = std::count_if(expect.begin(), expect.end(), [](void* pKey) { return ((const Record*)pKey)->pk < 100; });
+	ASSERT_EQ(tree.ForEach([](void* pKey) { return ((const Record*)pKey)->pk < 100; }), below + 1);
+
+	std::vector<TTreeNode*> visited;
+	tree.ForEachNode([&](TTreeNode* pNode) {
+		for(TTreeNode* pChild : {pNode->left, pNode->right})
+		{
+			if(pChild)
+			{
+				ASSERT_NE(std::find(visited.begin(), visited.end(), pChild), visited.end());
+			}
+		}
+		visited.push_back(pNode);
+	});
+	ASSERT_EQ(visited.back(), tree.m_pRootNode);
+	ASSERT_EQ(tree.Count(tree.m_pRootNode), tree.Count());
+
+	//破坏子树key数、节点内顺序
+	TTreeNode* pNode = visited[visited.size() / 2];
+	pNode->count++;
+	ASSERT_FALSE(tree.Verify());
+	pNode->count--;
+
+	std::swap(pNode->keys[0], pNode->keys[pNode->keyNum - 1]);
+	ASSERT_FALSE(tree.Verify());
+	std::swap(pNode->keys[0], pNode->keys[pNode->keyNum - 1]);
+	ASSERT_TRUE(tree.Verify());
+
+	//外部分配器逐个释放节点
+	tree.Clear();
+	ASSERT_EQ(tree.ForEach([](void*) { return true; }), 0);
+	ASSERT_TRUE(tree.Verify());
+}
+
+//节点头和key在同一块缓存行对齐的内存里
+TEST(Node, InlineLayout)
+{
+	TTreeMallocAllocator allocator;
+
+	for(unsigned int size : {1, 3, 7, 32, 128})
+	{
+		TTreeNode* pNode = TTreeNode::Create(&allocator, size);
+
+		ASSERT_EQ((uintptr_t)pNode % TTREE_CACHE_LINE, 0);
+		ASSERT_EQ(TTreeNode::AllocSize(size) % TTREE_CACHE_LINE, 0);
+		ASSERT_GE((char*)pNode + TTreeNode::AllocSize(size), (char*)&pNode->keys[size + 1]);
+		ASSERT_EQ(pNode->keyNum, 0);
+		ASSERT_EQ(pNode->height, 1);
+
+		TTreeNode::Destroy(&allocator, pNode, size);
+	}
+
+	//节点头在一个缓存行内
+	ASSERT_LE(offsetof(TTreeNode, keys), TTREE_CACHE_LINE);
+	ASSERT_EQ(TTreeNode::AllocSize(1), TTREE_CACHE_LINE * 2);
+	ASSERT_EQ(TTreeNode::AllocSize(1, true) % TTREE_CACHE_LINE, 0);
+}
+
+uint64_t pkPrefix(const void* pKey)
+{
+	return TTreeIntPrefix(((const Record*)pKey)->pk);
+}
+
+//节点池：释放的块被复用，Clear整体释放slab
+TEST(Allocator, Pool)
+{
+	TTreeNodePool pool(4096);
+
+	int count = 100000;
+	Record* pRecords = new Record[count];
+	std::shared_ptr<Record[]> ptr(pRecords);
+
+	{
+		TTree tree(pkComparator, true, 8, &pool);
+
+		for(int i = 0; i < count; i++)
+		{
+			pRecords[i].pk = i;
+			tree.Insert(pRecords + i);
+		}
+
+		size_t slabs = pool.SlabCount();
+		ASSERT_GT(slabs, 1);
+
+		for(int i = 0; i < count; i++)
+		{
+			ASSERT_EQ(tree.Delete(pRecords + i), 0);
+		}
+
+		//删除后再插入，空闲块被复用，不再申请slab
+		for(int i = 0; i < count; i++)
+		{
+			tree.Insert(pRecords + i);
+		}
+
+		ASSERT_EQ(pool.SlabCount(), slabs);
+		ASSERT_EQ(tree.Count(), count);
+		ASSERT_TRUE(CheckNode(tree.m_pRootNode, pkComparator));
+
+		//共享的分配器不整体释放
+		tree.Clear();
+		ASSERT_EQ(pool.SlabCount(), slabs);
+	}
+
+	ASSERT_TRUE(pool.Reset());
+	ASSERT_EQ(pool.SlabCount(), 0);
+
+	//树自己持有的池，Clear后可以继续使用
+	TTree tree(pkComparator, true, 8);
+	for(int round = 0; round < 2; round++)
+	{
+		for(int i = 0; i < count; i++)
+		{
+			tree.Insert(pRecords + i);
+		}
+		ASSERT_EQ(tree.Count(), count);
+
+		tree.Clear();
+		ASSERT_EQ(tree.Count(), 0);
+	}
+
+	//Clear后节点大小改变，池按新的大小重新开始，不会退化为逐个分配
+	ASSERT_EQ(tree.SetKeyPrefix(pkPrefix, TTREE_PREFIX_SLOTS), 0);
+	for(int i = 0; i < 1000; i++)
+	{
+		tree.Insert(pRecords + i);
+	}
+	ASSERT_EQ(((TTreeNodePool*)tree.m_pAllocator)->m_pLarge, nullptr);
+	tree.Clear();
+
+	//大小不同的块单独分配，Reset时一并释放
+	TTreeNodePool mixed(4096);
+	mixed.Alloc(128);
+	void* pLarge = mixed.Alloc(256);
+	mixed.Alloc(512);
+	mixed.Free(pLarge, 256);
+	ASSERT_NE(mixed.m_pLarge, nullptr);
+	ASSERT_TRUE(mixed.Reset());
+	ASSERT_EQ(mixed.m_pLarge, nullptr);
+	ASSERT_EQ(mixed.m_blockSize, 0);
+}
+
+//前缀缓存不改变结果
+TEST(Prefix, Modes)
+{
+	int count = 50000;
+	std::vector<int> vec(count);
+
+	Record* pRecords = new Record[count];
+	std::shared_ptr<Record[]> ptr(pRecords);
+
+	for(int i = 0; i < count; i++)
+	{
+		vec[i] = i;
+	}
+
+	TTreePrefixMode modes[] = {TTREE_PREFIX_NONE, TTREE_PREFIX_BOUNDS, TTREE_PREFIX_SLOTS};
+
+	for(TTreePrefixMode mode : modes)
+	{
+		for(TTreeSearchMode search : {TTREE_SEARCH_LINEAR, TTREE_SEARCH_BINARY})
+		{
+			std::shuffle(vec.begin(), vec.end(), std::default_random_engine(mode));
+
+			TTree tree(pkComparator, true, 16);
+			ASSERT_EQ(tree.SetKeyPrefix(pkPrefix, mode), 0);
+			tree.SetSearchMode(search);
+
+			for(int i = 0; i < count; i++)
+			{
+				pRecords[i].pk = vec[i] - count / 2;
+				ASSERT_EQ(tree.Insert(pRecords + i), 0);
+			}
+
+			//非空时不能修改
+			ASSERT_EQ(tree.SetKeyPrefix(pkPrefix, mode), -1);
+			ASSERT_EQ(tree.Count(), count);
+			ASSERT_TRUE(CheckNode(tree.m_pRootNode, pkComparator));
+
+			for(int i = 0; i < count; i++)
+			{
+				ASSERT_EQ(tree.Query(pRecords + i), pRecords + i);
+			}
+
+			Record lo, hi;
+			lo.pk = -100;
+			hi.pk = 99;
+			int n = 0;
+			for(TTreeIterator it = tree.Range(&lo, &hi); !it.IsEOF(); it.Next())
+			{
+				ASSERT_EQ(((Record*)*it.Get())->pk, lo.pk + n);
+				n++;
+			}
+			ASSERT_EQ(n, 200);
+
+			for(int i = 0; i < count; i += 2)
+			{
+				ASSERT_EQ(tree.Delete(pRecords + i), 0);
+			}
+
+			for(int i = 0; i < count; i++)
+			{
+				ASSERT_EQ(tree.Query(pRecords + i), i % 2 ? pRecords + i : nullptr);
+			}
+		}
+	}
+}
+
+//整数key直接用默认前缀；字符串前缀与strncmp一致
+TEST(Prefix, Helpers)
+{
+	TTreeT<int, TTreeCompare<int>, TTreeKeyPrefix<int> > tree(true, 8);
+	ASSERT_EQ(tree.SetPrefixMode(TTREE_PREFIX_SLOTS), 0);
+
+	for(int i = -1000; i < 1000; i++)
+	{
+		tree.Insert(i * 7 % 2000);
+	}
+
+	for(int i = -1000; i < 1000; i++)
+	{
+		ASSERT_NE(tree.Query(i * 7 % 2000), nullptr);
+	}
+
+	ASSERT_LT(TTreeIntPrefix(-1), TTreeIntPrefix(0));
+	ASSERT_LT(TTreeIntPrefix(INT32_MIN), TTreeIntPrefix(INT32_MAX));
+
+	char a[16] = "ab", b[16] = "ab";
+	b[3] = 'x';	//'\0'之后的内容不参与比较
+	ASSERT_EQ(TTreeStringPrefix(a, sizeof(a)), TTreeStringPrefix(b, sizeof(b)));
+	ASSERT_LT(TTreeStringPrefix("ab", 3), TTreeStringPrefix("abc", 4));
+	ASSERT_LT(TTreeStringPrefix("a\xff", 3), TTreeStringPrefix("b", 2));
+}
+
+//有序数组直接构建
+TEST(BulkLoad, Build)
+{
+	int count = 100000;
+	Record* pRecords = new Record[count];
+	std::shared_ptr<Record[]> ptr(pRecords);
+
+	std::vector<void*> keys(count);
+	for(int i = 0; i < count; i++)
+	{
+		pRecords[i].pk = i;
+		keys[i] = pRecords + i;
+	}
+
+	for(int n : {0, 1, 7, 100, count})
+	{
+		for(double fill : {0.5, 0.8, 1.0})
+		{
+			TTree tree(pkComparator, true, 16);
+			ASSERT_EQ(tree.BulkLoad(keys.data(), n, fill), 0);
+			ASSERT_EQ(tree.Count(), n);
+
+			if(n == 0)
+			{
+				ASSERT_EQ(tree.m_pRootNode, nullptr);
+				continue;
+			}
+
+			ASSERT_TRUE(CheckNode(tree.m_pRootNode, pkComparator));
+
+			for(int i = 0; i < n; i++)
+			{
+				ASSERT_EQ(tree.Query(pRecords + i), pRecords + i);
+			}
+
+			//构建后可以继续增删
+			for(int i = 0; i < n; i += 3)
+			{
+				ASSERT_EQ(tree.Delete(pRecords + i), 0);
+			}
+			for(int i = 0; i < n; i += 3)
+			{
+				ASSERT_EQ(tree.Insert(pRecords + i), 0);
+			}
+			ASSERT_EQ(tree.Count(), n);
+			ASSERT_TRUE(CheckNode(tree.m_pRootNode, pkComparator));
+		}
+	}
+
+	//按填充率分配节点
+	TTree tree(pkComparator, true, 10);
+	ASSERT_EQ(tree.BulkLoad(keys.data(), 1000, 0.5), 0);
+	ASSERT_EQ(tree.m_pRootNode->keyNum, 5);
+
+	//非空、无序、唯一索引有重复都拒绝
+	ASSERT_EQ(tree.BulkLoad(keys.data(), 10, 1.0), -1);
+
+	TTree unsorted(pkComparator, true, 10);
+	std::swap(keys[3], keys[4]);
+	ASSERT_EQ(unsorted.BulkLoad(keys.data(), 10, 1.0), -1);
+	std::swap(keys[3], keys[4]);
+
+	keys[4] = keys[3];
+	ASSERT_EQ(unsorted.BulkLoad(keys.data(), 10, 1.0), -1);
+
+	TTree dup(pkComparator, false, 10);
+	ASSERT_EQ(dup.BulkLoad(keys.data(), 10, 1.0), 0);
+	ASSERT_EQ(dup.Count(), 10);
+}
+
+//批量插入
+TEST(InsertBatch, Random)
+{
+	int count = 100000;
+	std::vector<int> vec(count);
+
+	Record* pRecords = new Record[count];
+	std::shared_ptr<Record[]> ptr(pRecords);
+
+	for(int i = 0; i < count; i++)
+	{
+		vec[i] = i;
+	}
+
+	std::default_random_engine engine(count);
+	std::shuffle(vec.begin(), vec.end(), engine);
+
+	for(int i = 0; i < count; i++)
+	{
+		pRecords[i].pk = vec[i];
+	}
+
+	for(TTreePrefixMode mode : {TTREE_PREFIX_NONE, TTREE_PREFIX_SLOTS})
+	{
+		for(unsigned int keySize : {3, 32})
+		{
+			TTree tree(pkComparator, true, keySize);
+			tree.SetKeyPrefix(pkPrefix, mode);
+
+			//先逐条插入一部分
+			for(int i = 0; i < count / 10; i++)
+			{
+				tree.Insert(pRecords + i);
+			}
+
+			std::vector<void*> batch;
+			for(int i = 0; i < count; i++)
+			{
+				batch.push_back(pRecords + i);
+
+				if(batch.size() == 5000 || i == count - 1)
+				{
+					size_t expect = 0;
+					for(void* pKey : batch)
+					{
+						expect += ((Record*)pKey - pRecords) >= count / 10;
+					}
+
+					ASSERT_EQ(tree.InsertBatch(batch.data(), batch.size()), expect);
+					batch.clear();
+				}
+			}
+
+			ASSERT_EQ(tree.Count(), count);
+			ASSERT_TRUE(CheckNode(tree.m_pRootNode, pkComparator));
+
+			for(int i = 0; i < count; i++)
+			{
+				ASSERT_EQ(tree.Query(pRecords + i), pRecords + i);
+			}
+		}
+	}
+}
+
+//批量插入重复key
+TEST(InsertBatch, Duplicate)
+{
+	std::vector<int> keys;
+	for(int i = 0; i < 1000; i++)
+	{
+		keys.push_back(i % 100);
+	}
+
+	TTreeT<int> unique(true, 8);
+	ASSERT_EQ(unique.InsertBatch(keys.data(), keys.size()), 100);
+	ASSERT_EQ(unique.InsertBatch(keys.data(), keys.size()), 0);
+	ASSERT_EQ(unique.Count(), 100);
+
+	TTreeT<int> multi(false, 8);
+	ASSERT_EQ(multi.InsertBatch(keys.data(), keys.size()), 1000);
+	ASSERT_EQ(multi.InsertBatch(keys.data(), 10), 10);
+	ASSERT_EQ(multi.Count(), 1010);
+
+	int prev = -1, n = 0;
+	for(TTreeT<int>::Cursor it = multi.Begin(); !it.IsEOF(); it.Next())
+	{
+		ASSERT_LE(prev, *it.Get());
+		prev = *it.Get();
+		n++;
+	}
+	ASSERT_EQ(n, 1010);
+}
+
+//批量查找与逐个查找结果一致
+TEST(QueryBatch, Random)
+{
+	int count = 20000;
+	Record* pRecords = new Record[count];
+	std::shared_ptr<Record[]> ptr(pRecords);
+
+	for(int i = 0; i < count; i++)
+	{
+		pRecords[i].pk = i;
+	}
+
+	for(TTreePrefixMode mode : {TTREE_PREFIX_NONE, TTREE_PREFIX_BOUNDS})
+	{
+		TTree tree(pkComparator, true, 8);
+		tree.SetKeyPrefix(pkPrefix, mode);
+
+		//只插入一半，另一半查不到
+		for(int i = 0; i < count; i += 2)
+		{
+			tree.Insert(pRecords + i);
+		}
+
+		std::vector<void*> keys;
+		for(int i = 0; i < count; i++)
+		{
+			keys.push_back(pRecords + (i * 7919) % count);
+		}
+
+		std::vector<const void*> out(count, (const void*)1);
+		tree.QueryBatch(keys.data(), out.data(), count - 3);
+
+		for(int i = 0; i < count - 3; i++)
+		{
+			ASSERT_EQ(out[i], tree.Query(keys[i]));
+		}
+		ASSERT_EQ(out[count - 3], (const void*)1);
+	}
+
+	TTree empty(pkComparator, true, 8);
+	const void* out = (const void*)1;
+	void* pKey = pRecords;
+	empty.QueryBatch(&pKey, &out, 1);
+	ASSERT_EQ(out, nullptr);
+}
+
+
+//并发模式：一个线程插入、删除奇数，读线程始终能查到全部偶数，区间扫描有序且不缺偶数
+TEST(Concurrent, ReadWrite)
+{
+	int count = 20000;
+
+	for(TTreePrefixMode mode : {TTREE_PREFIX_NONE, TTREE_PREFIX_SLOTS})
+	{
+		TTreeT<int, TTreeCompare<int>, TTreeKeyPrefix<int> > tree(true, 8);
+		tree.SetPrefixMode(mode);
+		tree.SetConcurrent(true);
+
+		for(int i = 0; i < count; i += 2)
+		{
+			tree.Insert(i);
+		}
+
+		std::atomic<bool> stop(false);
+		std::atomic<int> errors(0);
+
+		std::vector<std::thread> readers;
+		for(int t = 0; t < 3; t++)
+		{
+			readers.emplace_back([&, t]() {
+				std::mt19937 rng(t);
+				while(!stop.load())
+				{
+					int key = (rng() % count) & ~1;
+					int found = -1;
+					if(!tree.Find(key, &found) || found != key)
+					{
+						errors++;
+					}
+
+					int lo = rng() % count, hi = lo + 500, expect = (lo + 1) & ~1, prev = -1;
+					tree.Scan(lo, hi, [&](const int& k) {
+						if(k <= prev || k < lo || k > hi)
+						{
+							errors++;
+						}
+
+						if(k % 2 == 0)
+						{
+							if(k != expect)
+							{
+								errors++;
+							}
+							expect = k + 2;
+						}
+
+						prev = k;
+						return true;
+					});
+
+					if(expect <= hi && expect < count)
+					{
+						errors++;
+					}
+				}
+			});
+		}
+
+		std::mt19937 rng(100);
+		for(int round = 0; round < 4; round++)
+		{
+			for(int i = 1; i < count; i += 2)
+			{
+				tree.Insert(i);
+			}
+
+			std::vector<int> odd;
+			for(int i = 1; i < count; i += 2)
+			{
+				odd.push_back(i);
+			}
+			std::shuffle(odd.begin(), odd.end(), rng);
+
+			for(int k : odd)
+			{
+				ASSERT_EQ(tree.Delete(k), 0);
+			}
+		}
+
+		stop = true;
+		for(std::thread& reader : readers)
+		{
+			reader.join();
+		}
+
+		ASSERT_EQ(errors.load(), 0);
+		ASSERT_EQ(tree.Count(), count / 2);
+
+		//fn返回false时停止
+		int n = 0;
+		ASSERT_EQ(tree.Scan(0, count, [&](const int&) { return ++n < 10; }), 10);
+
+		//读者都已退出，剩下的被删除节点可以全部回收
+		tree.Reclaim();
+		ASSERT_EQ(tree.m_epoch.Pending(), 0);
+	}
+}
+
+//epoch：登记中的读者阻止回收，离开后才释放；Clear可以与读者同时进行
+TEST(Concurrent, Epoch)
+{
+	TTreeEpoch epoch;
+	int freed = 0;
+
+	epoch.Retire(&freed);
+	{
+		TTreeEpochGuard guard(&epoch);
+		ASSERT_EQ(epoch.Reclaim([&](void*) { freed++; }), 0);
+	}
+	ASSERT_EQ(epoch.Reclaim([&](void*) { freed++; }), 1);
+	ASSERT_EQ(freed, 1);
+
+	//槽位全部被占用时Enter等到有读者离开
+	std::vector<unsigned int> slots;
+	for(int i = 0; i < TTREE_EPOCH_SLOTS; i++)
+	{
+		slots.push_back(epoch.Enter());
+	}
+
+	std::atomic<bool> entered(false);
+	std::thread waiter([&]() {
+		epoch.Leave(epoch.Enter());
+		entered = true;
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	ASSERT_FALSE(entered.load());
+	epoch.Leave(slots.back());
+	waiter.join();
+	ASSERT_TRUE(entered.load());
+
+	slots.pop_back();
+	for(unsigned int slot : slots)
+	{
+		epoch.Leave(slot);
+	}
+
+	//节点直接malloc/free，提前释放会被ASan发现
+	TTreeMallocAllocator allocator;
+	TTreeT<int> tree(true, 8, &allocator);
+	tree.SetConcurrent(true);
+
+	int count = 5000;
+	std::atomic<bool> stop(false);
+	std::atomic<int> errors(0);
+
+	std::vector<std::thread> readers;
+	for(int t = 0; t < 3; t++)
+	{
+		readers.emplace_back([&, t]() {
+			std::mt19937 rng(t);
+			while(!stop.load())
+			{
+				int key = rng() % count, found = -1;
+				if(tree.Find(key, &found) && found != key)
+				{
+					errors++;
+				}
+
+				int prev = -1;
+				tree.Scan(0, count, [&](const int& k) {
+					if(k <= prev)
+					{
+						errors++;
+					}
+					prev = k;
+					return true;
+				});
+			}
+		});
+	}
+
+	std::vector<int> keys;
+	for(int i = 0; i < count; i++)
+	{
+		keys.push_back(i);
+	}
+
+	for(int round = 0; round < 20; round++)
+	{
+		if(round % 2 == 0)
+		{
+			ASSERT_EQ(tree.BulkLoad(keys.data(), count, 0.8), 0);
+		}
+		else
+		{
+			for(int i = 0; i < count; i++)
+			{
+				tree.Insert(keys[(i * 7919) % count]);
+			}
+		}
+
+		for(int i = 0; i < count; i += 3)
+		{
+			tree.Delete(i);
+		}
+
+		tree.Clear();
+	}
+
+	stop = true;
+	for(std::thread& reader : readers)
+	{
+		reader.join();
+	}
+
+	ASSERT_EQ(errors.load(), 0);
+	ASSERT_EQ(tree.Count(), 0);
+
+	tree.Reclaim();
+	ASSERT_EQ(tree.m_epoch.Pending(), 0);
+}
+
+
+struct Row
+{
+	int pk;
+	int a;	//非唯一
+	int b;	//唯一
+};
+
+int rowPkComparator(const void* pa, const void* pb)
+{
+	return ((const Row*)pa)->pk - ((const Row*)pb)->pk;
+}
+
+int rowAComparator(const void* pa, const void* pb)
+{
+	return ((const Row*)pa)->a - ((const Row*)pb)->a;
+}
+
+int rowBComparator(const void* pa, const void* pb)
+{
+	return ((const Row*)pa)->b - ((const Row*)pb)->b;
+}
+
+//多索引表：串行与并行结果一致，主键或唯一二级索引重复时整条回滚
+TEST(Table, Indexes)
+{
+	int count = 3000;
+	std::vector<Row> rows(count);
+
+	for(int i = 0; i < count; i++)
+	{
+		rows[i].pk = i;
+		rows[i].a = i % 10;
+		rows[i].b = i;
+	}
+
+	for(unsigned int workers : {0, 1, 2})
+	{
+		TTreeTable table(rowPkComparator, 8, workers);
+		ASSERT_EQ(table.AddIndex(rowAComparator, false), 0);
+		ASSERT_EQ(table.AddIndex(rowBComparator, true), 1);
+
+		for(int i = 0; i < count / 2; i++)
+		{
+			ASSERT_EQ(table.Insert(&rows[i]), 0);
+		}
+		ASSERT_EQ(table.AddIndex(rowAComparator, false), -1);
+
+		//主键重复
+		Row dupPk = {5, 99, 100000};
+		ASSERT_EQ(table.Insert(&dupPk), -1);
+
+		//唯一二级索引重复，主键和非唯一索引上的插入被撤销
+		Row dupB = {100000, 99, 7};
+		ASSERT_EQ(table.Insert(&dupB), -1);
+
+		std::vector<void*> batch;
+		for(int i = count / 2; i < count; i++)
+		{
+			batch.push_back(&rows[i]);
+		}
+		batch.push_back(&dupPk);
+
+		std::vector<int> results(batch.size());
+		ASSERT_EQ(table.InsertBatch(batch.data(), batch.size(), results.data()), count - count / 2);
+		ASSERT_EQ(results.back(), -1);
+
+		ASSERT_EQ(table.Count(), count);
+		ASSERT_EQ(table.Index(0)->Count(), count);
+		ASSERT_EQ(table.Index(1)->Count(), count);
+		ASSERT_EQ(table.Index(0)->Get(&dupPk), nullptr);
+
+		//删除按主键找到表中的那条记录
+		for(int i = 0; i < count; i += 2)
+		{
+			Row key = {i, 0, 0};
+			ASSERT_EQ(table.Delete(&key), 0);
+		}
+		Row missing = {count, 0, 0};
+		ASSERT_EQ(table.Delete(&missing), -1);
+
+		ASSERT_EQ(table.Count(), count / 2);
+		ASSERT_EQ(table.Index(0)->Count(), count / 2);
+		ASSERT_EQ(table.Index(1)->Count(), count / 2);
+
+		for(int i = 0; i < count; i++)
+		{
+			ASSERT_EQ(table.Index(1)->Get(&rows[i]), i % 2 ? &rows[i] : nullptr);
+		}
+	}
+}
+
+
+//整表加载：多线程排序构建与逐条插入得到相同的索引顺序
+TEST(Table, Load)
+{
+	int count = 50000;
+	std::vector<Row> rows(count);
+	std::vector<void*> records;
+
+	for(int i = 0; i < count; i++)
+	{
+		rows[i].pk = (i * 7919) % count;
+		rows[i].a = rows[i].pk % 100;
+		rows[i].b = count - rows[i].pk;
+		records.push_back(&rows[i]);
+	}
+
+	for(unsigned int threads : {1, 2, 8})
+	{
+		TTreeTable table(rowPkComparator, 16);
+		table.AddIndex(rowAComparator, false);
+		table.AddIndex(rowBComparator, true);
+
+		ASSERT_EQ(table.Load(records.data(), count, 0.9, threads), 0);
+		ASSERT_EQ(table.Load(records.data(), count, 0.9, threads), -1);
+
+		ASSERT_EQ(table.Count(), count);
+		for(unsigned int i = 0; i < table.IndexCount(); i++)
+		{
+			ASSERT_EQ(table.Index(i)->Count(), count);
+		}
+
+		//非唯一索引内相等的key保持在records中的先后顺序
+		std::vector<void*> expect(records);
+		std::stable_sort(expect.begin(), expect.end(), [](void* a, void* b) { return rowAComparator(a, b) < 0; });
+
+		size_t n = 0;
+		for(TTreeIterator it = table.Index(0)->Begin(); !it.IsEOF(); it.Next())
+		{
+			ASSERT_EQ(*it.Get(), expect[n++]);
+		}
+
+		n = 0;
+		for(TTreeIterator it = table.Primary()->Begin(); !it.IsEOF(); it.Next())
+		{
+			ASSERT_EQ(((const Row*)*it.Get())->pk, n++);
+		}
+	}
+
+	//主键重复，全部回退为空表
+	Row dup = rows[10];
+	records.push_back(&dup);
+
+	TTreeTable table(rowPkComparator, 16);
+	table.AddIndex(rowAComparator, false);
+	ASSERT_EQ(table.Load(records.data(), records.size(), 1.0, 4), -1);
+	ASSERT_EQ(table.Count(), 0);
+	ASSERT_EQ(table.Index(0)->Count(), 0);
+}
+
+uint64_t pkHash(const void* pKey)
+{
+	return (uint64_t)((const Record*)pKey)->pk * 0x9E3779B97F4A7C15ull >> 32;
+}
+
+//分片树：多线程插入后，归并遍历与单棵树的顺序一致
+TEST(Partition, Modes)
+{
+	int count = 20000;
+	Record* pRecords = new Record[count];
+	std::shared_ptr<Record[]> ptr(pRecords);
+
+	for(int i = 0; i < count; i++)
+	{
+		pRecords[i].pk = i / 2;	//每个key两条
+	}
+
+	Record splits[3];
+	splits[0].pk = count / 8;
+	splits[1].pk = count / 4;
+	splits[2].pk = count / 3;
+	void* splitKeys[3] = {&splits[0], &splits[1], &splits[2]};
+
+	for(TTreePartitionMode mode : {TTREE_PARTITION_RANGE, TTREE_PARTITION_HASH})
+	{
+		std::unique_ptr<PartitionedTTree> pTree(mode == TTREE_PARTITION_RANGE ?
+			new PartitionedTTree(pkComparator, false, 8, splitKeys, 3) :
+			new PartitionedTTree(pkComparator, false, 8, pkHash, 4));
+
+		ASSERT_EQ(pTree->ShardNum(), 4);
+
+		std::vector<std::thread> writers;
+		for(int t = 0; t < 4; t++)
+		{
+			writers.emplace_back([&, t]() {
+				for(int i = t; i < count; i += 4)
+				{
+					pTree->Insert(pRecords + (i * 7919) % count);
+				}
+			});
+		}
+		for(std::thread& writer : writers)
+		{
+			writer.join();
+		}
+
+		ASSERT_EQ(pTree->Count(), count);
+		for(unsigned int i = 0; i < pTree->ShardNum(); i++)
+		{
+			ASSERT_GT(pTree->ShardTree(i)->Count(), 0);
+		}
+
+		int n = 0;
+		for(PartitionedTTree::Iterator it = pTree->Begin(); !it.IsEOF(); it.Next())
+		{
+			ASSERT_EQ(((const Record*)it.Get())->pk, n / 2);
+			n++;
+		}
+		ASSERT_EQ(n, count);
+
+		//跨分片的区间
+		Record lo, hi;
+		lo.pk = count / 8 - 10;
+		hi.pk = count / 3 + 10;
+		n = 0;
+		for(PartitionedTTree::Iterator it = pTree->Range(&lo, &hi); !it.IsEOF(); it.Next())
+		{
+			ASSERT_EQ(((const Record*)it.Get())->pk, lo.pk + n / 2);
+			n++;
+		}
+		ASSERT_EQ(n, (hi.pk - lo.pk + 1) * 2);
+
+		ASSERT_EQ(((const Record*)pTree->Query(pRecords + 100))->pk, 50);
+		ASSERT_EQ(pTree->Delete(pRecords + 100), 0);
+		ASSERT_EQ(pTree->Delete(pRecords + 101), 0);
+		ASSERT_EQ(pTree->Query(pRecords + 100), nullptr);
+
+		pTree->Clear();
+		ASSERT_TRUE(pTree->Begin().IsEOF());
+	}
+}
+
+
+//快照中的key保存为记录下标
+Record* g_pSnapshotRecords = nullptr;
+
+uint64_t recordEncoder(const void* pKey)
+{
+	return (const Record*)pKey - g_pSnapshotRecords;
+}
+
+void* recordDecoder(uint64_t id)
+{
+	return g_pSnapshotRecords + id;
+}
+
+//保存后映射，查找、遍历结果与原树一致
+TEST(Snapshot, SaveOpen)
+{
+	int count = 30000;
+	Record* pRecords = new Record[count];
+	std::shared_ptr<Record[]> ptr(pRecords);
+	g_pSnapshotRecords = pRecords;
+
+	TTree tree(pkComparator, false, 8);
+	for(int i = 0; i < count; i++)
+	{
+		pRecords[i].pk = ((i * 7919) % count) / 3 * 2;	//偶数，每个key三条
+		tree.Insert(pRecords + i);
+	}
+	for(int i = 0; i < count; i += 5)
+	{
+		tree.Delete(pRecords + i);
+	}
+
+	const char* path = "ttree_snapshot_test.bin";
+	ASSERT_EQ(tree.Save(path, recordEncoder), 0);
+
+	TTreeMapped mapped(pkComparator, recordDecoder);
+	ASSERT_EQ(mapped.Open(path), 0);
+	ASSERT_EQ(mapped.Count(), tree.Count());
+
+	TTreeIterator it = tree.Begin();
+	for(TTreeMapped::Iterator mit = mapped.Begin(); !mit.IsEOF(); mit.Next(), it.Next())
+	{
+		ASSERT_FALSE(it.IsEOF());
+		ASSERT_EQ(mit.Get(), *it.Get());
+	}
+	ASSERT_TRUE(it.IsEOF());
+
+	Record key;
+	for(key.pk = -1; key.pk <= count; key.pk++)
+	{
+		const void* pFound = tree.Query(&key);
+		void* pMapped = mapped.Query(&key);
+
+		ASSERT_EQ(pFound == nullptr, pMapped == nullptr);
+		if(pMapped)
+		{
+			ASSERT_EQ(((const Record*)pMapped)->pk, key.pk);
+		}
+
+		TTreeIterator lower = tree.LowerBound(&key);
+		TTreeMapped::Iterator mappedLower = mapped.LowerBound(&key);
+		ASSERT_EQ(lower.IsEOF(), mappedLower.IsEOF());
+		if(!lower.IsEOF())
+		{
+			ASSERT_EQ(mappedLower.Get(), *lower.Get());
+		}
+	}
+
+	Record lo, hi;
+	lo.pk = 101;
+	hi.pk = 500;
+	int n = 0;
+	for(TTreeMapped::Iterator mit = mapped.Range(&lo, &hi); !mit.IsEOF(); mit.Next(), n++)
+	{
+		ASSERT_GE(((const Record*)mit.Get())->pk, lo.pk);
+		ASSERT_LE(((const Record*)mit.Get())->pk, hi.pk);
+	}
+	int expect = 0;
+	for(TTreeIterator rit = tree.Range(&lo, &hi); !rit.IsEOF(); rit.Next())
+	{
+		expect++;
+	}
+	ASSERT_EQ(n, expect);
+	ASSERT_TRUE(mapped.Range(&hi, &lo).IsEOF());
+
+	//空树
+	tree.Clear();
+	ASSERT_EQ(tree.Save(path, recordEncoder), 0);
+	ASSERT_EQ(mapped.Open(path), 0);
+	ASSERT_EQ(mapped.Count(), 0);
+	ASSERT_EQ(mapped.Query(&lo), nullptr);
+	ASSERT_TRUE(mapped.Begin().IsEOF());
+
+	//截断的文件
+	FILE* fp = fopen(path, "wb");
+	fwrite("TMMTTREE", 1, 8, fp);
+	fclose(fp);
+	ASSERT_EQ(mapped.Open(path), -1);
+	ASSERT_EQ(mapped.Open("no_such_dir/ttree_snapshot_test.bin"), -1);
+	ASSERT_EQ(tree.Save("no_such_dir/ttree_snapshot_test.bin", recordEncoder), -1);
+
+	remove(path);
+}
+
+//组内按pk倒序
+int pkReverseComparator(const void* pa, const void* pb)
+{
+	return pkComparator(pb, pa);
+}
+
+//每10个pk为同一个key
+int pkGroupComparator(const void* pa, const void* pb)
+{
+	return ((const Record*)pa)->pk / 10 - ((const Record*)pb)->pk / 10;
+}
+
+//posting list：相等的key一次取出，组内有序，遍历顺序与普通非唯一树按(key, 组内顺序)排序一致
+TEST(Multi, Postings)
+{
+	int count = 20000;
+	std::vector<Record> keys(count);
+	for(int i = 0; i < count; i++)
+	{
+		keys[i].pk = i;
+	}
+
+	auto keyOf = [](const void* p) { return ((const Record*)p)->pk / 10; };
+
+	for(fnKeyComparator tiebreak : {(fnKeyComparator)nullptr, (fnKeyComparator)pkReverseComparator})
+	{
+		TTreeMulti tree(pkGroupComparator, 8, tiebreak);
+
+		for(int i = 0; i < count; i++)
+		{
+			ASSERT_EQ(tree.Insert(&keys[(i * 7919) % count]), 0);
+		}
+		ASSERT_EQ(tree.Insert(&keys[5]), -1);
+		ASSERT_EQ(tree.Count(), count);
+		ASSERT_EQ(tree.KeyCount(), count / 10);
+
+		void* const* matches;
+		ASSERT_EQ(tree.EqualRange(&keys[123], &matches), 10);
+		for(int i = 0; i < 10; i++)
+		{
+			int pk = tiebreak ? 129 - i : 120 + i;
+			ASSERT_EQ(matches[i], &keys[pk]);
+		}
+		ASSERT_EQ(tree.Query(&keys[125]), matches[0]);
+
+		//删到只剩一个、全部删除
+		for(int i = 0; i < 9; i++)
+		{
+			ASSERT_EQ(tree.Delete(&keys[120 + i]), 0);
+		}
+		ASSERT_EQ(tree.Delete(&keys[120]), -1);
+		ASSERT_EQ(tree.EqualRange(&keys[120], &matches), 1);
+		ASSERT_EQ(matches[0], &keys[129]);
+		ASSERT_EQ(tree.Delete(&keys[129]), 0);
+		ASSERT_EQ(tree.EqualRange(&keys[120], &matches), 0);
+		ASSERT_EQ(tree.Query(&keys[120]), nullptr);
+		ASSERT_EQ(tree.KeyCount(), count / 10 - 1);
+
+		//遍历
+		int n = 0, prev = -1;
+		for(TTreeMulti::Iterator it = tree.Begin(); !it.IsEOF(); it.Next(), n++)
+		{
+			int key = keyOf(it.Get());
+			ASSERT_GE(key, prev);
+			prev = key;
+		}
+		ASSERT_EQ(n, count - 10);
+
+		n = 0;
+		for(TTreeMulti::Iterator it = tree.Range(&keys[100], &keys[159]); !it.IsEOF(); it.Next(), n++)
+		{
+			ASSERT_GE(keyOf(it.Get()), 10);
+			ASSERT_LE(keyOf(it.Get()), 15);
+		}
+		ASSERT_EQ(n, 50);
+
+		ASSERT_TRUE(tree.m_tree.Verify());
+	}
+}
+
+//按主键顺序收集表中的记录内容
+std::vector<std::vector<int> > DumpRows(TTreeTable& table)
+{
+	std::vector<std::vector<int> > rows;
+
+	for(TTreeIterator it = table.Primary()->Begin(); !it.IsEOF(); it.Next())
+	{
+		const Row* pRow = (const Row*)*it.Get();
+		rows.push_back({pRow->pk, pRow->a, pRow->b});
+	}
+
+	return rows;
+}
+
+//预写日志：检查点加日志重放后与崩溃前的表一致，日志尾部损坏时丢弃不完整的项
+TEST(Wal, Recover)
+{
+	const char* logPath = "ttree_wal_test.log";
+	const char* checkpointPath = "ttree_wal_test.ckpt";
+	remove(logPath);
+	remove(checkpointPath);
+
+	int count = 6000;
+	std::vector<Row> rows(count);
+	for(int i = 0; i < count; i++)
+	{
+		rows[i].pk = (i * 7919) % count;
+		rows[i].a = rows[i].pk % 50;
+		rows[i].b = -rows[i].pk;
+	}
+
+	std::vector<std::vector<int> > expect;
+	{
+		TTreeTable table(rowPkComparator, 16);
+		table.AddIndex(rowAComparator, false);
+		table.AddIndex(rowBComparator, true);
+
+		TTreeWal wal(&table, sizeof(Row));
+		ASSERT_EQ(wal.Insert(&rows[0]), -1);	//还没有Open
+		ASSERT_EQ(wal.Open(logPath, checkpointPath), 0);
+
+		for(int i = 0; i < count / 2; i++)
+		{
+			ASSERT_EQ(wal.Insert(&rows[i]), 0);
+		}
+		ASSERT_EQ(wal.Insert(&rows[0]), -1);	//重复的不记日志
+		ASSERT_EQ(wal.LastLsn(), count / 2);
+
+		ASSERT_EQ(wal.Checkpoint(), 0);
+
+		std::vector<void*> batch;
+		for(int i = count / 2; i < count; i++)
+		{
+			batch.push_back(&rows[i]);
+		}
+		ASSERT_EQ(wal.InsertBatch(batch.data(), batch.size()), count - count / 2);
+
+		for(int i = 0; i < count; i += 3)
+		{
+			ASSERT_EQ(wal.Delete(&rows[i]), 0);
+		}
+
+		//删除后以不同内容重新插入
+		Row again = rows[3];
+		again.a = 7;
+		ASSERT_EQ(wal.Insert(&again), 0);
+		ASSERT_EQ(wal.Sync(), 0);
+
+		expect = DumpRows(table);
+	}
+
+	//模拟崩溃时写了一半的日志项
+	FILE* fp = fopen(logPath, "ab");
+	fwrite("torn", 1, 4, fp);
+	fclose(fp);
+
+	for(int round = 0; round < 2; round++)
+	{
+		TTreeTable table(rowPkComparator, 16);
+		table.AddIndex(rowAComparator, false);
+		table.AddIndex(rowBComparator, true);
+
+		TTreeWal wal(&table, sizeof(Row));
+		ASSERT_EQ(wal.Open(logPath, checkpointPath), 0);
+
+		ASSERT_EQ(DumpRows(table), expect);
+		ASSERT_EQ(table.Index(0)->Count(), expect.size());
+		ASSERT_EQ(table.Index(1)->Count(), expect.size());
+
+		//恢复出来的记录可以继续删除，第二轮从检查点恢复
+		Row key;
+		key.pk = expect[0][0];
+		ASSERT_EQ(wal.Delete(&key), 0);
+		expect.erase(expect.begin());
+
+		if(round == 0)
+		{
+			ASSERT_EQ(wal.Checkpoint(), 0);
+		}
+	}
+
+	//从检查点恢复的记录全部删除后，整块随之释放；删除时传入的就是表中存放的记录
+	{
+		TTreeTable table(rowPkComparator, 16);
+		TTreeWal wal(&table, sizeof(Row));
+		ASSERT_EQ(wal.Open(logPath, checkpointPath), 0);
+		ASSERT_EQ(wal.m_blocks.size(), 1);
+
+		for(auto& row : expect)
+		{
+			Row key;
+			key.pk = row[0];
+			ASSERT_EQ(wal.Delete(table.Get(&key)), 0);
+		}
+		ASSERT_EQ(table.Count(), 0);
+		ASSERT_TRUE(wal.m_blocks.empty());
+	}
+
+	//记录大小不一致的检查点不能加载
+	TTreeTable table(rowPkComparator, 16);
+	TTreeWal wal(&table, sizeof(Row) + 4);
+	ASSERT_EQ(wal.Open(logPath, checkpointPath), -1);
+	ASSERT_EQ(table.Count(), 0);
+
+	//重放出来的记录：通过表中的指针删掉第一块的全部记录，日志仍然正确
+	remove(logPath);
+	remove(checkpointPath);
+	{
+		TTreeTable table(rowPkComparator, 16);
+		TTreeWal wal(&table, sizeof(Row));
+		ASSERT_EQ(wal.Open(logPath, checkpointPath), 0);
+
+		for(int i = 0; i < count; i++)
+		{
+			ASSERT_EQ(wal.Insert(&rows[i]), 0);
+		}
+		ASSERT_EQ(wal.Sync(), 0);
+	}
+	{
+		TTreeTable table(rowPkComparator, 16);
+		TTreeWal wal(&table, sizeof(Row));
+		ASSERT_EQ(wal.Open(logPath, checkpointPath), 0);
+		ASSERT_EQ(wal.m_blocks.size(), (size_t)(count + TTREE_WAL_BLOCK - 1) / TTREE_WAL_BLOCK);
+
+		//第一块中的记录按插入顺序就是rows的前TTREE_WAL_BLOCK条
+		for(int i = 0; i < TTREE_WAL_BLOCK; i++)
+		{
+			ASSERT_EQ(wal.Delete(table.Get(&rows[i])), 0);
+		}
+		ASSERT_EQ(wal.m_blocks.size(), (size_t)(count + TTREE_WAL_BLOCK - 1) / TTREE_WAL_BLOCK - 1);
+		ASSERT_EQ(wal.Sync(), 0);
+	}
+	{
+		TTreeTable table(rowPkComparator, 16);
+		TTreeWal wal(&table, sizeof(Row));
+		ASSERT_EQ(wal.Open(logPath, checkpointPath), 0);
+		ASSERT_EQ(table.Count(), count - TTREE_WAL_BLOCK);
+		ASSERT_EQ(table.Get(&rows[0]), nullptr);
+		ASSERT_NE(table.Get(&rows[count - 1]), nullptr);
+	}
+
+	remove(logPath);
+	remove(checkpointPath);
+}
+
+//写盘失败后日志不再可用，修改不再进入表，重新Open后恢复
+TEST(Wal, WriteError)
+{
+	const char* logPath = "ttree_wal_error.log";
+	const char* checkpointPath = "ttree_wal_error.ckpt";
+	remove(logPath);
+	remove(checkpointPath);
+
+	std::vector<Row> rows(4);
+	for(int i = 0; i < 4; i++)
+	{
+		rows[i].pk = i;
+		rows[i].a = i;
+		rows[i].b = i;
+	}
+
+	TTreeTable table(rowPkComparator, 16);
+	TTreeWal wal(&table, sizeof(Row));
+	ASSERT_EQ(wal.Open(logPath, checkpointPath), 0);
+	ASSERT_EQ(wal.Insert(&rows[0]), 0);
+	ASSERT_EQ(wal.Sync(), 0);
+
+	//换成只读的描述符，下一次刷盘失败
+	int fd = open(logPath, O_RDONLY);
+	ASSERT_GE(fd, 0);
+	ASSERT_GE(dup2(fd, wal.m_fd), 0);
+	close(fd);
+
+	ASSERT_EQ(wal.Insert(&rows[1]), 0);
+	ASSERT_EQ(wal.Sync(), -1);
+
+	int results[2];
+	void* batch[2] = {&rows[2], &rows[3]};
+	ASSERT_EQ(wal.Insert(&rows[2]), -1);
+	ASSERT_EQ(wal.InsertBatch(batch, 2, results), 0);
+	ASSERT_EQ(results[0], -1);
+	ASSERT_EQ(results[1], -1);
+	ASSERT_EQ(wal.Delete(&rows[0]), -1);
+	ASSERT_EQ(table.Count(), 2);
+
+	//重新Open从落盘的日志恢复，只有失败之前的修改
+	wal.Close();
+	table.Clear();
+	ASSERT_EQ(wal.Open(logPath, checkpointPath), 0);
+	ASSERT_EQ(table.Count(), 1);
+	ASSERT_EQ(wal.Insert(&rows[2]), 0);
+
+	wal.Close();
+	remove(logPath);
+	remove(checkpointPath);
+}
+
+//压缩索引：随机增删后与std::set一致，覆盖极端key、id和大量重复key；密集时每项远小于16字节
+TEST(Packed, Encode)
+{
+	typedef std::pair<int64_t, uint64_t> Item;
+
+	std::mt19937_64 rng(25);
+	TTreePacked packed(false, 4);
+	std::set<Item> expect;
+
+	auto check = [&]()
+	{
+		std::vector<Item> items;
+		for(TTreePacked::Iterator it = packed.Begin(); !it.IsEOF(); it.Next())
+		{
+			items.push_back(std::make_pair(it.Key(), it.Id()));
+		}
+		ASSERT_EQ(items, std::vector<Item>(expect.begin(), expect.end()));
+		ASSERT_EQ(packed.Count(), expect.size());
+		ASSERT_TRUE(packed.m_tree.Verify());
+	};
+
+	int64_t extremes[] = {INT64_MIN, INT64_MIN + 1, -1, 0, 1, INT64_MAX - 1, INT64_MAX};
+	for(int64_t key : extremes)
+	{
+		for(uint64_t id : {(uint64_t)0, (uint64_t)7, UINT64_MAX})
+		{
+			ASSERT_EQ(packed.Insert(key, id), 0);
+			expect.insert(std::make_pair(key, id));
+		}
+	}
+	ASSERT_EQ(packed.Insert(0, 7), -1);
+	check();
+
+	for(int i = 0; i < 30000; i++)
+	{
+		int64_t key = (rng() % 4 == 0) ? (int64_t)rng() : (int64_t)(rng() % 2000) - 1000;
+		uint64_t id = (rng() % 8 == 0) ? rng() : rng() % 5000;
+
+		if(rng() % 3 == 0 && !expect.empty())
+		{
+			auto victim = expect.lower_bound(std::make_pair(key, (uint64_t)0));
+			if(victim == expect.end())
+			{
+				victim = expect.begin();
+			}
+			ASSERT_EQ(packed.Delete(victim->first, victim->second), 0);
+			ASSERT_EQ(packed.Delete(victim->first, victim->second), -1);
+			expect.erase(victim);
+		}
+		else
+		{
+			ASSERT_EQ(packed.Insert(key, id), expect.insert(std::make_pair(key, id)).second ? 0 : -1);
+		}
+	}
+	check();
+
+	for(int64_t key = -1002; key <= 1002; key++)
+	{
+		auto lower = expect.lower_bound(std::make_pair(key, (uint64_t)0));
+		uint64_t id;
+
+		ASSERT_EQ(packed.Query(key, &id), lower != expect.end() && lower->first == key);
+		if(lower != expect.end() && lower->first == key)
+		{
+			ASSERT_EQ(id, lower->second);
+		}
+
+		TTreePacked::Iterator it = packed.LowerBound(key);
+		ASSERT_EQ(it.IsEOF(), lower == expect.end());
+		if(!it.IsEOF())
+		{
+			ASSERT_EQ(it.Key(), lower->first);
+			ASSERT_EQ(it.Id(), lower->second);
+		}
+	}
+
+	size_t inRange = 0;
+	for(TTreePacked::Iterator it = packed.Range(-10, 10); !it.IsEOF(); it.Next())
+	{
+		inRange++;
+	}
+	ASSERT_EQ(inRange, (size_t)std::distance(expect.lower_bound(std::make_pair((int64_t)-10, (uint64_t)0)),
+		expect.lower_bound(std::make_pair((int64_t)11, (uint64_t)0))));
+
+	//全部删除
+	for(auto& item : std::vector<Item>(expect.begin(), expect.end()))
+	{
+		ASSERT_EQ(packed.Delete(item.first, item.second), 0);
+	}
+	expect.clear();
+	check();
+	ASSERT_EQ(packed.BlockCount(), 0u);
+
+	//唯一索引，递增的密集key、id
+	TTreePacked unique(true);
+	for(int i = 0; i < 100000; i++)
+	{
+		ASSERT_EQ(unique.Insert(i * 3, 1000000 + i), 0);
+	}
+	ASSERT_EQ(unique.Insert(300, 1), -1);
+
+	uint64_t id;
+	ASSERT_TRUE(unique.Query(300, &id));
+	ASSERT_EQ(id, 1000100u);
+	ASSERT_FALSE(unique.Query(301, &id));
+	ASSERT_LT(unique.MemoryUsage(), 100000u * 4);
+}
+
+int main(int argc, char** argv)
+{
+	::testing::InitGoogleTest(&argc, argv);
+	
+	return RUN_ALL_TESTS();
+}
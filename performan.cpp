@@ -4,17 +4,42 @@
 */
 
 #include "ttree.h"
+#include "ttree_table.h"
+#include "ttree_partition.h"
+#include "ttree_mapped.h"
+#include "ttree_wal.h"
+#include "ttree_multi.h"
+#include "ttree_packed.h"
 #include <string.h>
 #include <stdio.h>
 #include <thread>
+#include <mutex>
 
 #include <iostream>
 #include <map>
+#include <memory>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
 
 int g_sleepMs = 2;
 
+const char* g_bench = "insert";
+
 unsigned int g_keySize = 32;
 
+TTreeSearchMode g_searchMode = TTREE_SEARCH_AUTO;
+TTreeLayout g_layout = TTREE_LAYOUT_NODE;
+
+TTreePrefixMode g_prefixMode = TTREE_PREFIX_NONE;
+
+//维护二级索引的工作线程数，0为在调用线程中串行
+unsigned int g_workers = 0;
+
+//并发插入的线程数
+unsigned int g_threads = 4;
+
 struct Record
 {
     int pk;
@@ -59,74 +84,141 @@ int fnIndex4Comparator(const void* a, const void* b)
     return ((const Record*)a)->index4 - ((const Record*)b)->index4;
 }
 
+uint64_t fnPkPrefix(const void* a)
+{
+    return TTreeIntPrefix(((const Record*)a)->pk);
+}
+
+uint64_t fnIndex1Prefix(const void* a)
+{
+    return TTreeIntPrefix(((const Record*)a)->index1);
+}
+
+uint64_t fnIndex2Prefix(const void* a)
+{
+    return TTreeIntPrefix(((const Record*)a)->index2_A);
+}
+
+uint64_t fnIndex3Prefix(const void* a)
+{
+    return TTreeStringPrefix(((const Record*)a)->index3, sizeof(Record::index3));
+}
+
+uint64_t fnIndex4Prefix(const void* a)
+{
+    return TTreeIntPrefix(((const Record*)a)->index4);
+}
+
+uint64_t fnPkHash(const void* a)
+{
+    return (uint64_t)((const Record*)a)->pk * 0x9E3779B97F4A7C15ull >> 32;
+}
+
+/**
+ * 与fnXXXComparator相同的比较，作为TTreeT的模板参数可以被内联
+*/
+struct PkKeyCompare
+{
+    int operator()(const Record* a, const Record* b) const
+    {
+        return a->pk - b->pk;
+    }
+};
+
+struct Index1KeyCompare
+{
+    int operator()(const Record* a, const Record* b) const
+    {
+        return a->index1 - b->index1;
+    }
+};
 
 
 class TableOfRecord
 {
     public:
-        TableOfRecord(unsigned int keySize) : m_pk(fnPkComparator, true, keySize), m_index{{fnIndex1Comparator, false, keySize}, {fnIndex2Comparator, false, keySize}, {fnIndex3Comparator, false, keySize}, {fnIndex4Comparator, false, keySize}}
+        TableOfRecord(unsigned int keySize) : m_table(fnPkComparator, keySize, g_workers)
         {
+            fnKeyComparator indexComparator[4] = {fnIndex1Comparator, fnIndex2Comparator, fnIndex3Comparator, fnIndex4Comparator};
+            fnKeyPrefix indexPrefix[4] = {fnIndex1Prefix, fnIndex2Prefix, fnIndex3Prefix, fnIndex4Prefix};
+
+            m_table.Primary()->SetSearchMode(g_searchMode);
+            m_table.Primary()->SetKeyPrefix(fnPkPrefix, g_prefixMode);
 
+            for(int i = 0; i < 4; i++)
+            {
+                TTree* pIndex = m_table.Index(m_table.AddIndex(indexComparator[i], false));
+                pIndex->SetSearchMode(g_searchMode);
+                pIndex->SetKeyPrefix(indexPrefix[i], g_prefixMode);
+            }
         }
 
         int Insert(Record* pRecord)
         {
-            int rc = m_pk.Insert(pRecord);
+            return m_table.Insert(pRecord);
+        }
 
-            if(rc != 0)
-                return rc;
+        size_t InsertBatch(Record** pRecords, size_t n)
+        {
+            return m_table.InsertBatch((void**)pRecords, n);
+        }
 
-            for(int i = 0; i < 4; i++)
+        /**
+         * 整表加载：每个索引各自并行排序后BulkLoad，--threads个线程
+        */
+        int Load(Record* pRecords, size_t n, double fillFactor)
+        {
+            std::vector<void*> records(n);
+            for(size_t i = 0; i < n; i++)
             {
-                m_index[i].Insert(pRecord);
+                records[i] = &pRecords[i];
             }
 
-            return 0;
+            return m_table.Load(records.data(), n, fillFactor, g_threads);
         }
 
     private:
-        TTree   m_pk;
-        TTree   m_index[4];
+        TTreeTable  m_table;
 };
 
 
 struct pkComparator
 {
-    bool operator()(const Record* a, const Record* b)
+    bool operator()(const Record* a, const Record* b) const
     {
-        return fnPkComparator(a, b);
+        return fnPkComparator(a, b) < 0;
     }
 };
 
 struct index1Comparator
 {
-    bool operator()(const Record* a, const Record* b)
+    bool operator()(const Record* a, const Record* b) const
     {
-        return fnIndex1Comparator(a, b);
+        return fnIndex1Comparator(a, b) < 0;
     }
 };
 
 struct index2Comparator
 {
-    bool operator()(const Record* a, const Record* b)
+    bool operator()(const Record* a, const Record* b) const
     {
-        return fnIndex2Comparator(a, b);
+        return fnIndex2Comparator(a, b) < 0;
     }
 };
 
 struct index3Comparator
 {
-    bool operator()(const Record* a, const Record* b)
+    bool operator()(const Record* a, const Record* b) const
     {
-        return fnIndex3Comparator(a, b);
+        return fnIndex3Comparator(a, b) < 0;
     }
 };
 
 struct index4Comparator
 {
-    bool operator()(const Record* a, const Record* b)
+    bool operator()(const Record* a, const Record* b) const
     {
-        return fnIndex4Comparator(a, b);
+        return fnIndex4Comparator(a, b) < 0;
     }
 };
 
@@ -291,6 +383,672 @@ void BenchTableInsert(unsigned int overCount)
     std::cout << "map avg :" << mapSum/100 << std::endl;
 }
 
+/**
+ * 函数指针比较器与内联比较器的查询耗时对比
+*/
+void BenchQuery(size_t n)
+{
+    TTree pkTree(fnPkComparator, true, g_keySize);
+    TTree index1Tree(fnIndex1Comparator, false, g_keySize);
+    TTreeT<Record*, PkKeyCompare> pkTreeT(true, g_keySize);
+    TTreeT<Record*, Index1KeyCompare> index1TreeT(false, g_keySize);
+
+    pkTree.SetSearchMode(g_searchMode);
+    index1Tree.SetSearchMode(g_searchMode);
+    pkTree.SetKeyPrefix(fnPkPrefix, g_prefixMode);
+    index1Tree.SetKeyPrefix(fnIndex1Prefix, g_prefixMode);
+    pkTreeT.SetSearchMode(g_searchMode);
+    index1TreeT.SetSearchMode(g_searchMode);
+    pkTree.SetLayout(g_layout);
+    index1Tree.SetLayout(g_layout);
+    pkTreeT.SetLayout(g_layout);
+    index1TreeT.SetLayout(g_layout);
+
+    std::shared_ptr<Record[]> recordPtr(new Record[n]);
+
+    int ratio = (int)(0.9 * n);
+
+    for(size_t i = 0; i < n; i++)
+    {
+        recordPtr[i].pk = i;
+        recordPtr[i].index1 = i % ratio;
+
+        pkTree.Insert(&recordPtr[i]);
+        index1Tree.Insert(&recordPtr[i]);
+        pkTreeT.Insert(&recordPtr[i]);
+        index1TreeT.Insert(&recordPtr[i]);
+    }
+
+    auto bench = [&](const char* name, auto& tree)
+    {
+        size_t found = 0;
+        auto begin = std::chrono::steady_clock::now().time_since_epoch().count();
+        for(size_t i = 0; i < n; i++)
+        {
+            found += tree.Query(&recordPtr[(i * 7919) % n]) != nullptr;
+        }
+        auto end = std::chrono::steady_clock::now().time_since_epoch().count();
+
+        std::cout << name << " query elapse(us): " << (end - begin)/1000 << ", found: " << found << std::endl;
+    };
+
+    std::vector<void*> keys(n);
+    std::vector<const void*> out(n);
+    for(size_t i = 0; i < n; i++)
+    {
+        keys[i] = &recordPtr[(i * 7919) % n];
+    }
+
+    auto begin = std::chrono::steady_clock::now().time_since_epoch().count();
+    pkTree.QueryBatch(keys.data(), out.data(), n);
+    auto end = std::chrono::steady_clock::now().time_since_epoch().count();
+
+    std::cout << "record size    : " << n << std::endl;
+    std::cout << "ttree key size : " << g_keySize << std::endl;
+    std::cout << "pk     TTree  batch query elapse(us): " << (end - begin)/1000 << std::endl;
+    bench("pk     TTree ", pkTree);
+    bench("pk     TTreeT", pkTreeT);
+    bench("index1 TTree ", index1Tree);
+    bench("index1 TTreeT", index1TreeT);
+}
+
+/**
+ * 逐条插入与排序后批量构建的耗时对比
+*/
+void BenchLoad(size_t n)
+{
+    std::shared_ptr<Record[]> recordPtr(new Record[n]);
+
+    int ratio = (int)(0.9 * n);
+
+    for(size_t i = 0; i < n; i++)
+    {
+        recordPtr[i].pk = i;
+        recordPtr[i].index1 = i % ratio;
+        recordPtr[i].index2_A = i % ratio;
+        strncpy(recordPtr[i].index2_B, "test test test", sizeof(recordPtr[i].index2_B));
+        sprintf(recordPtr[i].index3, "test test %zu", i % ratio);
+        recordPtr[i].index4 = i % ratio;
+    }
+
+    TableOfRecord inserted(g_keySize);
+    auto begin = std::chrono::steady_clock::now().time_since_epoch().count();
+    for(size_t i = 0; i < n; i++)
+    {
+        inserted.Insert(&recordPtr[i]);
+    }
+    auto end = std::chrono::steady_clock::now().time_since_epoch().count();
+    std::cout << "insert elapse(us)   : " << (end - begin)/1000 << std::endl;
+
+    TableOfRecord loaded(g_keySize);
+    begin = std::chrono::steady_clock::now().time_since_epoch().count();
+    loaded.Load(recordPtr.get(), n, 1.0);
+    end = std::chrono::steady_clock::now().time_since_epoch().count();
+    std::cout << "bulk load elapse(us): " << (end - begin)/1000 << std::endl;
+}
+
+/**
+ * 逐条插入与按批插入(主键与二级索引流水线并行)的耗时对比，--workers指定工作线程数
+*/
+void BenchTableBatch(size_t n, size_t batch)
+{
+    std::shared_ptr<Record[]> recordPtr(new Record[n]);
+    std::vector<Record*> records(n);
+
+    int ratio = (int)(0.9 * n);
+
+    for(size_t i = 0; i < n; i++)
+    {
+        recordPtr[i].pk = i;
+        recordPtr[i].index1 = i % ratio;
+        recordPtr[i].index2_A = i % ratio;
+        strncpy(recordPtr[i].index2_B, "test test test", sizeof(recordPtr[i].index2_B));
+        sprintf(recordPtr[i].index3, "test test %zu", i % ratio);
+        recordPtr[i].index4 = i % ratio;
+
+        records[i] = &recordPtr[i];
+    }
+
+    TableOfRecord single(g_keySize);
+    auto begin = std::chrono::steady_clock::now().time_since_epoch().count();
+    for(size_t i = 0; i < n; i++)
+    {
+        single.Insert(records[i]);
+    }
+    auto end = std::chrono::steady_clock::now().time_since_epoch().count();
+    std::cout << "workers             : " << g_workers << std::endl;
+    std::cout << "insert elapse(us)   : " << (end - begin)/1000 << std::endl;
+
+    TableOfRecord batched(g_keySize);
+    begin = std::chrono::steady_clock::now().time_since_epoch().count();
+    for(size_t i = 0; i < n; i += batch)
+    {
+        batched.InsertBatch(records.data() + i, std::min(batch, n - i));
+    }
+    end = std::chrono::steady_clock::now().time_since_epoch().count();
+    std::cout << "batch elapse(us)    : " << (end - begin)/1000 << std::endl;
+}
+
+/**
+ * 多线程插入主键：单棵树加一把锁与按hash分片的对比，--threads指定线程数
+*/
+void BenchPartition(size_t n)
+{
+    std::shared_ptr<Record[]> recordPtr(new Record[n]);
+    for(size_t i = 0; i < n; i++)
+    {
+        recordPtr[i].pk = i;
+    }
+
+    auto run = [&](const char* name, auto insert)
+    {
+        std::vector<std::thread> threads;
+
+        auto begin = std::chrono::steady_clock::now().time_since_epoch().count();
+        for(unsigned int t = 0; t < g_threads; t++)
+        {
+            threads.emplace_back([&, t]() {
+                for(size_t i = t; i < n; i += g_threads)
+                {
+                    insert(&recordPtr[i]);
+                }
+            });
+        }
+        for(std::thread& thread : threads)
+        {
+            thread.join();
+        }
+        auto end = std::chrono::steady_clock::now().time_since_epoch().count();
+
+        std::cout << name << " insert elapse(us): " << (end - begin)/1000 << std::endl;
+    };
+
+    TTree single(fnPkComparator, true, g_keySize);
+    std::mutex lock;
+    run("single     ", [&](Record* pRecord) {
+        std::lock_guard<std::mutex> guard(lock);
+        single.Insert(pRecord);
+    });
+
+    PartitionedTTree partitioned(fnPkComparator, true, g_keySize, fnPkHash, g_threads * 4);
+    run("partitioned", [&](Record* pRecord) {
+        partitioned.Insert(pRecord);
+    });
+
+    std::cout << "threads        : " << g_threads << std::endl;
+    std::cout << "record size    : " << n << std::endl;
+}
+
+Record* g_pSnapshotRecords = nullptr;
+
+uint64_t fnRecordEncoder(const void* pKey)
+{
+    return (const Record*)pKey - g_pSnapshotRecords;
+}
+
+void* fnRecordDecoder(uint64_t id)
+{
+    return g_pSnapshotRecords + id;
+}
+
+/**
+ * 重启恢复：逐条插入重建与映射快照文件的耗时对比，以及映射后的查找耗时
+*/
+void BenchSnapshot(size_t n)
+{
+    std::shared_ptr<Record[]> recordPtr(new Record[n]);
+    g_pSnapshotRecords = recordPtr.get();
+
+    for(size_t i = 0; i < n; i++)
+    {
+        recordPtr[i].pk = (i * 7919) % n;
+    }
+
+    const char* path = "ttree_snapshot.bin";
+
+    TTree tree(fnPkComparator, true, g_keySize);
+    auto begin = std::chrono::steady_clock::now().time_since_epoch().count();
+    for(size_t i = 0; i < n; i++)
+    {
+        tree.Insert(&recordPtr[i]);
+    }
+    auto end = std::chrono::steady_clock::now().time_since_epoch().count();
+    std::cout << "rebuild elapse(us)     : " << (end - begin)/1000 << std::endl;
+
+    begin = std::chrono::steady_clock::now().time_since_epoch().count();
+    tree.Save(path, fnRecordEncoder);
+    end = std::chrono::steady_clock::now().time_since_epoch().count();
+    std::cout << "save elapse(us)        : " << (end - begin)/1000 << std::endl;
+
+    TTreeMapped mapped(fnPkComparator, fnRecordDecoder);
+    begin = std::chrono::steady_clock::now().time_since_epoch().count();
+    mapped.Open(path);
+    end = std::chrono::steady_clock::now().time_since_epoch().count();
+    std::cout << "open elapse(us)        : " << (end - begin)/1000 << std::endl;
+
+    auto query = [&](const char* name, auto fn)
+    {
+        size_t found = 0;
+
+        auto begin = std::chrono::steady_clock::now().time_since_epoch().count();
+        for(size_t i = 0; i < n; i++)
+        {
+            found += fn(&recordPtr[i]) != nullptr;
+        }
+        auto end = std::chrono::steady_clock::now().time_since_epoch().count();
+
+        std::cout << name << " query elapse(us): " << (end - begin)/1000 << " found " << found << std::endl;
+    };
+
+    query("tree  ", [&](Record* pKey) { return tree.Query(pKey); });
+    query("mapped", [&](Record* pKey) { return mapped.Query(pKey); });
+
+    mapped.Close();
+    remove(path);
+}
+
+/**
+ * 主键表的插入吞吐：纯内存、开日志只在最后Sync、每100条Sync一次
+*/
+void BenchWal(size_t n)
+{
+    std::shared_ptr<Record[]> recordPtr(new Record[n]);
+    for(size_t i = 0; i < n; i++)
+    {
+        recordPtr[i].pk = (i * 7919) % n;
+    }
+
+    const char* logPath = "ttree_wal.log";
+    const char* checkpointPath = "ttree_wal.ckpt";
+
+    auto run = [&](const char* name, bool logging, size_t syncEvery)
+    {
+        remove(logPath);
+        remove(checkpointPath);
+
+        TTreeTable table(fnPkComparator, g_keySize);
+        TTreeWal wal(&table, sizeof(Record));
+        wal.Open(logPath, checkpointPath);
+
+        auto begin = std::chrono::steady_clock::now().time_since_epoch().count();
+        for(size_t i = 0; i < n; i++)
+        {
+            if(!logging)
+            {
+                table.Insert(&recordPtr[i]);
+                continue;
+            }
+
+            wal.Insert(&recordPtr[i]);
+            if(syncEvery > 0 && (i + 1) % syncEvery == 0)
+            {
+                wal.Sync();
+            }
+        }
+        wal.Sync();
+        auto end = std::chrono::steady_clock::now().time_since_epoch().count();
+
+        std::cout << name << " insert elapse(us): " << (end - begin)/1000 << std::endl;
+    };
+
+    run("memory   ", false, 0);
+    run("wal      ", true, 0);
+    run("wal s/100", true, 100);
+
+    TTreeTable table(fnPkComparator, g_keySize);
+    TTreeWal wal(&table, sizeof(Record));
+    auto begin = std::chrono::steady_clock::now().time_since_epoch().count();
+    wal.Open(logPath, checkpointPath);
+    auto end = std::chrono::steady_clock::now().time_since_epoch().count();
+    std::cout << "recover elapse(us)       : " << (end - begin)/1000 << " records " << table.Count() << std::endl;
+
+    wal.Close();
+    remove(logPath);
+    remove(checkpointPath);
+}
+
+/**
+ * 按偏移分页：从头走offset步与Select直接定位的耗时对比
+*/
+void BenchPage(size_t n, unsigned int pageSize)
+{
+    std::shared_ptr<Record[]> recordPtr(new Record[n]);
+
+    TTree index4Tree(fnIndex4Comparator, false, g_keySize);
+    for(size_t i = 0; i < n; i++)
+    {
+        recordPtr[i].index4 = (i * 7919) % (n / 4);
+        index4Tree.Insert(&recordPtr[i]);
+    }
+
+    auto run = [&](const char* name, auto seek)
+    {
+        size_t pages = 0, sum = 0;
+
+        auto begin = std::chrono::steady_clock::now().time_since_epoch().count();
+        for(size_t offset = 0; offset < n; offset += n / 200)
+        {
+            TTreeIterator it = seek(offset);
+            for(unsigned int k = 0; k < pageSize && !it.IsEOF(); k++, it.Next())
+            {
+                sum += ((const Record*)*it.Get())->index4;
+            }
+            pages++;
+        }
+        auto end = std::chrono::steady_clock::now().time_since_epoch().count();
+
+        std::cout << name << " " << pages << " pages elapse(us): " << (end - begin)/1000 << " checksum " << sum << std::endl;
+    };
+
+    run("skip  ", [&](size_t offset) {
+        TTreeIterator it = index4Tree.Begin();
+        for(size_t k = 0; k < offset && !it.IsEOF(); k++)
+        {
+            it.Next();
+        }
+        return it;
+    });
+
+    run("select", [&](size_t offset) {
+        return index4Tree.Select(offset);
+    });
+
+    auto begin = std::chrono::steady_clock::now().time_since_epoch().count();
+    unsigned int count = 0;
+    for(int i = 0; i < 1000; i++)
+    {
+        count += index4Tree.Count();
+    }
+    auto end = std::chrono::steady_clock::now().time_since_epoch().count();
+    std::cout << "1000 Count() elapse(us): " << (end - begin)/1000 << " " << count / 1000 << std::endl;
+}
+
+/**
+ * 低基数的index1：普通非唯一树与posting list的插入、取出全部相等key的耗时对比
+*/
+void BenchMulti(size_t n, size_t distinct)
+{
+    std::shared_ptr<Record[]> recordPtr(new Record[n]);
+    for(size_t i = 0; i < n; i++)
+    {
+        recordPtr[i].index1 = (i * 7919) % distinct;
+    }
+
+    TTree plain(fnIndex1Comparator, false, g_keySize);
+    TTreeMulti multi(fnIndex1Comparator, g_keySize);
+
+    auto begin = std::chrono::steady_clock::now().time_since_epoch().count();
+    for(size_t i = 0; i < n; i++)
+    {
+        plain.Insert(&recordPtr[i]);
+    }
+    auto end = std::chrono::steady_clock::now().time_since_epoch().count();
+    std::cout << "plain insert elapse(us)    : " << (end - begin)/1000 << std::endl;
+
+    begin = std::chrono::steady_clock::now().time_since_epoch().count();
+    for(size_t i = 0; i < n; i++)
+    {
+        multi.Insert(&recordPtr[i]);
+    }
+    end = std::chrono::steady_clock::now().time_since_epoch().count();
+    std::cout << "posting insert elapse(us)  : " << (end - begin)/1000 << std::endl;
+
+    size_t found = 0;
+    begin = std::chrono::steady_clock::now().time_since_epoch().count();
+    for(size_t i = 0; i < distinct; i++)
+    {
+        for(TTreeIterator it = plain.Range(&recordPtr[i], &recordPtr[i]); !it.IsEOF(); it.Next())
+        {
+            found++;
+        }
+    }
+    end = std::chrono::steady_clock::now().time_since_epoch().count();
+    std::cout << "plain equal elapse(us)     : " << (end - begin)/1000 << " found " << found << std::endl;
+
+    found = 0;
+    begin = std::chrono::steady_clock::now().time_since_epoch().count();
+    for(size_t i = 0; i < distinct; i++)
+    {
+        void* const* matches;
+        found += multi.EqualRange(&recordPtr[i], &matches);
+    }
+    end = std::chrono::steady_clock::now().time_since_epoch().count();
+    std::cout << "posting equal elapse(us)   : " << (end - begin)/1000 << " found " << found << std::endl;
+
+    size_t plainNodes = 0, multiNodes = 0;
+    plain.ForEachNode([&](TTreeNode*) { plainNodes++; });
+    multi.m_tree.ForEachNode([&](TTreeMultiTree::Node*) { multiNodes++; });
+    std::cout << "nodes plain / posting      : " << plainNodes << " / " << multiNodes << std::endl;
+}
+
+/**
+ * 内联整数key：线性、二分、SIMD节点内查找的耗时对比
+*/
+void BenchSimd(size_t n)
+{
+    std::vector<int32_t> keys(n);
+    for(size_t i = 0; i < n; i++)
+    {
+        keys[i] = (int32_t)((i * 7919) % n) - (int32_t)(n / 2);
+    }
+
+    TTreeT<int32_t> tree(false, g_keySize);
+    for(size_t i = 0; i < n; i++)
+    {
+        tree.Insert(keys[i]);
+    }
+    std::cout << "simd level: " << TTreeSimdDetect() << " key size: " << g_keySize << std::endl;
+
+    auto run = [&](const char* name, TTreeSearchMode mode)
+    {
+        tree.SetSearchMode(mode);
+
+        size_t found = 0;
+        auto begin = std::chrono::steady_clock::now().time_since_epoch().count();
+        for(int round = 0; round < 4; round++)
+        {
+            for(size_t i = 0; i < n; i++)
+            {
+                found += tree.Query(keys[i]) != nullptr;
+            }
+        }
+        auto end = std::chrono::steady_clock::now().time_since_epoch().count();
+
+        std::cout << name << " query elapse(us): " << (end - begin)/1000 << " found " << found << std::endl;
+    };
+
+    run("linear", TTREE_SEARCH_LINEAR);
+    run("binary", TTREE_SEARCH_BINARY);
+    run("simd  ", TTREE_SEARCH_SIMD);
+}
+
+/**
+ * 递增的pk中夹杂latePercent%迟到的key：各分裂策略的插入耗时、节点数和平均填充
+*/
+void BenchAppend(size_t n, int latePercent)
+{
+    std::shared_ptr<Record[]> recordPtr(new Record[n]);
+    std::mt19937 rng(23);
+
+    for(size_t i = 0; i < n; i++)
+    {
+        bool late = (int)(rng() % 100) < latePercent && i > 10000;
+        recordPtr[i].pk = late ? (int)(i - rng() % 10000) * 2 + 1 : (int)i * 2;
+    }
+
+    auto run = [&](const char* name, TTreeSplitPolicy policy, double fill)
+    {
+        TTree pkTree(fnPkComparator, true, g_keySize);
+        pkTree.SetSplitPolicy(policy, fill);
+
+        auto begin = std::chrono::steady_clock::now().time_since_epoch().count();
+        for(size_t i = 0; i < n; i++)
+        {
+            pkTree.Insert(&recordPtr[i]);
+        }
+        auto end = std::chrono::steady_clock::now().time_since_epoch().count();
+
+        size_t nodes = 0;
+        pkTree.ForEachNode([&](TTreeNode*) { nodes++; });
+
+        std::cout << name << " insert elapse(us): " << (end - begin)/1000 << " nodes " << nodes
+                  << " avg fill " << (double)pkTree.Count() / nodes << " height " << pkTree.m_pRootNode->height << std::endl;
+    };
+
+    std::cout << "late keys: " << latePercent << "%, key size: " << g_keySize << std::endl;
+    run("shift      ", TTREE_SPLIT_SHIFT, 1);
+    run("fill   0.5 ", TTREE_SPLIT_FILL, 0.5);
+    run("append 1.0 ", TTREE_SPLIT_APPEND, 1);
+    run("append 0.9 ", TTREE_SPLIT_APPEND, 0.9);
+}
+
+/**
+ * 递增的pk逐个插入；以及分散的若干段连续key，逐个Insert与每段取一次hint后InsertHint的对比
+*/
+void BenchHint(size_t n, size_t run)
+{
+    std::shared_ptr<Record[]> recordPtr(new Record[n]);
+    for(size_t i = 0; i < n; i++)
+    {
+        recordPtr[i].pk = (int)i;
+    }
+
+    TTree appendTree(fnPkComparator, true, g_keySize);
+    auto begin = std::chrono::steady_clock::now().time_since_epoch().count();
+    for(size_t i = 0; i < n; i++)
+    {
+        appendTree.Insert(&recordPtr[i]);
+    }
+    auto end = std::chrono::steady_clock::now().time_since_epoch().count();
+    std::cout << "ascending insert elapse(us): " << (end - begin)/1000 << std::endl;
+
+    //每段run个连续key，段的顺序打乱；树中已有偶数key，段内插入奇数key
+    std::shared_ptr<Record[]> oddPtr(new Record[n]);
+    std::vector<size_t> runs(n / run);
+    for(size_t i = 0; i < runs.size(); i++)
+    {
+        runs[i] = i;
+    }
+    std::shuffle(runs.begin(), runs.end(), std::mt19937(24));
+
+    auto load = [&](TTree& tree)
+    {
+        for(size_t i = 0; i < n; i++)
+        {
+            recordPtr[i].pk = (int)i * 2;
+            oddPtr[i].pk = (int)i * 2 + 1;
+        }
+        for(size_t i = 0; i < n; i++)
+        {
+            tree.Insert(&recordPtr[i]);
+        }
+    };
+
+    TTree plain(fnPkComparator, true, g_keySize);
+    TTree hinted(fnPkComparator, true, g_keySize);
+    load(plain);
+    load(hinted);
+
+    begin = std::chrono::steady_clock::now().time_since_epoch().count();
+    for(size_t r : runs)
+    {
+        for(size_t i = r * run; i < (r + 1) * run; i++)
+        {
+            plain.Insert(&oddPtr[i]);
+        }
+    }
+    end = std::chrono::steady_clock::now().time_since_epoch().count();
+    std::cout << "clustered insert elapse(us): " << (end - begin)/1000 << std::endl;
+
+    begin = std::chrono::steady_clock::now().time_since_epoch().count();
+    for(size_t r : runs)
+    {
+        TTreeIterator hint = hinted.LowerBound(&oddPtr[r * run]);
+        for(size_t i = r * run; i < (r + 1) * run; i++)
+        {
+            hinted.InsertHint(hint, &oddPtr[i]);
+        }
+    }
+    end = std::chrono::steady_clock::now().time_since_epoch().count();
+    std::cout << "clustered hint   elapse(us): " << (end - begin)/1000 << " count " << hinted.Count() << std::endl;
+}
+
+struct PackedEntryCompare
+{
+    int operator()(const TTreePackedEntry& a, const TTreePackedEntry& b) const
+    {
+        return (b < a) - (a < b);
+    }
+};
+
+/**
+ * index1到记录号的二级索引：不压缩的(key, id)树与TTreePacked的内存和查询耗时对比。
+ * distinct为不同index1的个数
+*/
+void BenchPacked(size_t n, size_t distinct)
+{
+    std::mt19937 rng(25);
+    std::vector<TTreePackedEntry> entries(n);
+    for(size_t i = 0; i < n; i++)
+    {
+        entries[i].key = rng() % distinct;
+        entries[i].id = i;
+    }
+
+    std::vector<int64_t> probes(n);
+    for(size_t i = 0; i < n; i++)
+    {
+        probes[i] = rng() % distinct;
+    }
+
+    TTreeT<TTreePackedEntry, PackedEntryCompare> plain(PackedEntryCompare(), true, g_keySize);
+    TTreePacked packed(false, g_keySize / 4 > 0 ? g_keySize / 4 : 1);
+
+    auto begin = std::chrono::steady_clock::now().time_since_epoch().count();
+    for(size_t i = 0; i < n; i++)
+    {
+        plain.Insert(entries[i]);
+    }
+    auto end = std::chrono::steady_clock::now().time_since_epoch().count();
+
+    size_t nodes = 0;
+    plain.ForEachNode([&](TTreeT<TTreePackedEntry, PackedEntryCompare>::Node*) { nodes++; });
+    size_t plainBytes = nodes * TTreeT<TTreePackedEntry, PackedEntryCompare>::Node::AllocSize(g_keySize);
+    std::cout << "plain  insert elapse(us): " << (end - begin)/1000 << " memory " << plainBytes
+              << " bytes/entry " << (double)plainBytes / n << std::endl;
+
+    begin = std::chrono::steady_clock::now().time_since_epoch().count();
+    for(size_t i = 0; i < n; i++)
+    {
+        packed.Insert(entries[i].key, entries[i].id);
+    }
+    end = std::chrono::steady_clock::now().time_since_epoch().count();
+    std::cout << "packed insert elapse(us): " << (end - begin)/1000 << " memory " << packed.MemoryUsage()
+              << " bytes/entry " << (double)packed.MemoryUsage() / n << " blocks " << packed.BlockCount() << std::endl;
+
+    uint64_t sum = 0;
+    begin = std::chrono::steady_clock::now().time_since_epoch().count();
+    for(size_t i = 0; i < n; i++)
+    {
+        TTreePackedEntry probe = {probes[i], 0};
+        auto it = plain.LowerBound(probe);
+        sum += (it.IsEOF() || it.Get()->key != probes[i]) ? 0 : it.Get()->id;
+    }
+    end = std::chrono::steady_clock::now().time_since_epoch().count();
+    std::cout << "plain  query elapse(us): " << (end - begin)/1000 << " sum " << sum << std::endl;
+
+    sum = 0;
+    begin = std::chrono::steady_clock::now().time_since_epoch().count();
+    for(size_t i = 0; i < n; i++)
+    {
+        uint64_t id = 0;
+        packed.Query(probes[i], &id);
+        sum += id;
+    }
+    end = std::chrono::steady_clock::now().time_since_epoch().count();
+    std::cout << "packed query elapse(us): " << (end - begin)/1000 << " sum " << sum << std::endl;
+}
+
 void GetOption(int argc, char** argv)
 {
     for(int i = 1; i < argc; i++)
@@ -303,6 +1061,45 @@ void GetOption(int argc, char** argv)
         {
             g_sleepMs = atoi(argv[++i]);
         }
+        else if(strcmp(argv[i], "--search") == 0)
+        {
+            i++;
+            if(strcmp(argv[i], "linear") == 0)
+                g_searchMode = TTREE_SEARCH_LINEAR;
+            else if(strcmp(argv[i], "binary") == 0)
+                g_searchMode = TTREE_SEARCH_BINARY;
+            else if(strcmp(argv[i], "simd") == 0)
+                g_searchMode = TTREE_SEARCH_SIMD;
+            else
+                g_searchMode = TTREE_SEARCH_AUTO;
+        }
+        else if(strcmp(argv[i], "--layout") == 0)
+        {
+            i++;
+            g_layout = strcmp(argv[i], "cst") == 0 ? TTREE_LAYOUT_CST : TTREE_LAYOUT_NODE;
+        }
+        else if(strcmp(argv[i], "--prefix") == 0)
+        {
+            i++;
+            if(strcmp(argv[i], "bounds") == 0)
+                g_prefixMode = TTREE_PREFIX_BOUNDS;
+            else if(strcmp(argv[i], "slots") == 0)
+                g_prefixMode = TTREE_PREFIX_SLOTS;
+            else
+                g_prefixMode = TTREE_PREFIX_NONE;
+        }
+        else if(strcmp(argv[i], "--threads") == 0)
+        {
+            g_threads = atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--workers") == 0)
+        {
+            g_workers = atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "--bench") == 0)
+        {
+            g_bench = argv[++i];
+        }
     }
 }
 
@@ -312,7 +1109,59 @@ int main(int argc, char** argv)
 
     //CompareInsert();
 
-    BenchTableInsert(50 * 10000);
+    if(strcmp(g_bench, "query") == 0)
+    {
+        BenchQuery(50 * 10000);
+    }
+    else if(strcmp(g_bench, "load") == 0)
+    {
+        BenchLoad(50 * 10000);
+    }
+    else if(strcmp(g_bench, "table") == 0)
+    {
+        BenchTableBatch(50 * 10000, 1024);
+    }
+    else if(strcmp(g_bench, "partition") == 0)
+    {
+        BenchPartition(200 * 10000);
+    }
+    else if(strcmp(g_bench, "snapshot") == 0)
+    {
+        BenchSnapshot(200 * 10000);
+    }
+    else if(strcmp(g_bench, "wal") == 0)
+    {
+        BenchWal(50 * 10000);
+    }
+    else if(strcmp(g_bench, "page") == 0)
+    {
+        BenchPage(100 * 10000, 20);
+    }
+    else if(strcmp(g_bench, "append") == 0)
+    {
+        BenchAppend(100 * 10000, 0);
+        BenchAppend(100 * 10000, 5);
+    }
+    else if(strcmp(g_bench, "hint") == 0)
+    {
+        BenchHint(100 * 10000, 16);
+    }
+    else if(strcmp(g_bench, "simd") == 0)
+    {
+        BenchSimd(100 * 10000);
+    }
+    else if(strcmp(g_bench, "packed") == 0)
+    {
+        BenchPacked(100 * 10000, 10 * 10000);
+    }
+    else if(strcmp(g_bench, "multi") == 0)
+    {
+        BenchMulti(100 * 10000, 10 * 10000);
+    }
+    else
+    {
+        BenchTableInsert(50 * 10000);
+    }
 
     return 0;
 }
\ No newline at end of file
@@ -4,528 +4,174 @@
 */
 
 #include "ttree.h"
+#include "ttree_mapped.h"
 
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string>
+#include <unordered_map>
 
-TTree::TTree(fnKeyComparator fn, bool unique, unsigned int keySize)
-{
-	m_keyCmp = fn;
-	m_unique = unique;
-	m_keySize = keySize;
-
-	m_pRootNode = nullptr;
-}
-
-void TTree::Clear()
-{
-	if (m_pRootNode)
-	{
-		FreeNode(m_pRootNode);
-		delete m_pRootNode;
-		m_pRootNode = nullptr;
-	}
-}
 
-TTree::~TTree()
+//rename之后同步所在目录，目录项落盘后新文件名才可靠
+static int SyncParentDir(const std::string& path)
 {
-	Clear();
-}
+	size_t slash = path.find_last_of('/');
+	std::string dir = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
 
-void TTree::FreeNode(TTreeNode* pNode)
-{
-	if (pNode->left)
+	int fd = open(dir.c_str(), O_RDONLY);
+	if (fd < 0)
 	{
-		FreeNode(pNode->left);
-		delete pNode->left;
+		return -1;
 	}
 
-	if (pNode->right)
-	{
-		FreeNode(pNode->right);
-		delete pNode->right;
-	}
+	int rc = fsync(fd);
+	close(fd);
 
-	free(pNode->keys);
+	return rc == 0 ? 0 : -1;
 }
 
-
-int TTree::SearchForward(TTreeNode* pNode, const void* pKey, int* insertPos)
+TTree::TTree(fnKeyComparator fn, bool unique, unsigned int keySize, TTreeAllocator* pAllocator)
+	: TTreeT(TTreeFnComparator{fn}, unique, keySize, pAllocator, TTreeFnPrefix{nullptr})
 {
-	int found = -1;
-	int cmp;
-
-	*insertPos = pNode->keyNum;	//假设在最后面，若for循环了一遍都没有被赋值，假设成立
-
-	for(int i = 0; i < pNode->keyNum; i++)
-	{
-		cmp = m_keyCmp(pNode->keys[i], pKey);
-		if (cmp == 0)
-		{
-			found = i;
-			*insertPos = i + 1;
-			break;
-		}
-		else if (cmp > 0)
-		{
-			*insertPos = i;
-			break;
-		}
-	}
-
-	return found;
 }
 
-
-int TTree::SearchBackward(TTreeNode* pNode, const void* pKey, int* insertPos)
+const void* TTree::Query(void* pKey)
 {
-	int found = -1;
-	int cmp;
-
-	*insertPos = 0;
-
-	for(int i = pNode->keyNum; i > 0; i--)
+	//并发模式下不能返回节点内的地址，拷贝出来
+	if (m_concurrent)
 	{
-		cmp = m_keyCmp(pKey, pNode->keys[i - 1]);
-		if (cmp == 0)
-		{
-			found = i - 1;
-			*insertPos = i;
-			break;
-		}
-		else if (cmp > 0)
-		{
-			*insertPos = i;
-			break;
-		}
+		void* pFound;
+		return Find(pKey, &pFound) ? pFound : nullptr;
 	}
 
-	return found;
+	void* const* ppKey = TTreeT::Query(pKey);
+
+	return ppKey == nullptr ? nullptr : *ppKey;
 }
 
-int TTree::BinarySeach(TTreeNode* pNode, const void* pKey, int* insertPos)
+void TTree::QueryBatch(void** pKeys, const void** out, size_t n)
 {
-	int left = 0, right = pNode->keyNum, m, cmp;
+	void* const* found[TTREE_BATCH_GROUP];
 
-	while (left < right)
+	for (size_t base = 0; base < n; base += TTREE_BATCH_GROUP)
 	{
-		m = (left + right) / 2;
+		size_t num = (n - base) < TTREE_BATCH_GROUP ? (n - base) : TTREE_BATCH_GROUP;
 
-		cmp = m_keyCmp(pKey, pNode->keys[m]);
+		TTreeT::QueryBatch(pKeys + base, found, num);
 
-		if (cmp == 0)
-		{
-			*insertPos = m + 1;
-			return m;
-		}
-		else if (cmp < 0)
+		for (size_t i = 0; i < num; i++)
 		{
-			right = m;
-		}
-		else
-		{
-			left = m + 1;
+			out[base + i] = found[i] == nullptr ? nullptr : *found[i];
 		}
 	}
-
-	if(cmp > 0)
-		*insertPos = m + 1;
-	else
-		*insertPos = m;
-
-	return -1;
 }
 
 void* TTree::Get(const void* pKey)
 {
-	TTreeNode* pNode = m_pRootNode;
-	int index, insertPos;
-	void* pTarget = nullptr;
-
-	int cmpLeft, cmpRight;
-
-	while (pNode)
-	{
-		cmpLeft = m_keyCmp(pKey, pNode->FirstKey());
-		if (cmpLeft < 0)
-		{
-			pNode = pNode->left;
-			continue;
-		}
-		else if ((cmpRight = m_keyCmp(pKey, pNode->LastKey())) > 0)
-		{
-			pNode = pNode->right;
-			continue;
-		}
-		else
-		{
-			index = BinarySeach(pNode, pKey, &insertPos);
-			if (index > 0)
-				pTarget = pNode->keys[index];
-
-			break;
-		}
-	}
+	void** ppKey = TTreeT::Get((void*)pKey);
 
-	return pTarget;
+	return ppKey == nullptr ? nullptr : *ppKey;
 }
 
-
-int TTree::InsertIntoNode(TTreeNode* pNode, void* pKey)
+int TTree::SetKeyPrefix(fnKeyPrefix fn, TTreePrefixMode mode)
 {
-	int insertPos, foundIndex;
-	foundIndex = SearchBackward(pNode, pKey, &insertPos);
-	//foundIndex = BinarySeach(pNode, pKey, &insertPos);
-
-	if (m_unique && foundIndex >= 0)
+	if (m_pRootNode)
 	{
 		return -1;
 	}
-	
-	//往后挪
-	for (int i = pNode->keyNum; i > insertPos; i--)
-	{
-		pNode->keys[i] = pNode->keys[i - 1];
-	}
-	pNode->keys[insertPos] = pKey;
 
-	//插入前就挤满了格子，那么会多出来的一格，多出来的往右子树的最左边插
-	if (pNode->keyNum >= m_keySize)
-	{
-		void* pOverflow =  pNode->keys[m_keySize];
-		if (pNode->right)
-		{
-			TTreeNode* pMostLeft = GetLeft(pNode->right);
-			//满了
-			if(pMostLeft->keyNum >= m_keySize)
-			{
-				TTreeNode* pNewNode = new TTreeNode(m_keySize);
-				pNewNode->parent = pMostLeft;
-				pNewNode->keys[0] = pOverflow;
-				pNewNode->keyNum++;
-
-				pMostLeft->left = pNewNode;
-				Rebalance(pMostLeft);
-			}
-			else
-			{
-				for(int i = pMostLeft->keyNum; i > 0; i--)
-				{
-					pMostLeft->keys[i] = pMostLeft->keys[i - 1];
-				}
-				pMostLeft->keys[0] = pOverflow;
-				pMostLeft->keyNum++;
-			}
-		}
-		else
-		{
-			TTreeNode* pNewNode = new TTreeNode(m_keySize);
-			pNewNode->parent = pNode;
-			pNode->right = pNewNode;
-
-			pNewNode->keys[0] = pOverflow;
-			pNewNode->keyNum++;
+	m_keyPrefix.fn = fn;
 
-			Rebalance(pNode);
-		}
-	}
-	else
-	{
-		pNode->keyNum++;
-	}
-
-	return 0;
+	return SetPrefixMode(fn == nullptr ? TTREE_PREFIX_NONE : mode);
 }
 
-//取最左边的节点
-TTreeNode* TTree::GetLeft(TTreeNode* pNode)
+int TTree::Save(const char* path, fnKeyEncoder encoder)
 {
-	while (pNode->left)
-	{
-		pNode = pNode->left;
-	}
+	WriteGuard guard(this);
 
-	return pNode;
-}
+	//中序遍历，得到每个节点的key在id数组中的起始位置
+	std::vector<uint64_t> ids;
+	std::unordered_map<Node*, uint32_t> firsts;
 
-/**
- * RR型，直接左旋
- * 	P
- * 		R
- * 
- * 			R
- * 
- * RL型，先右旋，转化成RR型，再左旋
- * P
- * 		R
- * L
- * 
- * LL型与RR型类似，LR型与RL型类似
- * 
-*/
-
-void TTree::Rebalance(TTreeNode* pNode)
-{
-	int diff;	//左右子树高度差
-
-	do
+	for (Node* pNode = m_pRootNode ? GetLeft(m_pRootNode) : nullptr; pNode; pNode = Successor(pNode))
 	{
-		pNode->Reheight();
-
-		diff = TTREE_HEIGHT_OF(pNode->left) - TTREE_HEIGHT_OF(pNode->right);
-
-		//右子树过高
-		if (diff < -1)
+		if (ids.size() + pNode->keyNum >= TTREE_SNAPSHOT_NIL)
 		{
-			int subDiff = TTREE_HEIGHT_OF(pNode->right->left) - TTREE_HEIGHT_OF(pNode->right->right);
-			//RL型
-			if (subDiff > 0)
-			{
-				pNode = RightRotate(pNode->right->left);
-				pNode = LeftRotate(pNode);
-			}
-			//RR型
-			else
-			{
-				pNode = LeftRotate(pNode->right);
-			}
+			return -1;
 		}
-		//左子树过高
-		else if (diff > 1)
-		{
-			int subDiff = TTREE_HEIGHT_OF(pNode->left->left) - TTREE_HEIGHT_OF(pNode->left->right);
-			//LR型
-			if (subDiff < 0)
-			{
-				pNode = LeftRotate(pNode->left->right);
-				pNode = RightRotate(pNode);
-			}
-			else
-			{
-				pNode = RightRotate(pNode->left);
-			}
-		}
-		
-		if(pNode->parent == nullptr)
+
+		firsts[pNode] = ids.size();
+
+		for (unsigned int i = 0; i < pNode->keyNum; i++)
 		{
-			m_pRootNode = pNode;
+			ids.push_back(encoder(pNode->keys[i]));
 		}
-
-		pNode = pNode->parent;
 	}
-	while (pNode);
-
-}
 
+	//层序编号，子节点入队时的位置就是它的编号
+	std::vector<Node*> queue;
+	std::vector<TTreeSnapshotNode> nodes;
 
-int TTree::Insert(void* pKey)
-{
-	if (m_pRootNode == nullptr)
+	if (m_pRootNode)
 	{
-		m_pRootNode = new TTreeNode(m_keySize);
-		m_pRootNode->keys[0] = pKey;
-		m_pRootNode->keyNum++;
-		return 0;
+		queue.push_back(m_pRootNode);
 	}
-	
-	TTreeNode* pNode = m_pRootNode;
 
-	int cmpLeft, cmpRight;
-
-	while (true)
+	for (size_t i = 0; i < queue.size(); i++)
 	{
-		cmpLeft = m_keyCmp(pKey, pNode->FirstKey());
+		Node* pNode = queue[i];
+		TTreeSnapshotNode node;
 
-		// key < left
-		if (cmpLeft < 0)
-		{
-			if (pNode->left)
-			{
-				pNode = pNode->left;
-				continue;
-			}
-
-			//这个结点还有空间
-			else if(pNode->keyNum < m_keySize)
-			{
-				return InsertIntoNode(pNode, pKey);
-			}
-			else	// key 可能会下沉？
-			{
-				TTreeNode* pNewNode = new TTreeNode(m_keySize);
-				pNewNode->parent = pNode;
-				pNewNode->keys[0] = pKey;
-				pNewNode->keyNum++;
-
-				pNode->left = pNewNode;
-				Rebalance(pNode);
-
-				return 0;
-			}
-		}
+		node.first = firsts[pNode];
+		node.keyNum = pNode->keyNum;
+		node.left = node.right = TTREE_SNAPSHOT_NIL;
 
-		cmpRight = m_keyCmp(pKey, pNode->LastKey());
-		// key > right
-		if (cmpRight > 0)
+		if (pNode->left)
 		{
-			if (pNode->right)
-			{
-				pNode = pNode->right;
-				continue;
-			}	
-
-			//这个结点还有空间
-			if(pNode->keyNum < m_keySize)
-			{
-				return InsertIntoNode(pNode, pKey);
-			}
-
-			else
-			{
-				TTreeNode* pNewNode = new TTreeNode(m_keySize);
-				pNewNode->parent = pNode;
-				pNewNode->keys[0] = pKey;
-				pNewNode->keyNum++;
-
-				pNode->right = pNewNode;
-				Rebalance(pNode);
-				return 0;
-			}
+			node.left = queue.size();
+			queue.push_back(pNode->left);
 		}
-		
-		// left <= key <= right , key应当在这个node
-		return InsertIntoNode(pNode, pKey);
-	}
 
-	//不会到这里
-	return -1;
-}
-
-const void* TTree::Query(void* pKey)
-{
-	TTreeNode* pNode = m_pRootNode;
-
-	int cmpLeft, cmpRight, index, pos;
-
-	while (pNode)
-	{
-		cmpLeft = m_keyCmp(pKey, pNode->FirstKey());
-		if(cmpLeft < 0)
-		{
-			pNode = pNode->left;
-			continue;
-		}
-		
-		cmpRight = m_keyCmp(pKey, pNode->LastKey());
-		if(cmpRight > 0)
+		if (pNode->right)
 		{
-			pNode = pNode->right;
-			continue;
+			node.right = queue.size();
+			queue.push_back(pNode->right);
 		}
 
-		index = SearchBackward(pNode, pKey, &pos);
-
-		if(index >= 0)
-		{
-			return pNode->keys[index];
-		}
-		else
-		{
-			return nullptr;
-		}
+		nodes.push_back(node);
 	}
 
-	return nullptr;
-}
-
-int TTree::Delete(void* pKey)
-{
-
-	return 0;
-}
-
-unsigned int TTree::Count()
-{
-	return m_pRootNode == nullptr ? 0 : Count(m_pRootNode);
-}
-
-unsigned int TTree::Count(TTreeNode* pNode)
-{
-	return pNode->keyNum + \
-			(pNode->left == nullptr ? 0 : Count(pNode->left)) + 
-			(pNode->right == nullptr ? 0 : Count(pNode->right));
-}
-/** 左旋，右子树的树高转移到左子树，
- * 
- *			pParent 		
- * 				pNode
- * 		pLeft		pRight
- * 					
-*/
-
-TTreeNode* TTree::LeftRotate(TTreeNode* pNode)
-{
-	TTreeNode* pParent = pNode->parent;		//parent 肯定存在
-	TTreeNode* pLeft = pNode->left;
+	TTreeSnapshotHeader header;
+	header.magic = TTREE_SNAPSHOT_MAGIC;
+	header.version = TTREE_SNAPSHOT_VERSION;
+	header.unique = m_unique;
+	header.keySize = m_keySize;
+	header.nodeNum = nodes.size();
+	header.keyNum = ids.size();
 
-	//如果存在祖父节点，祖父的孙子(即pNode)变成儿子
-	if (pParent->parent)
-	{
-		if (pParent == pParent->parent->left)
-		{
-			pParent->parent->left = pNode;
-		}
-		else
-		{
-			pParent->parent->right = pNode;
-		}
-	}
+	std::string tmpPath = std::string(path) + ".tmp";
 
-	pNode->parent = pParent->parent;
-	pNode->left = pParent;
-	if(pLeft)
+	FILE* fp = fopen(tmpPath.c_str(), "wb");
+	if (fp == nullptr)
 	{
-		pLeft->parent = pParent;
+		return -1;
 	}
 
+	//空树只有文件头
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 && (nodes.empty() ||
+		(fwrite(nodes.data(), sizeof(TTreeSnapshotNode), nodes.size(), fp) == nodes.size() &&
+		fwrite(ids.data(), sizeof(uint64_t), ids.size(), fp) == ids.size()));
 
-	pParent->parent = pNode;
-	pParent->right = pLeft;
-
-	//pParent和pNode的父子关系互换了，需要子节点先reheight
-	pParent->Reheight();
-	pNode->Reheight();
+	//数据落盘后再rename，否则崩溃后可能留下一个不完整的快照
+	ok = ok && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+	ok = (fclose(fp) == 0) && ok;
 
-	return pNode;
-}
-
-TTreeNode* TTree::RightRotate(TTreeNode* pNode)
-{
-	TTreeNode* pParent = pNode->parent;
-	TTreeNode* pRight = pNode->right;
-
-	if (pParent->parent)
+	if (!ok || rename(tmpPath.c_str(), path) != 0)
 	{
-		if (pParent == pParent->parent->left)
-		{
-			pParent->parent->left = pNode;
-		}
-		else
-		{
-			pParent->parent->right = pNode;
-		}
-	}
-
-	pNode->parent = pParent->parent;
-	pNode->right = pParent;
-	if (pRight)
-	{
-		pRight->parent = pParent;
+		remove(tmpPath.c_str());
+		return -1;
 	}
 
-	pParent->parent = pNode;
-	pParent->left = pRight;
-
-	pParent->Reheight();
-	pNode->Reheight();
-
-	return pNode;
-}
\ No newline at end of file
+	return SyncParentDir(path);
+}
@@ -7,169 +7,76 @@
 #define __TTREE_H__
 
 #include <stdlib.h>
-#include <vector>
 
+#include "ttree_t.h"
 
-typedef int (*fnKeyComparator)(const void* pa, const void* pb);
-
-#define TTREE_HEIGHT_OF(node) (node == nullptr ? 0 : node->height)
-#define MAX(a, b) (a > b ? a : b)
 
+typedef int (*fnKeyComparator)(const void* pa, const void* pb);
 
-struct TTreeNode
+/**
+ * 函数指针比较器的适配，供void*版本的TTree使用
+*/
+struct TTreeFnComparator
 {
-	int				height;		//高度
-	unsigned int	keyNum;		//key数量
-	void**			keys;		//key指针
-
-	union {
-		TTreeNode* children[2];
-		struct
-		{
-			TTreeNode* left;
-			TTreeNode* right;
-		};
-	};
-
-	TTreeNode* parent;
-
-	void* FirstKey()
-	{
-		return keyNum == 0 ? nullptr : keys[0];
-	}
+	fnKeyComparator	fn;
 
-	void* LastKey()
+	int operator()(const void* pa, const void* pb) const
 	{
-		return keyNum == 0 ? nullptr : keys[keyNum - 1];
+		return fn(pa, pb);
 	}
+};
 
-	void Reheight()
-	{
-		height = MAX(TTREE_HEIGHT_OF(left), TTREE_HEIGHT_OF(right)) + 1;
-	}
+typedef uint64_t (*fnKeyPrefix)(const void* pKey);
 
-	TTreeNode(unsigned int size)
-	{
-		//多申请一格，插入时有可能挤出来一个key
-		keys = (void**)malloc(sizeof(void*) * (size + 1));
-		parent = left = right = nullptr;
+/**
+ * 函数指针前缀的适配，每次操作只调用一次
+*/
+struct TTreeFnPrefix
+{
+	fnKeyPrefix	fn;
 
-		keyNum = 0;
-		height = 1;
+	uint64_t operator()(const void* pKey) const
+	{
+		return fn(pKey);
 	}
 };
 
-class TTreeIterator
-{
-	public:
-		void Reserve(size_t size)
-		{
-			m_keys.reserve(size);
-		}
-
-		void Add(void* pKey)
-		{
-			m_keys.push_back(pKey);
-		}
-
-		void* Get()
-		{
-			if(IsEOF())
-			{
-				return nullptr;
-			}
-
-			return m_keys[m_current];
-		}
-
-		bool IsEOF()
-		{
-			return m_current == m_keys.size();
-		}
-
-		bool Next()
-		{
-			if(m_current < m_keys.size())
-			{
-				m_current++;
-				return true;
-			}
-
-			return false;
-		}
-
-		void Reset()
-		{
-			m_current = 0;
-		}
-
-	private:
-		std::vector<void*>	m_keys;
-		size_t m_current {0};
-};
+//把key编码成可以持久化的id，如记录号或文件偏移
+typedef uint64_t (*fnKeyEncoder)(const void* pKey);
+
+typedef TTreeNodeT<void*> TTreeNode;
+
+typedef TTreeCursorT<void*, TTreeFnComparator> TTreeIterator;
 
-class TTree
+/**
+ * key为void*、比较器为函数指针的T树，比较时无法内联，
+ * 对性能敏感的场景直接使用TTreeT<Key, Compare>
+*/
+class TTree : public TTreeT<void*, TTreeFnComparator, TTreeFnPrefix>
 {
 public:
-	TTree(fnKeyComparator fn, bool unique, unsigned int keySize);
-
-	//自上而下插入
-	int Insert(void* pKey);
+	TTree(fnKeyComparator fn, bool unique, unsigned int keySize, TTreeAllocator* pAllocator = nullptr);
 
+	//并发模式下可以与写操作同时调用
 	const void* Query(void* pKey);
 
-	int Delete(void* pKey);
-
-	unsigned int Count();
-
-	void Clear();
-
-	~TTree();
-
-//private:
-public:
-	unsigned int Count(TTreeNode* pNode);
 	/**
-	 * 二分查找
+	 * 批量查找，out[i]为与pKeys[i]相等的key，找不到为nullptr
 	*/
-	int BinarySeach(TTreeNode* pNode, const void* pKey, int* insertPos);
+	void QueryBatch(void** pKeys, const void** out, size_t n);
+
+	void* Get(const void* pKey);
 
 	/**
-	 * 从前往后找
+	 * 开启key前缀缓存，fn需要保序，只能在树为空时设置
 	*/
-	int SearchForward(TTreeNode* pNode, const void* pKey, int* insertPos);
+	int SetKeyPrefix(fnKeyPrefix fn, TTreePrefixMode mode);
 
 	/**
-	 * 从后往前找
+	 * 把树保存为快照文件，每个key用encoder编码成id，由TTreeMapped映射后直接查询。
+	 * 先写到path.tmp再改名，失败返回-1。并发模式下期间阻塞写操作
 	*/
-	int SearchBackward(TTreeNode* pNode, const void* pKey, int* insertPos);
-
-	void* Get(const void* pKey);
-
-	int InsertIntoNode(TTreeNode* pNode, void* pKey);
-
-	void InsertIntoLeft(TTreeNode* pNode, void* pKey);
-
-	//取最左边的节点
-	TTreeNode* GetLeft(TTreeNode* pNode);
-
-	void Rebalance(TTreeNode* pNode);
-
-	TTreeNode* LeftRotate(TTreeNode* pNode);
-
-	TTreeNode* RightRotate(TTreeNode* pNode);
-
-	void FreeNode(TTreeNode* pNode);
-	
-//private:
-public:
-	bool			m_unique;
-	fnKeyComparator	m_keyCmp;
-
-	TTreeNode* 		m_pRootNode;
-
-	unsigned int 	m_keySize;
+	int Save(const char* path, fnKeyEncoder encoder);
 };
 
 #endif
-
@@ -0,0 +1,256 @@
+/**
+ * @brief	T树节点分配器
+ * @author	huangxx
+*/
+
+#ifndef __TTREE_ALLOC_H__
+#define __TTREE_ALLOC_H__
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <new>
+
+
+#define TTREE_CACHE_LINE 64
+
+//每个slab的默认大小
+#define TTREE_SLAB_SIZE (64 * 1024)
+
+
+/**
+ * 节点分配器接口，size已按缓存行对齐，返回的内存也需要按缓存行对齐
+*/
+class TTreeAllocator
+{
+public:
+	virtual ~TTreeAllocator()
+	{
+	}
+
+	virtual void* Alloc(size_t size) = 0;
+
+	virtual void Free(void* p, size_t size) = 0;
+
+	/**
+	 * 一次释放分配过的全部内存，不支持时返回false，由调用方逐个Free
+	*/
+	virtual bool Reset()
+	{
+		return false;
+	}
+};
+
+/**
+ * 直接使用aligned_alloc/free
+*/
+class TTreeMallocAllocator : public TTreeAllocator
+{
+public:
+	void* Alloc(size_t size) override
+	{
+		return aligned_alloc(TTREE_CACHE_LINE, size);
+	}
+
+	void Free(void* p, size_t) override
+	{
+		free(p);
+	}
+};
+
+/**
+ * 定长块的slab池：分配时优先从空闲链表取，否则在当前slab内移动指针；
+ * Reset一次释放所有slab。
+ * 块大小由Reset后第一次Alloc决定，大小不同的请求单独aligned_alloc，
+ * 前面多一个缓存行挂在链表上，Reset时一并释放
+*/
+class TTreeNodePool : public TTreeAllocator
+{
+public:
+	TTreeNodePool(size_t slabSize = TTREE_SLAB_SIZE)
+	{
+		m_slabSize = slabSize;
+		m_blockSize = 0;
+
+		m_pSlabs = nullptr;
+		m_pCur = m_pEnd = nullptr;
+		m_pFree = nullptr;
+		m_pLarge = nullptr;
+	}
+
+	~TTreeNodePool()
+	{
+		Reset();
+	}
+
+	void* Alloc(size_t size) override
+	{
+		if (m_blockSize == 0)
+		{
+			m_blockSize = size;
+		}
+		else if (size != m_blockSize)
+		{
+			return AllocLarge(size);
+		}
+
+		if (m_pFree)
+		{
+			FreeBlock* pBlock = m_pFree;
+			m_pFree = pBlock->next;
+			return pBlock;
+		}
+
+		if (m_pCur + m_blockSize > m_pEnd)
+		{
+			NewSlab();
+		}
+
+		void* p = m_pCur;
+		m_pCur += m_blockSize;
+
+		return p;
+	}
+
+	void Free(void* p, size_t size) override
+	{
+		if (size != m_blockSize)
+		{
+			FreeLarge(p);
+			return;
+		}
+
+		FreeBlock* pBlock = (FreeBlock*)p;
+		pBlock->next = m_pFree;
+		m_pFree = pBlock;
+	}
+
+	bool Reset() override
+	{
+		while (m_pSlabs)
+		{
+			Slab* pNext = m_pSlabs->next;
+			free(m_pSlabs);
+			m_pSlabs = pNext;
+		}
+
+		while (m_pLarge)
+		{
+			LargeBlock* pNext = m_pLarge->next;
+			free(m_pLarge);
+			m_pLarge = pNext;
+		}
+
+		m_pCur = m_pEnd = nullptr;
+		m_pFree = nullptr;
+		m_blockSize = 0;
+
+		return true;
+	}
+
+	//已申请的slab数量
+	size_t SlabCount()
+	{
+		size_t n = 0;
+		for (Slab* pSlab = m_pSlabs; pSlab; pSlab = pSlab->next)
+		{
+			n++;
+		}
+
+		return n;
+	}
+
+private:
+	void NewSlab()
+	{
+		//slab头占一个缓存行，至少放得下一个块
+		size_t size = TTREE_CACHE_LINE + m_blockSize;
+		if (size < m_slabSize)
+		{
+			size = m_slabSize / TTREE_CACHE_LINE * TTREE_CACHE_LINE;
+		}
+
+		Slab* pSlab = (Slab*)aligned_alloc(TTREE_CACHE_LINE, size);
+		if (pSlab == nullptr)
+		{
+			throw std::bad_alloc();
+		}
+
+		pSlab->next = m_pSlabs;
+		m_pSlabs = pSlab;
+
+		m_pCur = (char*)pSlab + TTREE_CACHE_LINE;
+		m_pEnd = (char*)pSlab + size;
+	}
+
+	void* AllocLarge(size_t size)
+	{
+		LargeBlock* pBlock = (LargeBlock*)aligned_alloc(TTREE_CACHE_LINE, TTREE_CACHE_LINE + size);
+		if (pBlock == nullptr)
+		{
+			throw std::bad_alloc();
+		}
+
+		pBlock->prev = nullptr;
+		pBlock->next = m_pLarge;
+		if (m_pLarge)
+		{
+			m_pLarge->prev = pBlock;
+		}
+		m_pLarge = pBlock;
+
+		return (char*)pBlock + TTREE_CACHE_LINE;
+	}
+
+	void FreeLarge(void* p)
+	{
+		LargeBlock* pBlock = (LargeBlock*)((char*)p - TTREE_CACHE_LINE);
+
+		if (pBlock->prev)
+		{
+			pBlock->prev->next = pBlock->next;
+		}
+		else
+		{
+			m_pLarge = pBlock->next;
+		}
+
+		if (pBlock->next)
+		{
+			pBlock->next->prev = pBlock->prev;
+		}
+
+		free(pBlock);
+	}
+
+//private:
+public:
+	struct Slab
+	{
+		Slab*	next;
+	};
+
+	struct FreeBlock
+	{
+		FreeBlock*	next;
+	};
+
+	//大小不同的块的头，占一个缓存行
+	struct LargeBlock
+	{
+		LargeBlock*	prev;
+		LargeBlock*	next;
+	};
+
+	size_t		m_slabSize;
+	size_t		m_blockSize;
+
+	Slab*		m_pSlabs;	//所有slab的链表
+	char*		m_pCur;		//当前slab中下一个可分配的位置
+	char*		m_pEnd;
+
+	FreeBlock*	m_pFree;	//空闲块链表
+
+	LargeBlock*	m_pLarge;	//大小不同的块的链表
+};
+
+#endif
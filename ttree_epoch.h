@@ -0,0 +1,198 @@
+/**
+ * @brief	基于epoch的延迟回收
+ * @author	huangxx
+*/
+
+#ifndef __TTREE_EPOCH_H__
+#define __TTREE_EPOCH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "ttree_alloc.h"
+
+
+//同时读的线程数上限，超过时Enter等待空闲槽位
+#define TTREE_EPOCH_SLOTS 64
+
+//待回收的节点攒够这么多时尝试回收一次
+#define TTREE_EPOCH_BATCH 64
+
+
+/**
+ * 读者进入时在一个槽位登记当前epoch，离开时清空；
+ * 写者摘下的内存记上当时的epoch，等所有登记中的epoch都比它大之后才真正释放。
+ * Enter、Leave可以多线程调用，Retire、Reclaim只能由持有写锁的线程调用
+*/
+class TTreeEpoch
+{
+public:
+	TTreeEpoch()
+	{
+		m_epoch.store(1, std::memory_order_relaxed);
+
+		for (unsigned int i = 0; i < TTREE_EPOCH_SLOTS; i++)
+		{
+			m_slots[i].epoch.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	TTreeEpoch(const TTreeEpoch&) = delete;
+
+	TTreeEpoch& operator=(const TTreeEpoch&) = delete;
+
+	/**
+	 * 登记当前epoch，返回占用的槽位
+	*/
+	unsigned int Enter()
+	{
+		static thread_local unsigned int s_hint = 0;
+
+		for (;;)
+		{
+			for (unsigned int n = 0; n < TTREE_EPOCH_SLOTS; n++)
+			{
+				unsigned int i = (s_hint + n) % TTREE_EPOCH_SLOTS;
+				Slot& slot = m_slots[i];
+				uint64_t expected = 0;
+
+				if (slot.epoch.load(std::memory_order_relaxed) == 0 &&
+					slot.epoch.compare_exchange_strong(expected, m_epoch.load(std::memory_order_acquire)))
+				{
+					//与Reclaim中的fence配对：要么回收方看到这个槽位，要么读者看到内存已经被摘下
+					std::atomic_thread_fence(std::memory_order_seq_cst);
+
+					s_hint = i;
+					return s_hint;
+				}
+			}
+
+			//所有槽位都被占用，让出CPU等读者离开
+			std::this_thread::yield();
+		}
+	}
+
+	void Leave(unsigned int slot)
+	{
+		m_slots[slot].epoch.store(0, std::memory_order_release);
+	}
+
+	/**
+	 * p已经不能从树上访问到，记下当前epoch等待回收
+	*/
+	void Retire(void* p)
+	{
+		m_retired.push_back(Retired{p, m_epoch.load(std::memory_order_relaxed)});
+	}
+
+	/**
+	 * 推进epoch，对所有读者都已离开的内存调用fn，返回释放的数量
+	*/
+	template <typename Fn>
+	size_t Reclaim(Fn fn)
+	{
+		m_epoch.fetch_add(1, std::memory_order_release);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		//登记中最小的epoch，比它小的retire之后才进入的读者不会再看到
+		uint64_t minEpoch = m_epoch.load(std::memory_order_relaxed);
+		for (unsigned int i = 0; i < TTREE_EPOCH_SLOTS; i++)
+		{
+			uint64_t epoch = m_slots[i].epoch.load(std::memory_order_acquire);
+			if (epoch != 0 && epoch < minEpoch)
+			{
+				minEpoch = epoch;
+			}
+		}
+
+		size_t kept = 0, freed = 0;
+		for (size_t i = 0; i < m_retired.size(); i++)
+		{
+			if (m_retired[i].epoch < minEpoch)
+			{
+				fn(m_retired[i].p);
+				freed++;
+			}
+			else
+			{
+				m_retired[kept++] = m_retired[i];
+			}
+		}
+		m_retired.resize(kept);
+
+		return freed;
+	}
+
+	/**
+	 * 不检查读者，全部交给fn，调用方保证已经没有读者
+	*/
+	template <typename Fn>
+	void ReclaimAll(Fn fn)
+	{
+		for (Retired& retired : m_retired)
+		{
+			fn(retired.p);
+		}
+
+		m_retired.clear();
+	}
+
+	//等待回收的数量
+	size_t Pending()
+	{
+		return m_retired.size();
+	}
+
+private:
+	struct alignas(TTREE_CACHE_LINE) Slot
+	{
+		std::atomic<uint64_t>	epoch;	//0表示空闲
+	};
+
+	struct Retired
+	{
+		void*		p;
+		uint64_t	epoch;
+	};
+
+	std::atomic<uint64_t>	m_epoch;
+	Slot					m_slots[TTREE_EPOCH_SLOTS];
+
+	std::vector<Retired>	m_retired;
+};
+
+/**
+ * 读者的作用域，pEpoch为空时什么都不做
+*/
+class TTreeEpochGuard
+{
+public:
+	TTreeEpochGuard(TTreeEpoch* pEpoch) : m_pEpoch(pEpoch), m_slot(0)
+	{
+		if (m_pEpoch)
+		{
+			m_slot = m_pEpoch->Enter();
+		}
+	}
+
+	~TTreeEpochGuard()
+	{
+		if (m_pEpoch)
+		{
+			m_pEpoch->Leave(m_slot);
+		}
+	}
+
+	TTreeEpochGuard(const TTreeEpochGuard&) = delete;
+
+	TTreeEpochGuard& operator=(const TTreeEpochGuard&) = delete;
+
+private:
+	TTreeEpoch*		m_pEpoch;
+	unsigned int	m_slot;
+};
+
+#endif
@@ -0,0 +1,234 @@
+/**
+ * @brief	T树快照文件，mmap后直接查询
+ * @author	huangxx
+*/
+
+#include "ttree_mapped.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+TTreeMapped::TTreeMapped(fnKeyComparator fn, fnKeyDecoder decoder)
+{
+	m_fn = fn;
+	m_decoder = decoder;
+
+	m_pMap = nullptr;
+	m_mapSize = 0;
+
+	m_pHeader = nullptr;
+	m_pNodes = nullptr;
+	m_pIds = nullptr;
+}
+
+TTreeMapped::~TTreeMapped()
+{
+	Close();
+}
+
+int TTreeMapped::Open(const char* path)
+{
+	Close();
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		return -1;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(TTreeSnapshotHeader))
+	{
+		close(fd);
+		return -1;
+	}
+
+	void* pMap = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (pMap == MAP_FAILED)
+	{
+		return -1;
+	}
+
+	m_pMap = pMap;
+	m_mapSize = st.st_size;
+
+	const TTreeSnapshotHeader* pHeader = (const TTreeSnapshotHeader*)pMap;
+	if (pHeader->magic != TTREE_SNAPSHOT_MAGIC || pHeader->version != TTREE_SNAPSHOT_VERSION ||
+		pHeader->keyNum > TTREE_SNAPSHOT_NIL)
+	{
+		Close();
+		return -1;
+	}
+
+	size_t size = sizeof(TTreeSnapshotHeader) + sizeof(TTreeSnapshotNode) * (size_t)pHeader->nodeNum + sizeof(uint64_t) * pHeader->keyNum;
+	if (size != m_mapSize)
+	{
+		Close();
+		return -1;
+	}
+
+	const TTreeSnapshotNode* pNodes = (const TTreeSnapshotNode*)(pHeader + 1);
+
+	//层序排列时子节点的编号一定比父节点大，损坏的文件也不会让查找陷入环
+	for (uint32_t i = 0; i < pHeader->nodeNum; i++)
+	{
+		const TTreeSnapshotNode& node = pNodes[i];
+
+		if (node.keyNum == 0 || (uint64_t)node.first + node.keyNum > pHeader->keyNum ||
+			(node.left != TTREE_SNAPSHOT_NIL && (node.left <= i || node.left >= pHeader->nodeNum)) ||
+			(node.right != TTREE_SNAPSHOT_NIL && (node.right <= i || node.right >= pHeader->nodeNum)))
+		{
+			Close();
+			return -1;
+		}
+	}
+
+	m_pHeader = pHeader;
+	m_pNodes = pNodes;
+	m_pIds = (const uint64_t*)(pNodes + pHeader->nodeNum);
+
+	return 0;
+}
+
+void TTreeMapped::Close()
+{
+	if (m_pMap)
+	{
+		munmap(m_pMap, m_mapSize);
+	}
+
+	m_pMap = nullptr;
+	m_mapSize = 0;
+
+	m_pHeader = nullptr;
+	m_pNodes = nullptr;
+	m_pIds = nullptr;
+}
+
+void* TTreeMapped::KeyAt(uint64_t pos) const
+{
+	return m_decoder(m_pIds[pos]);
+}
+
+uint64_t TTreeMapped::Count() const
+{
+	return m_pHeader == nullptr ? 0 : m_pHeader->keyNum;
+}
+
+uint64_t TTreeMapped::Bound(const void* pKey, bool upper) const
+{
+	if (m_pHeader == nullptr || m_pHeader->nodeNum == 0)
+	{
+		return 0;
+	}
+
+	//跟TTreeT::Bound一样，往左走时当前节点的第一个key是候选
+	uint64_t bound = m_pHeader->keyNum;
+	uint32_t cur = 0;
+
+	while (cur != TTREE_SNAPSHOT_NIL)
+	{
+		const TTreeSnapshotNode& node = m_pNodes[cur];
+
+		int cmp = m_fn(pKey, KeyAt(node.first));
+		if (cmp < 0 || (cmp == 0 && !upper))
+		{
+			bound = node.first;
+			cur = node.left;
+			continue;
+		}
+
+		cmp = m_fn(pKey, KeyAt(node.first + node.keyNum - 1));
+		if (cmp > 0 || (cmp == 0 && upper))
+		{
+			cur = node.right;
+			continue;
+		}
+
+		//结果在(first, first + keyNum - 1]之间
+		uint64_t lo = node.first + 1, hi = node.first + node.keyNum - 1;
+		while (lo < hi)
+		{
+			uint64_t mid = lo + (hi - lo) / 2;
+
+			cmp = m_fn(pKey, KeyAt(mid));
+			if (cmp > 0 || (cmp == 0 && upper))
+			{
+				lo = mid + 1;
+			}
+			else
+			{
+				hi = mid;
+			}
+		}
+
+		return lo;
+	}
+
+	return bound;
+}
+
+void* TTreeMapped::Query(const void* pKey) const
+{
+	uint64_t pos = Bound(pKey, false);
+
+	if (pos >= Count())
+	{
+		return nullptr;
+	}
+
+	void* pFound = KeyAt(pos);
+
+	return m_fn(pKey, pFound) == 0 ? pFound : nullptr;
+}
+
+TTreeMapped::Iterator TTreeMapped::LowerBound(const void* pKey) const
+{
+	return Iterator(this, Bound(pKey, false), Count());
+}
+
+TTreeMapped::Iterator TTreeMapped::Range(const void* lo, const void* hi) const
+{
+	uint64_t begin = Bound(lo, false);
+	uint64_t end = Bound(hi, true);
+
+	return Iterator(this, begin, end > begin ? end : begin);
+}
+
+TTreeMapped::Iterator TTreeMapped::Begin() const
+{
+	return Iterator(this, 0, Count());
+}
+
+
+TTreeMapped::Iterator::Iterator(const TTreeMapped* pTree, uint64_t pos, uint64_t end)
+	: m_pTree(pTree), m_pos(pos), m_end(end)
+{
+}
+
+void* TTreeMapped::Iterator::Get() const
+{
+	return IsEOF() ? nullptr : m_pTree->KeyAt(m_pos);
+}
+
+bool TTreeMapped::Iterator::IsEOF() const
+{
+	return m_pos >= m_end;
+}
+
+bool TTreeMapped::Iterator::Next()
+{
+	if (IsEOF())
+	{
+		return false;
+	}
+
+	m_pos++;
+
+	return !IsEOF();
+}
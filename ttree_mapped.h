@@ -0,0 +1,128 @@
+/**
+ * @brief	T树快照文件，mmap后直接查询
+ * @author	huangxx
+*/
+
+#ifndef __TTREE_MAPPED_H__
+#define __TTREE_MAPPED_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ttree.h"
+
+
+#define TTREE_SNAPSHOT_MAGIC	0x45455254544d4d54ull	//"TMMTTREE"
+#define TTREE_SNAPSHOT_VERSION	1
+
+//没有子节点
+#define TTREE_SNAPSHOT_NIL		0xffffffffu
+
+//把Save时编码的id还原成key
+typedef void* (*fnKeyDecoder)(uint64_t id);
+
+/**
+ * 快照文件布局(本机字节序)：
+ *		TTreeSnapshotHeader
+ *		TTreeSnapshotNode[nodeNum]	按层序排列，根节点为0号，靠近根的节点集中在文件开头
+ *		uint64_t[keyNum]			所有key编码后的id，按key的顺序排列
+ * 节点只记录自己的key在id数组中的起始位置和个数，区间遍历直接顺序读id数组
+*/
+struct TTreeSnapshotHeader
+{
+	uint64_t	magic;
+	uint32_t	version;
+	uint32_t	unique;
+	uint32_t	keySize;	//原树的节点容量，仅供参考
+	uint32_t	nodeNum;
+	uint64_t	keyNum;
+};
+
+struct TTreeSnapshotNode
+{
+	uint32_t	first;		//第一个key在id数组中的位置
+	uint32_t	keyNum;
+	uint32_t	left;		//子节点的编号，TTREE_SNAPSHOT_NIL表示没有
+	uint32_t	right;
+};
+
+/**
+ * 只读的快照树，文件整体mmap，Query、区间遍历直接访问映射的内存，
+ * 打开时只校验文件结构，不反序列化。多个线程可以同时查询
+*/
+class TTreeMapped
+{
+public:
+	TTreeMapped(fnKeyComparator fn, fnKeyDecoder decoder);
+
+	~TTreeMapped();
+
+	TTreeMapped(const TTreeMapped&) = delete;
+
+	TTreeMapped& operator=(const TTreeMapped&) = delete;
+
+	/**
+	 * 映射TTree::Save生成的文件，文件不存在或格式不对返回-1
+	*/
+	int Open(const char* path);
+
+	void Close();
+
+	/**
+	 * 按顺序遍历id数组中[pos, end)的key
+	*/
+	class Iterator
+	{
+	public:
+		Iterator(const TTreeMapped* pTree, uint64_t pos, uint64_t end);
+
+		//当前key，已经走完时返回nullptr
+		void* Get() const;
+
+		bool IsEOF() const;
+
+		bool Next();
+
+	private:
+		const TTreeMapped*	m_pTree;
+		uint64_t			m_pos;
+		uint64_t			m_end;
+	};
+
+	//返回与pKey相等的key，找不到返回nullptr
+	void* Query(const void* pKey) const;
+
+	//第一个不小于pKey的位置
+	Iterator LowerBound(const void* pKey) const;
+
+	//[lo, hi]区间内的key，按顺序遍历
+	Iterator Range(const void* lo, const void* hi) const;
+
+	//从最小的key开始遍历
+	Iterator Begin() const;
+
+	uint64_t Count() const;
+
+//private:
+public:
+	/**
+	 * 第一个不小于(upper时大于)pKey的key在id数组中的位置
+	*/
+	uint64_t Bound(const void* pKey, bool upper) const;
+
+	void* KeyAt(uint64_t pos) const;
+
+//private:
+public:
+	fnKeyComparator				m_fn;
+	fnKeyDecoder				m_decoder;
+
+	void*						m_pMap;
+	size_t						m_mapSize;
+
+	const TTreeSnapshotHeader*	m_pHeader;
+	const TTreeSnapshotNode*	m_pNodes;
+	const uint64_t*				m_pIds;
+};
+
+#endif
@@ -0,0 +1,284 @@
+/**
+ * @brief	非唯一索引，相等的key归入同一个posting list
+ * @author	huangxx
+*/
+
+#include "ttree_multi.h"
+
+#include <string.h>
+#include <functional>
+
+
+TTreeMulti::TTreeMulti(fnKeyComparator fn, unsigned int keySize, fnKeyComparator tiebreak, TTreeAllocator* pAllocator)
+	: m_tree(TTreeMultiCompare{fn}, true, keySize, pAllocator)
+{
+	m_tiebreak = tiebreak;
+	m_count = 0;
+}
+
+TTreeMulti::~TTreeMulti()
+{
+	Clear();
+}
+
+bool TTreeMulti::Less(void* a, void* b) const
+{
+	if (m_tiebreak)
+	{
+		return m_tiebreak(a, b) < 0;
+	}
+
+	return std::less<void*>()(a, b);
+}
+
+unsigned int TTreeMulti::Locate(const TTreePosting* pPosting, void* pKey, bool* pFound) const
+{
+	unsigned int lo = 0, hi = pPosting->num;
+
+	while (lo < hi)
+	{
+		unsigned int mid = (lo + hi) / 2;
+
+		if (Less(pPosting->keys[mid], pKey))
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	//tiebreak下相等的key可能有多个，往后找同一个指针
+	*pFound = false;
+	for (unsigned int i = lo; i < pPosting->num && !Less(pKey, pPosting->keys[i]); i++)
+	{
+		if (pPosting->keys[i] == pKey)
+		{
+			*pFound = true;
+			return i;
+		}
+	}
+
+	return lo;
+}
+
+TTreePosting* TTreeMulti::GrowPosting(TTreePosting* pPosting, unsigned int capacity)
+{
+	TTreePosting* pNew = (TTreePosting*)realloc(pPosting, offsetof(TTreePosting, keys) + sizeof(void*) * capacity);
+	if (pNew == nullptr)
+	{
+		throw std::bad_alloc();
+	}
+
+	if (pPosting == nullptr)
+	{
+		pNew->num = 0;
+	}
+	pNew->capacity = capacity;
+
+	return pNew;
+}
+
+int TTreeMulti::Insert(void* pKey)
+{
+	TTreeMultiSlot probe = {pKey, nullptr};
+	TTreeMultiSlot* pSlot = m_tree.Get(probe);
+
+	//新的key只占一格，不分配posting
+	if (pSlot == nullptr)
+	{
+		m_tree.Insert(probe);
+		m_count++;
+
+		return 0;
+	}
+
+	if (pSlot->pPosting == nullptr)
+	{
+		if (pSlot->pKey == pKey)
+		{
+			return -1;
+		}
+
+		pSlot->pPosting = GrowPosting(nullptr, TTREE_POSTING_INIT);
+		pSlot->pPosting->keys[0] = pSlot->pKey;
+		pSlot->pPosting->num = 1;
+	}
+
+	bool found;
+	unsigned int pos = Locate(pSlot->pPosting, pKey, &found);
+	if (found)
+	{
+		return -1;
+	}
+
+	TTreePosting* pPosting = pSlot->pPosting;
+	if (pPosting->num == pPosting->capacity)
+	{
+		pPosting = pSlot->pPosting = GrowPosting(pPosting, pPosting->capacity * 2);
+	}
+
+	memmove(pPosting->keys + pos + 1, pPosting->keys + pos, sizeof(void*) * (pPosting->num - pos));
+	pPosting->keys[pos] = pKey;
+	pPosting->num++;
+
+	//比较只用pKey，换成组内第一个不影响在树中的位置
+	pSlot->pKey = pPosting->keys[0];
+	m_count++;
+
+	return 0;
+}
+
+int TTreeMulti::Delete(void* pKey)
+{
+	TTreeMultiSlot probe = {pKey, nullptr};
+	TTreeMultiSlot* pSlot = m_tree.Get(probe);
+
+	if (pSlot == nullptr)
+	{
+		return -1;
+	}
+
+	if (pSlot->pPosting == nullptr)
+	{
+		if (pSlot->pKey != pKey)
+		{
+			return -1;
+		}
+
+		m_tree.Delete(probe);
+		m_count--;
+
+		return 0;
+	}
+
+	bool found;
+	TTreePosting* pPosting = pSlot->pPosting;
+	unsigned int pos = Locate(pPosting, pKey, &found);
+	if (!found)
+	{
+		return -1;
+	}
+
+	memmove(pPosting->keys + pos, pPosting->keys + pos + 1, sizeof(void*) * (pPosting->num - pos - 1));
+	pPosting->num--;
+
+	//只剩一个时退回到不带posting的一格
+	if (pPosting->num == 1)
+	{
+		pSlot->pKey = pPosting->keys[0];
+		pSlot->pPosting = nullptr;
+		free(pPosting);
+	}
+	else
+	{
+		pSlot->pKey = pPosting->keys[0];
+	}
+
+	m_count--;
+
+	return 0;
+}
+
+void* TTreeMulti::Query(const void* pKey)
+{
+	TTreeMultiSlot probe = {(void*)pKey, nullptr};
+	const TTreeMultiSlot* pSlot = m_tree.Query(probe);
+
+	return pSlot == nullptr ? nullptr : pSlot->pKey;
+}
+
+unsigned int TTreeMulti::EqualRange(const void* pKey, void* const** ppKeys)
+{
+	TTreeMultiSlot probe = {(void*)pKey, nullptr};
+	const TTreeMultiSlot* pSlot = m_tree.Query(probe);
+
+	if (pSlot == nullptr)
+	{
+		*ppKeys = nullptr;
+		return 0;
+	}
+
+	if (pSlot->pPosting == nullptr)
+	{
+		*ppKeys = &pSlot->pKey;
+		return 1;
+	}
+
+	*ppKeys = pSlot->pPosting->keys;
+	return pSlot->pPosting->num;
+}
+
+TTreeMulti::Iterator TTreeMulti::Begin()
+{
+	return Iterator(m_tree.Begin());
+}
+
+TTreeMulti::Iterator TTreeMulti::Range(void* lo, void* hi)
+{
+	TTreeMultiSlot loSlot = {lo, nullptr}, hiSlot = {hi, nullptr};
+
+	return Iterator(m_tree.Range(loSlot, hiSlot));
+}
+
+unsigned int TTreeMulti::Count()
+{
+	return m_count;
+}
+
+unsigned int TTreeMulti::KeyCount()
+{
+	return m_tree.Count();
+}
+
+void TTreeMulti::Clear()
+{
+	m_tree.ForEach([](const TTreeMultiSlot& slot) {
+		free(slot.pPosting);
+		return true;
+	});
+
+	m_tree.Clear();
+	m_count = 0;
+}
+
+
+TTreeMulti::Iterator::Iterator(const TTreeMultiTree::Cursor& cursor)
+	: m_cursor(cursor), m_pos(0)
+{
+}
+
+void* TTreeMulti::Iterator::Get() const
+{
+	const TTreeMultiSlot* pSlot = m_cursor.Get();
+	if (pSlot == nullptr)
+	{
+		return nullptr;
+	}
+
+	return pSlot->pPosting == nullptr ? pSlot->pKey : pSlot->pPosting->keys[m_pos];
+}
+
+bool TTreeMulti::Iterator::IsEOF() const
+{
+	return m_cursor.IsEOF();
+}
+
+bool TTreeMulti::Iterator::Next()
+{
+	const TTreeMultiSlot* pSlot = m_cursor.Get();
+	if (pSlot == nullptr)
+	{
+		return false;
+	}
+
+	if (pSlot->pPosting && ++m_pos < pSlot->pPosting->num)
+	{
+		return true;
+	}
+
+	m_pos = 0;
+
+	return m_cursor.Next();
+}
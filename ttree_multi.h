@@ -0,0 +1,139 @@
+/**
+ * @brief	非唯一索引，相等的key归入同一个posting list
+ * @author	huangxx
+*/
+
+#ifndef __TTREE_MULTI_H__
+#define __TTREE_MULTI_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ttree.h"
+
+
+//posting list第一次分配时的容量
+#define TTREE_POSTING_INIT 4
+
+/**
+ * 一组相等的key，按tiebreak比较器(为空时按地址)排序
+*/
+struct TTreePosting
+{
+	unsigned int	num;
+	unsigned int	capacity;
+	void*			keys[];
+};
+
+/**
+ * 树中的一格：pKey是这一组排在最前的key，比较时只用它，不需要访问posting；
+ * 只有一个key时不分配posting
+*/
+struct TTreeMultiSlot
+{
+	void*			pKey;
+	TTreePosting*	pPosting;
+
+	bool operator==(const TTreeMultiSlot& other) const
+	{
+		return pKey == other.pKey && pPosting == other.pPosting;
+	}
+};
+
+struct TTreeMultiCompare
+{
+	fnKeyComparator	fn;
+
+	int operator()(const TTreeMultiSlot& a, const TTreeMultiSlot& b) const
+	{
+		return fn(a.pKey, b.pKey);
+	}
+};
+
+typedef TTreeT<TTreeMultiSlot, TTreeMultiCompare> TTreeMultiTree;
+
+/**
+ * 非唯一索引：每个不同的key在树中只占一格，相等的key放在这一格的posting list中。
+ * 重复率高时节点数少，EqualRange为O(log n + k)，Query稳定返回组内第一个key。
+ * 同一个key指针只能插入一次。不支持并发模式
+*/
+class TTreeMulti
+{
+public:
+	/**
+	 * tiebreak决定相等key在组内的顺序，为空时按地址排序
+	*/
+	TTreeMulti(fnKeyComparator fn, unsigned int keySize, fnKeyComparator tiebreak = nullptr, TTreeAllocator* pAllocator = nullptr);
+
+	~TTreeMulti();
+
+	TTreeMulti(const TTreeMulti&) = delete;
+
+	TTreeMulti& operator=(const TTreeMulti&) = delete;
+
+	//pKey这个指针已经在树中时返回-1
+	int Insert(void* pKey);
+
+	//删除与pKey是同一个指针的key，找不到返回-1
+	int Delete(void* pKey);
+
+	//与pKey相等的key中排在最前的一个，找不到返回nullptr
+	void* Query(const void* pKey);
+
+	/**
+	 * 与pKey相等的所有key，*ppKeys指向按组内顺序排列的连续数组，返回个数；
+	 * 数组在下一次修改前有效
+	*/
+	unsigned int EqualRange(const void* pKey, void* const** ppKeys);
+
+	/**
+	 * 按key、组内顺序遍历
+	*/
+	class Iterator
+	{
+	public:
+		Iterator(const TTreeMultiTree::Cursor& cursor);
+
+		void* Get() const;
+
+		bool IsEOF() const;
+
+		bool Next();
+
+	private:
+		TTreeMultiTree::Cursor	m_cursor;
+		unsigned int			m_pos;		//在posting中的位置
+	};
+
+	//从最小的key开始遍历
+	Iterator Begin();
+
+	//[lo, hi]区间内的key
+	Iterator Range(void* lo, void* hi);
+
+	//key的总数
+	unsigned int Count();
+
+	//不同key的个数
+	unsigned int KeyCount();
+
+	void Clear();
+
+//private:
+public:
+	//组内顺序
+	bool Less(void* a, void* b) const;
+
+	//key在posting中应该在的位置；pFound不为空时返回是否已有同一个指针
+	unsigned int Locate(const TTreePosting* pPosting, void* pKey, bool* pFound) const;
+
+	static TTreePosting* GrowPosting(TTreePosting* pPosting, unsigned int capacity);
+
+//private:
+public:
+	TTreeMultiTree		m_tree;
+	fnKeyComparator		m_tiebreak;
+	unsigned int		m_count;
+};
+
+#endif
@@ -0,0 +1,395 @@
+/**
+ * @brief	整数key到记录号的压缩索引
+ * @author	huangxx
+*/
+
+#include "ttree_packed.h"
+
+#include <algorithm>
+
+
+static unsigned int BitWidth(uint64_t v)
+{
+	return v == 0 ? 0 : 64 - __builtin_clzll(v);
+}
+
+TTreePacked::TTreePacked(bool unique, unsigned int keySize, TTreeAllocator* pAllocator)
+	: m_tree(TTreePackedCompare(), true, keySize, pAllocator)
+{
+	m_unique = unique;
+	m_count = 0;
+}
+
+size_t TTreePacked::Encode(const TTreePackedEntry* entries, size_t n, TTreePackedBlock* pBlock)
+{
+	uint64_t minId = entries[0].id, maxId = entries[0].id;
+	unsigned int keyBits = 0, idBits = 0;
+	size_t num = 1;
+
+	//逐项加入，位宽随之变大，直到放不下
+	for (; num < n && num < TTREE_PACKED_MAX; num++)
+	{
+		uint64_t lo = std::min(minId, entries[num].id), hi = std::max(maxId, entries[num].id);
+		unsigned int kb = BitWidth((uint64_t)entries[num].key - (uint64_t)entries[0].key);
+		unsigned int ib = BitWidth(hi - lo);
+
+		if ((num + 1) * (kb + ib) > TTREE_PACKED_DATA * 8)
+		{
+			break;
+		}
+
+		minId = lo;
+		maxId = hi;
+		keyBits = kb;
+		idBits = ib;
+	}
+
+	pBlock->baseKey = entries[0].key;
+	pBlock->baseId = minId;
+	pBlock->num = (uint16_t)num;
+	pBlock->keyBits = (uint8_t)keyBits;
+	pBlock->idBits = (uint8_t)idBits;
+	memset(pBlock->data, 0, sizeof(pBlock->data));
+
+	for (size_t i = 0; i < num; i++)
+	{
+		TTreePackedBlock::PutBits(pBlock->data, i * keyBits, keyBits, (uint64_t)entries[i].key - (uint64_t)entries[0].key);
+		TTreePackedBlock::PutBits(pBlock->data, num * keyBits + i * idBits, idBits, entries[i].id - minId);
+	}
+
+	return num;
+}
+
+size_t TTreePacked::Decode(const TTreePackedBlock& block, TTreePackedEntry* entries)
+{
+	for (unsigned int i = 0; i < block.num; i++)
+	{
+		entries[i] = block.EntryAt(i);
+	}
+
+	return block.num;
+}
+
+unsigned int TTreePacked::Search(const TTreePackedBlock& block, const TTreePackedEntry& entry)
+{
+	unsigned int lo = 0, hi = block.num;
+
+	while (lo < hi)
+	{
+		unsigned int mid = (lo + hi) / 2;
+
+		if (block.EntryAt(mid) < entry)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+TTreePackedTree::Cursor TTreePacked::Floor(const TTreePackedEntry& entry)
+{
+	//只有一项、位宽为0的块，第一项就是entry
+	TTreePackedBlock probe;
+	probe.baseKey = entry.key;
+	probe.baseId = entry.id;
+	probe.num = 1;
+	probe.keyBits = 0;
+	probe.idBits = 0;
+
+	TTreePackedTree::Cursor it = m_tree.UpperBound(probe);
+	TTreePackedTree::Node* pNode = it.GetNode();
+	unsigned int index = it.GetIndex();
+
+	//往前退一块
+	if (pNode == nullptr)
+	{
+		pNode = m_tree.m_pRootNode ? TTreePackedTree::GetRight(m_tree.m_pRootNode) : nullptr;
+		index = pNode ? pNode->keyNum : 0;
+	}
+
+	if (pNode && index == 0)
+	{
+		pNode = TTreePackedTree::Predecessor(pNode);
+		index = pNode ? pNode->keyNum : 0;
+	}
+
+	if (pNode == nullptr)
+	{
+		return TTreePackedTree::Cursor();
+	}
+
+	return TTreePackedTree::Cursor(pNode, index - 1, &m_tree.m_keyCmp, nullptr);
+}
+
+int TTreePacked::Insert(int64_t key, uint64_t id)
+{
+	TTreePackedEntry entry = {key, id};
+
+	if (m_unique && Query(key, nullptr))
+	{
+		return -1;
+	}
+
+	TTreePackedTree::Cursor it = Floor(entry);
+
+	//比第一项还小时插到第一块
+	if (it.IsEOF())
+	{
+		it = m_tree.Begin();
+	}
+
+	if (it.IsEOF())
+	{
+		TTreePackedBlock block;
+		Encode(&entry, 1, &block);
+		m_tree.Insert(block);
+		m_count++;
+
+		return 0;
+	}
+
+	TTreePackedBlock* pBlock = const_cast<TTreePackedBlock*>(it.Get());
+	TTreePackedEntry entries[TTREE_PACKED_MAX + 1];
+
+	size_t n = Decode(*pBlock, entries);
+	size_t pos = Search(*pBlock, entry);
+	if (pos < n && entries[pos] == entry)
+	{
+		return -1;
+	}
+
+	memmove(entries + pos + 1, entries + pos, sizeof(TTreePackedEntry) * (n - pos));
+	entries[pos] = entry;
+	n++;
+
+	//块内第一项只会在第一块变小，不影响块之间的顺序
+	size_t done = Encode(entries, n, pBlock);
+	if (done < n)
+	{
+		//追加到最后一块的末尾时原块装满，其余情况对半分，两边都留有空位
+		TTreePackedTree::Cursor next = it;
+		bool tail = (pos == n - 1) && !next.Next();
+
+		done = tail ? done : Encode(entries, n / 2, pBlock);
+
+		//pBlock所在的节点会被插入改动，之后不再访问
+		while (done < n)
+		{
+			TTreePackedBlock block;
+			done += Encode(entries + done, n - done, &block);
+			m_tree.Insert(block);
+		}
+	}
+
+	m_count++;
+
+	return 0;
+}
+
+int TTreePacked::Delete(int64_t key, uint64_t id)
+{
+	TTreePackedEntry entry = {key, id};
+
+	TTreePackedTree::Cursor it = Floor(entry);
+	if (it.IsEOF())
+	{
+		return -1;
+	}
+
+	TTreePackedBlock* pBlock = const_cast<TTreePackedBlock*>(it.Get());
+	TTreePackedEntry entries[TTREE_PACKED_MAX * 2];
+
+	size_t n = Decode(*pBlock, entries);
+	size_t pos = Search(*pBlock, entry);
+	if (pos >= n || !(entries[pos] == entry))
+	{
+		return -1;
+	}
+
+	m_count--;
+
+	if (n == 1)
+	{
+		TTreePackedBlock block = *pBlock;
+		m_tree.Delete(block);
+
+		return 0;
+	}
+
+	memmove(entries + pos, entries + pos + 1, sizeof(TTreePackedEntry) * (n - pos - 1));
+	n--;
+
+	//项和位宽都只减不增，一定放得下
+	Encode(entries, n, pBlock);
+
+	//用了不到一半时尝试并入后一块
+	if (n * (pBlock->keyBits + pBlock->idBits) * 2 > TTREE_PACKED_DATA * 8)
+	{
+		return 0;
+	}
+
+	TTreePackedTree::Cursor next = it;
+	if (!next.Next())
+	{
+		return 0;
+	}
+
+	TTreePackedBlock nextBlock = *next.Get();
+	size_t total = n + Decode(nextBlock, entries + n);
+
+	TTreePackedBlock merged;
+	if (Encode(entries, total, &merged) < total)
+	{
+		return 0;
+	}
+
+	//合并后的块第一项不变，先写回再删掉后一块
+	*pBlock = merged;
+	m_tree.Delete(nextBlock);
+
+	return 0;
+}
+
+bool TTreePacked::Query(int64_t key, uint64_t* pId)
+{
+	Iterator it = LowerBound(key);
+
+	if (it.IsEOF() || it.Key() != key)
+	{
+		return false;
+	}
+
+	if (pId)
+	{
+		*pId = it.Id();
+	}
+
+	return true;
+}
+
+TTreePacked::Iterator TTreePacked::Begin()
+{
+	return Iterator(m_tree.Begin(), 0, nullptr);
+}
+
+TTreePackedTree::Cursor TTreePacked::Seek(int64_t key, unsigned int* pPos)
+{
+	TTreePackedEntry entry = {key, 0};
+
+	*pPos = 0;
+
+	TTreePackedTree::Cursor it = Floor(entry);
+	if (it.IsEOF())
+	{
+		return m_tree.Begin();
+	}
+
+	//块内找不到时从后一块的第一项开始
+	*pPos = Search(*it.Get(), entry);
+	if (*pPos >= it.Get()->num)
+	{
+		it.Next();
+		*pPos = 0;
+	}
+
+	return it;
+}
+
+TTreePacked::Iterator TTreePacked::LowerBound(int64_t key)
+{
+	unsigned int pos;
+	TTreePackedTree::Cursor it = Seek(key, &pos);
+
+	return Iterator(it, pos, nullptr);
+}
+
+TTreePacked::Iterator TTreePacked::Range(int64_t lo, int64_t hi)
+{
+	unsigned int pos;
+	TTreePackedTree::Cursor it = Seek(lo, &pos);
+
+	return Iterator(it, pos, &hi);
+}
+
+size_t TTreePacked::Count()
+{
+	return m_count;
+}
+
+size_t TTreePacked::BlockCount()
+{
+	return m_tree.Count();
+}
+
+size_t TTreePacked::MemoryUsage()
+{
+	size_t nodes = 0;
+
+	m_tree.ForEachNode([&](TTreePackedTree::Node*) { nodes++; });
+
+	return nodes * TTreePackedTree::Node::AllocSize(m_tree.m_keySize);
+}
+
+void TTreePacked::Clear()
+{
+	m_tree.Clear();
+	m_count = 0;
+}
+
+
+TTreePacked::Iterator::Iterator(const TTreePackedTree::Cursor& cursor, unsigned int pos, const int64_t* pHi)
+	: m_cursor(cursor), m_pos(pos), m_hi(0), m_bounded(pHi != nullptr)
+{
+	if (m_bounded)
+	{
+		m_hi = *pHi;
+	}
+
+	CheckBound();
+}
+
+int64_t TTreePacked::Iterator::Key() const
+{
+	return m_cursor.Get()->KeyAt(m_pos);
+}
+
+uint64_t TTreePacked::Iterator::Id() const
+{
+	return m_cursor.Get()->IdAt(m_pos);
+}
+
+bool TTreePacked::Iterator::IsEOF() const
+{
+	return m_cursor.IsEOF();
+}
+
+bool TTreePacked::Iterator::Next()
+{
+	if (m_cursor.IsEOF())
+	{
+		return false;
+	}
+
+	if (++m_pos >= m_cursor.Get()->num)
+	{
+		m_pos = 0;
+		m_cursor.Next();
+	}
+
+	CheckBound();
+
+	return !m_cursor.IsEOF();
+}
+
+void TTreePacked::Iterator::CheckBound()
+{
+	if (!m_cursor.IsEOF() && m_bounded && Key() > m_hi)
+	{
+		m_cursor = TTreePackedTree::Cursor();
+	}
+}
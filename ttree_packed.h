@@ -0,0 +1,238 @@
+/**
+ * @brief	整数key到记录号的压缩索引
+ * @author	huangxx
+*/
+
+#ifndef __TTREE_PACKED_H__
+#define __TTREE_PACKED_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ttree_t.h"
+
+
+//每块的字节数，与缓存行一样大
+#define TTREE_PACKED_BLOCK		TTREE_CACHE_LINE
+
+//块头之后存放位压缩数据的字节数
+#define TTREE_PACKED_DATA		(TTREE_PACKED_BLOCK - 20)
+
+//一块最多的项数：项互不相同，两项以上时每项至少1位
+#define TTREE_PACKED_MAX		(TTREE_PACKED_DATA * 8)
+
+/**
+ * 一项：按(key, id)排序
+*/
+struct TTreePackedEntry
+{
+	int64_t		key;
+	uint64_t	id;
+
+	bool operator<(const TTreePackedEntry& other) const
+	{
+		return key < other.key || (key == other.key && id < other.id);
+	}
+
+	bool operator==(const TTreePackedEntry& other) const
+	{
+		return key == other.key && id == other.id;
+	}
+};
+
+/**
+ * 一块有序的项，frame-of-reference编码：key存与第一个key的差，id存与最小id的差，
+ * 各用keyBits、idBits位；先是num个key差，再是num个id差。
+ * 每个差都能按下标直接解出来，块内可以二分
+*/
+struct TTreePackedBlock
+{
+	int64_t		baseKey;
+	uint64_t	baseId;
+	uint16_t	num;
+	uint8_t		keyBits;
+	uint8_t		idBits;
+	uint8_t		data[TTREE_PACKED_DATA];
+
+	static uint64_t GetBits(const uint8_t* data, size_t pos, unsigned int bits)
+	{
+		size_t byte = pos / 8;
+		unsigned int shift = pos % 8;
+
+		if (bits == 0)
+		{
+			return 0;
+		}
+
+		//不跨出数据区且不超过64位时一次读出
+		if (byte + 8 <= TTREE_PACKED_DATA && shift + bits <= 64)
+		{
+			uint64_t word;
+			memcpy(&word, data + byte, sizeof(word));
+
+			return (word >> shift) & (bits == 64 ? ~0ull : ((1ull << bits) - 1));
+		}
+
+		uint64_t v = 0;
+		for (unsigned int got = 0; got < bits; byte++, shift = 0)
+		{
+			unsigned int take = (8 - shift) < (bits - got) ? (8 - shift) : (bits - got);
+
+			v |= (uint64_t)((data[byte] >> shift) & ((1u << take) - 1)) << got;
+			got += take;
+		}
+
+		return v;
+	}
+
+	static void PutBits(uint8_t* data, size_t pos, unsigned int bits, uint64_t v)
+	{
+		size_t byte = pos / 8;
+		unsigned int shift = pos % 8;
+
+		for (unsigned int put = 0; put < bits; byte++, shift = 0)
+		{
+			unsigned int take = (8 - shift) < (bits - put) ? (8 - shift) : (bits - put);
+
+			data[byte] |= (uint8_t)(((v >> put) & ((1u << take) - 1)) << shift);
+			put += take;
+		}
+	}
+
+	int64_t KeyAt(unsigned int i) const
+	{
+		return (int64_t)((uint64_t)baseKey + GetBits(data, (size_t)i * keyBits, keyBits));
+	}
+
+	uint64_t IdAt(unsigned int i) const
+	{
+		return baseId + GetBits(data, (size_t)num * keyBits + (size_t)i * idBits, idBits);
+	}
+
+	TTreePackedEntry EntryAt(unsigned int i) const
+	{
+		return TTreePackedEntry{KeyAt(i), IdAt(i)};
+	}
+
+	bool operator==(const TTreePackedBlock& other) const
+	{
+		return memcmp(this, &other, sizeof(TTreePackedBlock)) == 0;
+	}
+};
+
+static_assert(sizeof(TTreePackedBlock) == TTREE_PACKED_BLOCK, "TTreePackedBlock must fill one block");
+
+//块之间按第一项比较，各块的区间互不重叠
+struct TTreePackedCompare
+{
+	int operator()(const TTreePackedBlock& a, const TTreePackedBlock& b) const
+	{
+		TTreePackedEntry x = a.EntryAt(0), y = b.EntryAt(0);
+
+		return (y < x) - (x < y);
+	}
+};
+
+typedef TTreeT<TTreePackedBlock, TTreePackedCompare> TTreePackedTree;
+
+/**
+ * 整数key到记录号(id)的二级索引：树中的每个key是一个64字节的压缩块，
+ * 保存若干按(key, id)排序的项，查找和遍历时按位解码。
+ * key、id较密集时每项只占几个字节，远小于指针加记录的存储。
+ * 非唯一时同一个key可以对应多个id，(key, id)不能重复。不支持并发模式
+*/
+class TTreePacked
+{
+public:
+	/**
+	 * keySize是树节点容纳的块数
+	*/
+	TTreePacked(bool unique, unsigned int keySize = 8, TTreeAllocator* pAllocator = nullptr);
+
+	TTreePacked(const TTreePacked&) = delete;
+
+	TTreePacked& operator=(const TTreePacked&) = delete;
+
+	//(key, id)已经存在，或者唯一索引中key已经存在时返回-1
+	int Insert(int64_t key, uint64_t id);
+
+	//找不到返回-1
+	int Delete(int64_t key, uint64_t id);
+
+	//key对应的最小的id，找不到返回false；pId可以为空
+	bool Query(int64_t key, uint64_t* pId);
+
+	/**
+	 * 按(key, id)顺序遍历
+	*/
+	class Iterator
+	{
+	public:
+		Iterator(const TTreePackedTree::Cursor& cursor, unsigned int pos, const int64_t* pHi);
+
+		int64_t Key() const;
+
+		uint64_t Id() const;
+
+		bool IsEOF() const;
+
+		bool Next();
+
+	private:
+		//超过上界即结束
+		void CheckBound();
+
+	private:
+		TTreePackedTree::Cursor	m_cursor;
+		unsigned int			m_pos;		//在块中的位置
+		int64_t					m_hi;
+		bool					m_bounded;
+	};
+
+	Iterator Begin();
+
+	//第一个key不小于key的项
+	Iterator LowerBound(int64_t key);
+
+	//key在[lo, hi]内的项
+	Iterator Range(int64_t lo, int64_t hi);
+
+	//项数
+	size_t Count();
+
+	//块数
+	size_t BlockCount();
+
+	//树节点占用的字节数
+	size_t MemoryUsage();
+
+	void Clear();
+
+//private:
+public:
+	/**
+	 * 把entries中最多n项编码进pBlock，放不下时只编码前面能放下的，返回编码的项数(至少1项)
+	*/
+	static size_t Encode(const TTreePackedEntry* entries, size_t n, TTreePackedBlock* pBlock);
+
+	//解码全部项，返回项数
+	static size_t Decode(const TTreePackedBlock& block, TTreePackedEntry* entries);
+
+	//块内第一个不小于entry的位置
+	static unsigned int Search(const TTreePackedBlock& block, const TTreePackedEntry& entry);
+
+	//最后一个第一项不大于entry的块，没有时返回结尾
+	TTreePackedTree::Cursor Floor(const TTreePackedEntry& entry);
+
+	//第一个key不小于key的项所在的块，*pPos为块内位置
+	TTreePackedTree::Cursor Seek(int64_t key, unsigned int* pPos);
+
+//private:
+public:
+	TTreePackedTree		m_tree;
+	bool				m_unique;
+	size_t				m_count;
+};
+
+#endif
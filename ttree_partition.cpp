@@ -0,0 +1,235 @@
+/**
+ * @brief	分片T树，每个分片独立加锁
+ * @author	huangxx
+*/
+
+#include "ttree_partition.h"
+
+#include <algorithm>
+
+
+PartitionedTTree::PartitionedTTree(fnKeyComparator fn, bool unique, unsigned int keySize, void** splitKeys, unsigned int splitNum)
+	: m_splitKeys(splitKeys, splitKeys + splitNum)
+{
+	m_fn = fn;
+	m_unique = unique;
+	m_keySize = keySize;
+
+	m_mode = TTREE_PARTITION_RANGE;
+	m_hash = nullptr;
+
+	CreateShards(splitNum + 1);
+}
+
+PartitionedTTree::PartitionedTTree(fnKeyComparator fn, bool unique, unsigned int keySize, fnKeyHash hash, unsigned int shardNum)
+{
+	m_fn = fn;
+	m_unique = unique;
+	m_keySize = keySize;
+
+	m_mode = TTREE_PARTITION_HASH;
+	m_hash = hash;
+
+	CreateShards(shardNum > 0 ? shardNum : 1);
+}
+
+PartitionedTTree::~PartitionedTTree()
+{
+	for (Shard* pShard : m_shards)
+	{
+		delete pShard;
+	}
+}
+
+void PartitionedTTree::CreateShards(unsigned int shardNum)
+{
+	for (unsigned int i = 0; i < shardNum; i++)
+	{
+		m_shards.push_back(new Shard(m_fn, m_unique, m_keySize));
+	}
+}
+
+unsigned int PartitionedTTree::ShardOf(const void* pKey)
+{
+	if (m_mode == TTREE_PARTITION_HASH)
+	{
+		return m_hash(pKey) % m_shards.size();
+	}
+
+	//不大于key的分界key的个数
+	fnKeyComparator fn = m_fn;
+	return std::upper_bound(m_splitKeys.begin(), m_splitKeys.end(), pKey,
+		[fn](const void* a, const void* b) { return fn(a, b) < 0; }) - m_splitKeys.begin();
+}
+
+int PartitionedTTree::Insert(void* pKey)
+{
+	Shard* pShard = m_shards[ShardOf(pKey)];
+	std::lock_guard<std::mutex> guard(pShard->lock);
+
+	return pShard->tree.Insert(pKey);
+}
+
+int PartitionedTTree::Delete(void* pKey)
+{
+	Shard* pShard = m_shards[ShardOf(pKey)];
+	std::lock_guard<std::mutex> guard(pShard->lock);
+
+	return pShard->tree.Delete(pKey);
+}
+
+void* PartitionedTTree::Query(void* pKey)
+{
+	Shard* pShard = m_shards[ShardOf(pKey)];
+	std::lock_guard<std::mutex> guard(pShard->lock);
+
+	return (void*)pShard->tree.Query(pKey);
+}
+
+unsigned int PartitionedTTree::Count()
+{
+	unsigned int count = 0;
+
+	for (Shard* pShard : m_shards)
+	{
+		std::lock_guard<std::mutex> guard(pShard->lock);
+		count += pShard->tree.Count();
+	}
+
+	return count;
+}
+
+void PartitionedTTree::Clear()
+{
+	for (Shard* pShard : m_shards)
+	{
+		std::lock_guard<std::mutex> guard(pShard->lock);
+		pShard->tree.Clear();
+	}
+}
+
+unsigned int PartitionedTTree::ShardNum()
+{
+	return m_shards.size();
+}
+
+TTree* PartitionedTTree::ShardTree(unsigned int i)
+{
+	return i < m_shards.size() ? &m_shards[i]->tree : nullptr;
+}
+
+PartitionedTTree::Iterator PartitionedTTree::Begin()
+{
+	std::vector<TTreeIterator> cursors;
+
+	for (Shard* pShard : m_shards)
+	{
+		cursors.push_back(pShard->tree.Begin());
+	}
+
+	return Iterator(m_fn, cursors);
+}
+
+PartitionedTTree::Iterator PartitionedTTree::Range(void* lo, void* hi)
+{
+	std::vector<TTreeIterator> cursors;
+
+	//区间分片时只有lo、hi之间的分片可能有key
+	unsigned int first = 0, last = m_shards.size() - 1;
+	if (m_mode == TTREE_PARTITION_RANGE)
+	{
+		first = ShardOf(lo);
+		last = ShardOf(hi);
+	}
+
+	for (unsigned int i = first; i <= last && i < m_shards.size(); i++)
+	{
+		cursors.push_back(m_shards[i]->tree.Range(lo, hi));
+	}
+
+	return Iterator(m_fn, cursors);
+}
+
+
+PartitionedTTree::Iterator::Iterator(fnKeyComparator fn, std::vector<TTreeIterator>& cursors)
+	: m_fn(fn), m_cursors(cursors)
+{
+	for (unsigned int i = 0; i < m_cursors.size(); i++)
+	{
+		if (!m_cursors[i].IsEOF())
+		{
+			m_heap.push_back(i);
+		}
+	}
+
+	for (size_t pos = m_heap.size() / 2; pos > 0; pos--)
+	{
+		SiftDown(pos - 1);
+	}
+}
+
+const void* PartitionedTTree::Iterator::Get() const
+{
+	return IsEOF() ? nullptr : *m_cursors[m_heap[0]].Get();
+}
+
+bool PartitionedTTree::Iterator::IsEOF() const
+{
+	return m_heap.empty();
+}
+
+bool PartitionedTTree::Iterator::Next()
+{
+	if (IsEOF())
+	{
+		return false;
+	}
+
+	if (!m_cursors[m_heap[0]].Next())
+	{
+		m_heap[0] = m_heap.back();
+		m_heap.pop_back();
+	}
+
+	if (!m_heap.empty())
+	{
+		SiftDown(0);
+	}
+
+	return !IsEOF();
+}
+
+bool PartitionedTTree::Iterator::Less(unsigned int a, unsigned int b) const
+{
+	int cmp = m_fn(*m_cursors[a].Get(), *m_cursors[b].Get());
+
+	return cmp < 0 || (cmp == 0 && a < b);
+}
+
+void PartitionedTTree::Iterator::SiftDown(size_t pos)
+{
+	size_t n = m_heap.size();
+
+	while (true)
+	{
+		size_t smallest = pos, left = pos * 2 + 1, right = pos * 2 + 2;
+
+		if (left < n && Less(m_heap[left], m_heap[smallest]))
+		{
+			smallest = left;
+		}
+
+		if (right < n && Less(m_heap[right], m_heap[smallest]))
+		{
+			smallest = right;
+		}
+
+		if (smallest == pos)
+		{
+			return;
+		}
+
+		std::swap(m_heap[pos], m_heap[smallest]);
+		pos = smallest;
+	}
+}
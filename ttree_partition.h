@@ -0,0 +1,130 @@
+/**
+ * @brief	分片T树，每个分片独立加锁
+ * @author	huangxx
+*/
+
+#ifndef __TTREE_PARTITION_H__
+#define __TTREE_PARTITION_H__
+
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+
+#include "ttree.h"
+
+
+typedef uint64_t (*fnKeyHash)(const void* pKey);
+
+/**
+ * 分片方式
+*/
+enum TTreePartitionMode
+{
+	TTREE_PARTITION_RANGE,	//按分界key划分区间，分片之间整体有序
+	TTREE_PARTITION_HASH,	//按hash取模，相等的key的hash必须相同
+};
+
+/**
+ * key按区间或hash分到K棵独立的TTree上，每个分片有自己的锁和节点池，
+ * 不同分片上的Insert、Delete、Query可以并行。
+ * 有序遍历对各分片做k路归并，遍历期间不能有并发修改
+*/
+class PartitionedTTree
+{
+public:
+	/**
+	 * 区间分片：splitKeys为升序的splitNum个分界key，共splitNum + 1个分片，
+	 * 第i个分片存放 [splitKeys[i - 1], splitKeys[i]) 内的key
+	*/
+	PartitionedTTree(fnKeyComparator fn, bool unique, unsigned int keySize, void** splitKeys, unsigned int splitNum);
+
+	/**
+	 * hash分片
+	*/
+	PartitionedTTree(fnKeyComparator fn, bool unique, unsigned int keySize, fnKeyHash hash, unsigned int shardNum);
+
+	~PartitionedTTree();
+
+	PartitionedTTree(const PartitionedTTree&) = delete;
+
+	PartitionedTTree& operator=(const PartitionedTTree&) = delete;
+
+	int Insert(void* pKey);
+
+	int Delete(void* pKey);
+
+	//返回与pKey相等的key，找不到返回nullptr
+	void* Query(void* pKey);
+
+	unsigned int Count();
+
+	void Clear();
+
+	unsigned int ShardNum();
+
+	//key所在的分片
+	unsigned int ShardOf(const void* pKey);
+
+	TTree* ShardTree(unsigned int i);
+
+	/**
+	 * 各分片游标的k路归并，用小根堆取当前最小的key；
+	 * 相等的key按分片编号先后输出
+	*/
+	class Iterator
+	{
+	public:
+		Iterator(fnKeyComparator fn, std::vector<TTreeIterator>& cursors);
+
+		const void* Get() const;
+
+		bool IsEOF() const;
+
+		bool Next();
+
+	private:
+		//堆顶是当前最小的分片
+		bool Less(unsigned int a, unsigned int b) const;
+
+		void SiftDown(size_t pos);
+
+	private:
+		fnKeyComparator				m_fn;
+		std::vector<TTreeIterator>	m_cursors;
+		std::vector<unsigned int>	m_heap;		//没有走完的游标编号
+	};
+
+	//从最小的key开始遍历
+	Iterator Begin();
+
+	//[lo, hi]区间内的key，按顺序遍历
+	Iterator Range(void* lo, void* hi);
+
+//private:
+public:
+	struct alignas(TTREE_CACHE_LINE) Shard
+	{
+		std::mutex	lock;
+		TTree		tree;
+
+		Shard(fnKeyComparator fn, bool unique, unsigned int keySize) : tree(fn, unique, keySize)
+		{
+		}
+	};
+
+	void CreateShards(unsigned int shardNum);
+
+//private:
+public:
+	fnKeyComparator		m_fn;
+	bool				m_unique;
+	unsigned int		m_keySize;
+
+	TTreePartitionMode	m_mode;
+	std::vector<void*>	m_splitKeys;
+	fnKeyHash			m_hash;
+
+	std::vector<Shard*>	m_shards;
+};
+
+#endif
@@ -0,0 +1,184 @@
+/**
+ * @brief	整数key的节点内SIMD查找
+ * @author	huangxx
+*/
+
+#ifndef __TTREE_SIMD_H__
+#define __TTREE_SIMD_H__
+
+#include <stdint.h>
+#include <limits>
+#include <type_traits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TTREE_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+
+/**
+ * 运行时检测到的指令集
+*/
+enum TTreeSimdLevel
+{
+	TTREE_SIMD_NONE,	//标量，逐个比较但没有分支
+	TTREE_SIMD_SSE42,
+	TTREE_SIMD_AVX2,
+};
+
+inline TTreeSimdLevel TTreeSimdDetect()
+{
+#ifdef TTREE_SIMD_X86
+	static const TTreeSimdLevel s_level = __builtin_cpu_supports("avx2") ? TTREE_SIMD_AVX2 :
+		(__builtin_cpu_supports("sse4.2") ? TTREE_SIMD_SSE42 : TTREE_SIMD_NONE);
+
+	return s_level;
+#else
+	return TTREE_SIMD_NONE;
+#endif
+}
+
+/**
+ * 4、8字节的整数可以用SIMD查找
+*/
+template <typename T>
+struct TTreeSimdKey
+{
+	static const bool value = std::is_integral<T>::value && !std::is_same<T, bool>::value && (sizeof(T) == 4 || sizeof(T) == 8);
+};
+
+/**
+ * 以下统计keys[0, n)中小于key的个数。无符号数与flip(符号位)异或后按有符号比较
+*/
+template <typename Word>
+inline unsigned int TTreeCountLessScalar(const Word* keys, unsigned int n, Word key, Word flip)
+{
+	unsigned int count = 0;
+
+	for (unsigned int i = 0; i < n; i++)
+	{
+		count += (Word)(keys[i] ^ flip) < (Word)(key ^ flip);
+	}
+
+	return count;
+}
+
+#ifdef TTREE_SIMD_X86
+
+__attribute__((target("avx2,popcnt")))
+inline unsigned int TTreeCountLessAvx2(const int32_t* keys, unsigned int n, int32_t key, int32_t flip)
+{
+	__m256i vFlip = _mm256_set1_epi32(flip);
+	__m256i vKey = _mm256_set1_epi32(key ^ flip);
+	unsigned int count = 0, i = 0;
+
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(keys + i)), vFlip);
+		count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(vKey, v))));
+	}
+
+	return count + TTreeCountLessScalar(keys + i, n - i, key, flip);
+}
+
+__attribute__((target("avx2,popcnt")))
+inline unsigned int TTreeCountLessAvx2(const int64_t* keys, unsigned int n, int64_t key, int64_t flip)
+{
+	__m256i vFlip = _mm256_set1_epi64x(flip);
+	__m256i vKey = _mm256_set1_epi64x(key ^ flip);
+	unsigned int count = 0, i = 0;
+
+	for (; i + 4 <= n; i += 4)
+	{
+		__m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(keys + i)), vFlip);
+		count += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(vKey, v))));
+	}
+
+	return count + TTreeCountLessScalar(keys + i, n - i, key, flip);
+}
+
+__attribute__((target("sse4.2,popcnt")))
+inline unsigned int TTreeCountLessSse42(const int32_t* keys, unsigned int n, int32_t key, int32_t flip)
+{
+	__m128i vFlip = _mm_set1_epi32(flip);
+	__m128i vKey = _mm_set1_epi32(key ^ flip);
+	unsigned int count = 0, i = 0;
+
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(keys + i)), vFlip);
+		count += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(vKey, v))));
+	}
+
+	return count + TTreeCountLessScalar(keys + i, n - i, key, flip);
+}
+
+__attribute__((target("sse4.2,popcnt")))
+inline unsigned int TTreeCountLessSse42(const int64_t* keys, unsigned int n, int64_t key, int64_t flip)
+{
+	__m128i vFlip = _mm_set1_epi64x(flip);
+	__m128i vKey = _mm_set1_epi64x(key ^ flip);
+	unsigned int count = 0, i = 0;
+
+	for (; i + 2 <= n; i += 2)
+	{
+		__m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(keys + i)), vFlip);
+		count += __builtin_popcount(_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(vKey, v))));
+	}
+
+	return count + TTreeCountLessScalar(keys + i, n - i, key, flip);
+}
+
+#endif
+
+template <typename Word>
+inline unsigned int TTreeCountLess(const Word* keys, unsigned int n, Word key, Word flip)
+{
+#ifdef TTREE_SIMD_X86
+	switch (TTreeSimdDetect())
+	{
+	case TTREE_SIMD_AVX2:
+		return TTreeCountLessAvx2(keys, n, key, flip);
+	case TTREE_SIMD_SSE42:
+		return TTreeCountLessSse42(keys, n, key, flip);
+	default:
+		break;
+	}
+#endif
+
+	return TTreeCountLessScalar(keys, n, key, flip);
+}
+
+/**
+ * 有序数组keys[0, n)中小于key(upper时不大于key)的个数，即lower/upper bound的位置。
+ * 节点只有几十个key时整段比较比二分少了分支预测失败
+*/
+template <typename T>
+inline unsigned int TTreeSimdRank(const T* keys, unsigned int n, const T& key, bool upper, std::true_type)
+{
+	typedef typename std::conditional<sizeof(T) == 4, int32_t, int64_t>::type Word;
+
+	//不大于key即小于key + 1
+	if (upper)
+	{
+		if (key == std::numeric_limits<T>::max())
+		{
+			return n;
+		}
+
+		return TTreeSimdRank(keys, n, (T)(key + 1), false, std::true_type());
+	}
+
+	Word flip = std::is_signed<T>::value ? 0 : std::numeric_limits<Word>::min();
+
+	return TTreeCountLess((const Word*)keys, n, (Word)key, flip);
+}
+
+//其他类型的key不会走到这里
+template <typename T>
+inline unsigned int TTreeSimdRank(const T*, unsigned int, const T&, bool, std::false_type)
+{
+	return 0;
+}
+
+#endif
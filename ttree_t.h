@@ -0,0 +1,3546 @@
+/**
+ * @brief	T树模板实现，比较器作为模板参数，可以被编译器内联
+ * @author	huangxx
+*/
+
+#ifndef __TTREE_T_H__
+#define __TTREE_T_H__
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <new>
+#include <type_traits>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+#include "ttree_alloc.h"
+#include "ttree_epoch.h"
+#include "ttree_simd.h"
+
+
+#define TTREE_HEIGHT_OF(node) (node == nullptr ? 0 : node->height)
+#define TTREE_COUNT_OF(node) (node == nullptr ? 0 : node->count)
+#define MAX(a, b) (a > b ? a : b)
+
+//AUTO模式下，节点容量不超过该值时用顺序查找，否则用二分查找
+#define TTREE_LINEAR_SEARCH_MAX 16
+
+//AUTO模式下，整数key的节点容量不超过该值时用SIMD整段比较
+#define TTREE_SIMD_SEARCH_MAX 256
+
+//QueryBatch中同时交错下降的查找个数
+#define TTREE_BATCH_GROUP 16
+
+//Scan每段拷贝的key个数，一段校验一次
+#define TTREE_SCAN_CHUNK 64
+
+//Scan一段内最多记录的节点个数
+#define TTREE_SCAN_TRACK 64
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TTREE_PREFETCH(p) __builtin_prefetch((const void*)(p))
+#else
+#define TTREE_PREFETCH(p)
+#endif
+
+
+/**
+ * 并发模式下乐观读者不加锁读取、写者同时修改的字段：写总是relaxed原子写，
+ * 乐观读者用Load原子读，读到的值是否一致由版本号校验，读写本身不构成数据竞争。
+ * 隐式转换是普通读，只在写者自己或者没有写者时使用，编译器可以照常优化
+*/
+template <typename T>
+struct TTreeRelaxed
+{
+	T	value;
+
+	TTreeRelaxed() = default;
+
+	TTreeRelaxed(const TTreeRelaxed& other) : value(other.value)
+	{
+	}
+
+	T Load() const
+	{
+		return __atomic_load_n(&value, __ATOMIC_RELAXED);
+	}
+
+	void Store(T v)
+	{
+		__atomic_store_n(&value, v, __ATOMIC_RELAXED);
+	}
+
+	operator T() const
+	{
+		return value;
+	}
+
+	//T是指针时
+	T operator->() const
+	{
+		return value;
+	}
+
+	TTreeRelaxed& operator=(T v)
+	{
+		Store(v);
+		return *this;
+	}
+
+	TTreeRelaxed& operator=(const TTreeRelaxed& other)
+	{
+		Store(other.value);
+		return *this;
+	}
+
+	//只有持有写锁的线程修改，不需要原子的读改写
+	TTreeRelaxed& operator+=(T v)
+	{
+		Store(value + v);
+		return *this;
+	}
+
+	TTreeRelaxed& operator-=(T v)
+	{
+		Store(value - v);
+		return *this;
+	}
+
+	T operator++(int)
+	{
+		T v = value;
+		Store(v + 1);
+		return v;
+	}
+
+	T operator--(int)
+	{
+		T v = value;
+		Store(v - 1);
+		return v;
+	}
+};
+
+template <typename Word>
+inline void TTreeAtomicCopyWords(void* pDst, const void* pSrc, size_t n)
+{
+	Word* dst = (Word*)pDst;
+	const Word* src = (const Word*)pSrc;
+
+	//与memmove一样允许重叠
+	if (dst > src && dst < src + n)
+	{
+		for (size_t i = n; i > 0; i--)
+		{
+			__atomic_store_n(dst + i - 1, __atomic_load_n(src + i - 1, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+		}
+
+		return;
+	}
+
+	for (size_t i = 0; i < n; i++)
+	{
+		__atomic_store_n(dst + i, __atomic_load_n(src + i, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+	}
+}
+
+/**
+ * 按两边都对齐的最大字长逐字relaxed原子拷贝，用于并发模式下读写key和槽位前缀
+*/
+inline void TTreeAtomicCopy(void* pDst, const void* pSrc, size_t bytes)
+{
+	uintptr_t align = (uintptr_t)pDst | (uintptr_t)pSrc | bytes;
+
+	if (align % sizeof(uint64_t) == 0)
+	{
+		TTreeAtomicCopyWords<uint64_t>(pDst, pSrc, bytes / sizeof(uint64_t));
+	}
+	else if (align % sizeof(uint32_t) == 0)
+	{
+		TTreeAtomicCopyWords<uint32_t>(pDst, pSrc, bytes / sizeof(uint32_t));
+	}
+	else
+	{
+		TTreeAtomicCopyWords<uint8_t>(pDst, pSrc, bytes);
+	}
+}
+
+
+/**
+ * 节点内查找方式
+*/
+enum TTreeSearchMode
+{
+	TTREE_SEARCH_AUTO,		//按节点容量选择
+	TTREE_SEARCH_LINEAR,	//从后往前顺序查找
+	TTREE_SEARCH_BINARY,	//无分支二分查找
+	TTREE_SEARCH_SIMD,		//整数key用SIMD整段比较，其他key同AUTO
+};
+
+/**
+ * 节点满了还要插入时的处理，见TTreeT::SetSplitPolicy
+*/
+enum TTreeSplitPolicy
+{
+	TTREE_SPLIT_SHIFT,		//溢出的最大key移到后继节点，后继也满了时新建只有这一个key的节点
+	TTREE_SPLIT_FILL,		//后继也满了时节点按填充率分裂，后半段移到新建的后继节点
+	TTREE_SPLIT_APPEND,		//最右节点达到填充率后在末尾新建节点，不挪动key；落在中间的key同FILL
+};
+
+/**
+ * Get、Query下降时的布局，见TTreeT::SetLayout
+*/
+enum TTreeLayout
+{
+	TTREE_LAYOUT_NODE,		//逐层比较节点的最小、最大key
+	TTREE_LAYOUT_CST,		//节点的最小key另存为按缓存行分块的目录，下降只访问目录
+};
+
+
+/**
+ * key前缀缓存方式，见TTreeT::SetPrefixMode
+*/
+enum TTreePrefixMode
+{
+	TTREE_PREFIX_NONE,		//不缓存
+	TTREE_PREFIX_BOUNDS,	//节点缓存最小、最大key的前缀，下降时不用访问key
+	TTREE_PREFIX_SLOTS,		//另外每个key都缓存前缀，节点内查找也先比前缀
+};
+
+/**
+ * 不提供前缀，只能使用TTREE_PREFIX_NONE
+*/
+template <typename Key>
+struct TTreeNoPrefix
+{
+	uint64_t operator()(const Key&) const
+	{
+		return 0;
+	}
+};
+
+/**
+ * 有符号整数的保序前缀
+*/
+inline uint64_t TTreeIntPrefix(int64_t v)
+{
+	return (uint64_t)v ^ (1ull << 63);
+}
+
+/**
+ * 字符串前8个字节的保序前缀，与strncmp的顺序一致(遇到'\0'后补0)
+*/
+inline uint64_t TTreeStringPrefix(const char* s, size_t n)
+{
+	uint64_t v = 0;
+	bool end = false;
+
+	for (size_t i = 0; i < 8; i++)
+	{
+		unsigned char c = (end || i >= n) ? 0 : (unsigned char)s[i];
+		end = end || c == 0;
+
+		v = (v << 8) | c;
+	}
+
+	return v;
+}
+
+/**
+ * key是指针时预取其指向的内容，其他类型什么都不做
+*/
+template <typename T>
+inline void TTreePrefetchKey(T* p)
+{
+	TTREE_PREFETCH(p);
+}
+
+template <typename T>
+inline void TTreePrefetchKey(const T&)
+{
+}
+
+/**
+ * 默认比较器，适用于整数等支持<的key，返回值与fnKeyComparator一致
+*/
+template <typename Key>
+struct TTreeCompare
+{
+	int operator()(const Key& a, const Key& b) const
+	{
+		return (b < a) - (a < b);
+	}
+};
+
+/**
+ * 整数key的默认前缀
+*/
+template <typename Key>
+struct TTreeKeyPrefix
+{
+	uint64_t operator()(const Key& key) const
+	{
+		return std::is_signed<Key>::value ? TTreeIntPrefix((int64_t)key) : (uint64_t)key;
+	}
+};
+
+/**
+ * 节点头、子节点指针和key连续存放在一块按缓存行对齐的内存中，
+ * 通过Create/Destroy从分配器申请释放，每个节点只需要一次分配，访问时是连续的缓存行
+*/
+template <typename Key>
+struct TTreeNodeT
+{
+	int				height;		//高度
+
+	//以下字段和keys、槽位前缀在并发模式下会被乐观读者读取，见TTreeRelaxed
+	TTreeRelaxed<unsigned int>	keyNum;		//key数量
+
+	union {
+		TTreeRelaxed<TTreeNodeT*> children[2];
+		struct
+		{
+			TTreeRelaxed<TTreeNodeT*> left;
+			TTreeRelaxed<TTreeNodeT*> right;
+		};
+	};
+
+	TTreeRelaxed<TTreeNodeT*>	parent;
+
+	TTreeRelaxed<uint64_t>		minPrefix;	//keys[0]的前缀，TTREE_PREFIX_NONE时不使用
+	TTreeRelaxed<uint64_t>		maxPrefix;	//keys[keyNum - 1]的前缀
+
+	std::atomic<uint32_t>	version;	//并发模式下的版本号，奇数表示正在被修改
+
+	unsigned int	count;		//子树(含本节点)中key的总数
+
+	Key				keys[];		//key数组，容量由Create时的size决定
+
+	Key FirstKey()
+	{
+		return keyNum == 0 ? Key() : keys[0];
+	}
+
+	Key LastKey()
+	{
+		return keyNum == 0 ? Key() : keys[keyNum - 1];
+	}
+
+	//乐观读者读取key，写者可能同时在修改
+	Key LoadKey(unsigned int i) const
+	{
+		Key key;
+		TTreeAtomicCopy(&key, keys + i, sizeof(Key));
+
+		return key;
+	}
+
+	void Reheight()
+	{
+		height = MAX(TTREE_HEIGHT_OF(left), TTREE_HEIGHT_OF(right)) + 1;
+	}
+
+	void Recount()
+	{
+		count = keyNum + TTREE_COUNT_OF(left) + TTREE_COUNT_OF(right);
+	}
+
+	TTreeNodeT()
+	{
+		parent = left = right = nullptr;
+
+		keyNum = 0;
+		height = 1;
+		count = 0;
+
+		version.store(0, std::memory_order_relaxed);
+	}
+
+	//key数组之后存放每个key前缀的偏移
+	static size_t SlotPrefixOffset(unsigned int size)
+	{
+		size_t bytes = offsetof(TTreeNodeT, keys) + sizeof(Key) * (size + 1);
+
+		return (bytes + sizeof(uint64_t) - 1) / sizeof(uint64_t) * sizeof(uint64_t);
+	}
+
+	uint64_t* SlotPrefix(unsigned int size)
+	{
+		return (uint64_t*)((char*)this + SlotPrefixOffset(size));
+	}
+
+	/**
+	 * 节点占用的字节数，按缓存行向上取整；slotPrefix时在key之后为每个key留前缀
+	*/
+	static size_t AllocSize(unsigned int size, bool slotPrefix = false)
+	{
+		//多申请一格，插入时有可能挤出来一个key
+		size_t bytes = offsetof(TTreeNodeT, keys) + sizeof(Key) * (size + 1);
+
+		if (slotPrefix)
+		{
+			bytes = SlotPrefixOffset(size) + sizeof(uint64_t) * (size + 1);
+		}
+
+		return (bytes + TTREE_CACHE_LINE - 1) / TTREE_CACHE_LINE * TTREE_CACHE_LINE;
+	}
+
+	static TTreeNodeT* Create(TTreeAllocator* pAllocator, unsigned int size, bool slotPrefix = false)
+	{
+		return new (pAllocator->Alloc(AllocSize(size, slotPrefix))) TTreeNodeT();
+	}
+
+	static void Destroy(TTreeAllocator* pAllocator, TTreeNodeT* pNode, unsigned int size, bool slotPrefix = false)
+	{
+		pAllocator->Free(pNode, AllocSize(size, slotPrefix));
+	}
+};
+
+template <typename Key, typename Compare>
+class TTreeCursorT;
+
+
+/**
+ * Compare需要提供 int operator()(const Key& a, const Key& b) const，
+ * 返回值小于0、等于0、大于0分别表示a小于、等于、大于b；
+ * KeyPrefix需要提供 uint64_t operator()(const Key& key) const，返回保序的定长前缀：
+ * 前缀小的key一定更小，前缀相等时再用Compare比较
+*/
+template <typename Key, typename Compare = TTreeCompare<Key>, typename KeyPrefix = TTreeNoPrefix<Key> >
+class TTreeT
+{
+	static_assert(std::is_trivially_copyable<Key>::value, "TTreeT key must be trivially copyable");
+
+public:
+	typedef TTreeNodeT<Key> Node;
+	typedef TTreeCursorT<Key, Compare> Cursor;
+
+	/**
+	 * pAllocator为空时树自己持有一个TTreeNodePool；
+	 * 外部传入的分配器由调用方管理生命周期，可以在多棵树之间共享
+	*/
+	TTreeT(Compare cmp, bool unique, unsigned int keySize, TTreeAllocator* pAllocator = nullptr, KeyPrefix prefix = KeyPrefix());
+
+	TTreeT(bool unique, unsigned int keySize, TTreeAllocator* pAllocator = nullptr);
+
+	TTreeT(const TTreeT&) = delete;
+
+	TTreeT& operator=(const TTreeT&) = delete;
+
+	//自上而下插入；不小于最大key的key直接插到缓存的最右节点，不从根节点下降
+	int Insert(const Key& key);
+
+	/**
+	 * 在hint指向的节点附近插入，key落在该节点与其前驱、后继之间时不从根节点下降，
+	 * 否则退化为Insert。插入不释放节点，hint在之后的插入中一直可用，删除后失效
+	*/
+	int InsertHint(const Cursor& hint, const Key& key);
+
+	/**
+	 * 批量插入，keys会被原地排序；落在同一个节点的一段key合并后一次写回，
+	 * 只在新建节点时Rebalance。返回实际插入的数量(唯一索引中重复的key不插入)
+	*/
+	size_t InsertBatch(Key* keys, size_t n);
+
+	//返回树中与key相等的key，找不到返回nullptr
+	const Key* Query(const Key& key);
+
+	/**
+	 * 批量查找，结果与逐个Query相同。每TTREE_BATCH_GROUP个查找一组逐层交错下降，
+	 * 先对下一层节点发出预取再处理组内其他查找，隐藏访存延迟
+	*/
+	void QueryBatch(const Key* keys, const Key** out, size_t n);
+
+	/**
+	 * 查找与key相等的key并拷贝到pOut，找不到返回false。
+	 * 并发模式下不加锁，可以与写操作同时调用
+	*/
+	bool Find(const Key& key, Key* pOut);
+
+	/**
+	 * 按顺序对[lo, hi]内的每个key调用fn，fn返回false时停止，返回调用的次数。
+	 * 每次拷贝TTREE_SCAN_CHUNK个key并校验经过的节点后再交给fn，
+	 * 并发模式下节点被修改时从已输出的位置重新定位，不会重复或跳过未被修改的key
+	*/
+	template <typename Fn>
+	size_t Scan(const Key& lo, const Key& hi, Fn fn);
+
+	int Delete(const Key& key);
+
+	/**
+	 * 从有序的key数组直接构建平衡树，O(n)；每个节点填充到keySize * fillFactor。
+	 * 只能在树为空时调用，keys无序(唯一索引时有重复)返回-1
+	*/
+	int BulkLoad(const Key* sortedKeys, size_t n, double fillFactor);
+
+	//第一个不小于key的位置
+	Cursor LowerBound(const Key& key);
+
+	//第一个大于key的位置
+	Cursor UpperBound(const Key& key);
+
+	//[lo, hi]区间内的key，按顺序遍历
+	Cursor Range(const Key& lo, const Key& hi);
+
+	//从最小的key开始遍历
+	Cursor Begin();
+
+	void SetSearchMode(TTreeSearchMode mode);
+
+	/**
+	 * CST布局：每个节点的最小key(及前缀)按中序连续存放，每TTREE_CACHE_LINE字节一块，
+	 * 上层是下层每块的第一个key，从顶层往下每层只访问一个缓存行，最后只访问一个数据节点。
+	 * 节点增删后目录在下一次Get、Query时重建，适合读多写少的阶段；
+	 * Find、Scan等其他操作不受影响
+	*/
+	void SetLayout(TTreeLayout layout);
+
+	/**
+	 * 分裂策略与填充率：fill是分裂时原节点保留的比例，APPEND下也是最右节点填到的比例；
+	 * 内部节点最少key数同时降到不超过fill，删除时不会马上从叶子借key。默认SHIFT。
+	 * 递增key中夹杂迟到的key时，SHIFT为几乎每个迟到的key新建一个只有一个key的节点；
+	 * APPEND以0.9左右的fill给每个节点留出空位，迟到的key直接落入，
+	 * key严格递增时fill取1，节点全部填满
+	*/
+	void SetSplitPolicy(TTreeSplitPolicy policy, double fill = 0.5);
+
+	/**
+	 * 设置前缀缓存方式，节点布局随之变化，只能在树为空时设置，否则返回-1
+	*/
+	int SetPrefixMode(TTreePrefixMode mode);
+
+	/**
+	 * 并发模式：Find、Scan不加锁，按节点版本号乐观校验，读到正在修改的节点时重试；
+	 * 写操作之间互斥，写期间只有被修改的节点对读者不可见。
+	 * Query、QueryBatch、游标返回的是节点内的地址，只能在没有并发写时使用。
+	 * 被删除的节点交给epoch，等读者都离开后再释放。只能在没有其他线程访问时切换
+	*/
+	void SetConcurrent(bool concurrent);
+
+	/**
+	 * 释放已经没有读者能访问到的被删除节点，返回释放的数量；
+	 * 写操作结束时攒够TTREE_EPOCH_BATCH个会自动回收
+	*/
+	size_t Reclaim();
+
+	//O(1)，由节点的子树key数得到
+	unsigned int Count();
+
+	/**
+	 * 小于key的key的个数，即LowerBound的位置，O(log n)。
+	 * Rank、Select、CountRange只能在没有并发写时使用
+	*/
+	unsigned int Rank(const Key& key);
+
+	//第i个(从0开始)key的位置，i超出范围时返回结尾，用于按偏移分页
+	Cursor Select(unsigned int i);
+
+	//[lo, hi]内key的个数
+	unsigned int CountRange(const Key& lo, const Key& hi);
+
+	/**
+	 * 按顺序对每个key调用fn，fn返回false时停止，返回调用的次数。
+	 * 经parent指针找后继节点，不递归、不分配内存，只能在没有并发写时使用
+	*/
+	template <typename Fn>
+	size_t ForEach(Fn fn);
+
+	/**
+	 * 后序访问每个节点，子节点先于父节点，fn可以释放传入的节点。
+	 * 经parent指针回溯，不递归、不分配内存
+	*/
+	template <typename Fn>
+	void ForEachNode(Fn fn);
+
+	/**
+	 * 校验树的结构：key有序、高度与平衡、父指针、子树key数，有错误返回false
+	*/
+	bool Verify();
+
+	//并发模式下可以与Find、Scan同时调用，旧的节点延迟释放
+	void Clear();
+
+	~TTreeT();
+
+//private:
+public:
+	/**
+	 * 写操作的作用域：并发模式下持有写锁，结束时恢复被修改节点的版本号
+	*/
+	class WriteGuard
+	{
+	public:
+		WriteGuard(TTreeT* pTree) : m_pTree(pTree), m_locked(pTree->m_concurrent)
+		{
+			if (m_locked)
+			{
+				m_pTree->m_writeLock.lock();
+			}
+		}
+
+		~WriteGuard()
+		{
+			if (m_locked)
+			{
+				m_pTree->UnlatchAll();
+				m_pTree->m_writeLock.unlock();
+			}
+		}
+
+	private:
+		TTreeT*	m_pTree;
+		bool	m_locked;
+	};
+
+	/**
+	 * Scan一段中读过的节点及其版本号，段结束时统一校验
+	*/
+	struct ScanTrack
+	{
+		Node*		nodes[TTREE_SCAN_TRACK];
+		uint32_t	versions[TTREE_SCAN_TRACK];
+		size_t		num;
+	};
+
+	//Scan上一段结束的位置，节点版本没变时下一段直接从这里继续
+	struct ScanPos
+	{
+		Node*			pNode;
+		unsigned int	index;
+		uint32_t		version;
+	};
+
+	//Insert的实现，调用方负责WriteGuard
+	int InsertOne(const Key& key);
+
+	/**
+	 * key落在pNode的side一侧(0左、1右)且这一侧没有孩子：
+	 * 节点有空位(或按分裂策略)时插入节点，否则新建只有这个key的孩子
+	*/
+	int InsertBeside(Node* pNode, const Key& key, uint64_t prefix, int side);
+
+	//最右节点，节点增删后重新查找
+	Node* Rightmost();
+
+	//逐个节点累加，用于校验子树key数
+	unsigned int Count(Node* pNode);
+
+	//以pRoot为根的子树的后序遍历，见ForEachNode
+	template <typename Fn>
+	static void PostOrder(Node* pRoot, Fn fn);
+
+	//后序遍历的第一个节点：一直往下，有左走左，否则走右
+	static Node* FirstPostOrder(Node* pNode);
+
+	//pNode及其所有祖先的子树key数加上delta
+	static void AddCount(Node* pNode, int delta);
+
+	//不小于(upper时大于)key的第一个key之前的key数
+	unsigned int RankOf(const Key& key, bool upper);
+	/**
+	 * 节点内查找，按m_searchMode选择顺序或二分查找；
+	 * 返回最后一个与key相等的位置，insertPos为其后一个位置
+	*/
+	int SearchNode(Node* pNode, const Key& key, uint64_t prefix, int* insertPos);
+
+	/**
+	 * 节点内第一个不小于key(upper为true时大于key)的位置
+	*/
+	unsigned int SearchBound(Node* pNode, const Key& key, uint64_t prefix, bool upper);
+
+	/**
+	 * 二分查找，语义与SearchBackward一致
+	*/
+	int BinarySeach(Node* pNode, const Key& key, uint64_t prefix, int* insertPos);
+
+	/**
+	 * 从前往后找
+	*/
+	int SearchForward(Node* pNode, const Key& key, int* insertPos);
+
+	/**
+	 * 从后往前找
+	*/
+	int SearchBackward(Node* pNode, const Key& key, uint64_t prefix, int* insertPos);
+
+	Key* Get(const Key& key);
+
+	/**
+	 * CST布局下经目录找到可能包含key的节点：最后一个最小key不大于key的节点。
+	 * 节点集合不变时只插入删除key不重建目录，分界可能过时，沿前驱、后继修正
+	*/
+	Node* DirectoryLookup(const Key& key, uint64_t prefix);
+
+	//目录失效后重建，多个读者同时发现时只有一个重建
+	void BuildDirectory();
+
+	//key与目录第i项比较
+	int CompareDirectory(const Key& key, uint64_t prefix, size_t i);
+
+	//新建节点，节点集合变化，目录和缓存的最右节点失效
+	Node* CreateNode();
+
+	/**
+	 * 节点插入后多出一个key时，移到后继的key个数；
+	 * 为1且后继有空位时移到后继，否则移到新建的后继节点
+	*/
+	unsigned int SplitCount(Node* pNode, int insertPos, Node* pSuccessor);
+
+	/**
+	 * 中序第一个满足 LastKey >= key (upper为true时 LastKey > key) 的节点，
+	 * 以及该节点内对应的位置
+	*/
+	Node* Bound(const Key& key, bool upper, unsigned int* pIndex);
+
+	int InsertIntoNode(Node* pNode, const Key& key, uint64_t prefix);
+
+	/**
+	 * Insert下降时key最终落到的节点：包含key的节点，或者下降到底的节点
+	*/
+	Node* FindInsertNode(const Key& key, uint64_t prefix);
+
+	/**
+	 * 把有序的keys合并进pNode，超出容量的部分放到中序后继节点或新建的节点中，
+	 * 调用方保证keys都在pNode的前驱与后继之间
+	*/
+	size_t MergeIntoNode(Node* pNode, const Key* keys, size_t n, std::vector<Key>& merged, std::vector<uint64_t>& prefixes);
+
+	//把pNewNode挂到pNode的中序后继位置
+	void AttachAfter(Node* pNode, Node* pNewNode);
+
+	/**
+	 * 用第[lo, hi)个节点构建平衡子树，第i个节点存放keys[i * n / nodeNum, (i + 1) * n / nodeNum)
+	*/
+	Node* BuildBalanced(const Key* keys, size_t n, size_t nodeNum, size_t lo, size_t hi, Node* pParent);
+
+	//预取节点头和紧随其后的key
+	static void PrefetchNode(Node* pNode);
+
+	//key的前缀，未开启前缀缓存时为0
+	uint64_t PrefixOf(const Key& key);
+
+	/**
+	 * key与节点最小、最大key以及第i个key比较，前缀能区分时不访问key
+	*/
+	int CompareFirst(const Key& key, uint64_t prefix, Node* pNode);
+
+	int CompareLast(const Key& key, uint64_t prefix, Node* pNode);
+
+	int CompareSlot(const Key& key, uint64_t prefix, Node* pNode, unsigned int i);
+
+	//写入第pos个key
+	void SetKey(Node* pNode, unsigned int pos, const Key& key, uint64_t prefix);
+
+	//从pSrc的srcPos开始搬n个key到pDst的dstPos，区间可以重叠
+	void MoveKeys(Node* pDst, unsigned int dstPos, Node* pSrc, unsigned int srcPos, unsigned int n);
+
+	//key变化后更新节点的最小、最大前缀
+	void UpdateBounds(Node* pNode);
+
+	//取最左边的节点
+	static Node* GetLeft(Node* pNode);
+
+	//取最右边的节点
+	static Node* GetRight(Node* pNode);
+
+	//中序遍历的前一个节点
+	static Node* Predecessor(Node* pNode);
+
+	//中序遍历的后一个节点
+	static Node* Successor(Node* pNode);
+
+	/**
+	 * 非唯一索引中找与key完全相同(==)的key，找不到时保持原位置不变
+	*/
+	bool LocateExact(Node** ppNode, int* pIndex, const Key& key);
+
+	/**
+	 * 从节点中删除第index个key，并处理节点下溢
+	*/
+	void RemoveFromNode(Node* pNode, int index);
+
+	void Rebalance(Node* pNode);
+
+	Node* LeftRotate(Node* pNode);
+
+	Node* RightRotate(Node* pNode);
+
+	//释放节点及其子树
+	void FreeNode(Node* pNode);
+
+	void DestroyNode(Node* pNode);
+
+	/**
+	 * 释放已经从树上摘下的单个节点，并发模式下读者可能还在访问，写操作结束时交给epoch
+	*/
+	void ReleaseNode(Node* pNode);
+
+	//摘下整棵子树，全部交给epoch
+	void RetireTree(Node* pNode);
+
+	/**
+	 * 写操作修改节点前调用：版本号加1变为奇数，写操作结束时由UnlatchAll再加1；
+	 * 非并发模式下什么都不做
+	*/
+	void LatchNode(Node* pNode);
+
+	void UnlatchAll();
+
+	//修改根节点指针，并发模式下同时修改m_rootVersion
+	void SetRoot(Node* pNode);
+
+	//读取版本号，奇数(正在被修改)时返回false
+	static bool ReadVersion(const std::atomic<uint32_t>& version, uint32_t* pVersion);
+
+	//读完数据后校验版本号是否没变
+	static bool Validate(const std::atomic<uint32_t>& version, uint32_t expected);
+
+	//记录节点的版本号，节点正在被修改或者记录满时返回false
+	static bool Track(ScanTrack* pTrack, Node* pNode);
+
+	/**
+	 * 乐观读时与第i个key比较：先拷贝出key并校验版本，保证交给比较器的是完整的key，
+	 * 版本变化时*pValid置为false；pBound不为空时用它代替槽位前缀
+	*/
+	int CompareOptimistic(const Key& key, uint64_t prefix, Node* pNode, uint32_t version, unsigned int i, const TTreeRelaxed<uint64_t>* pBound, bool* pValid);
+
+	/**
+	 * 乐观读的节点内二分，返回第一个不小于key(upper时大于key)的位置
+	*/
+	unsigned int BoundOptimistic(const Key& key, uint64_t prefix, Node* pNode, uint32_t version, unsigned int keyNum, bool upper, bool* pValid);
+
+	/**
+	 * 乐观读的中序后继，经过的节点记入pTrack，由调用方统一校验；
+	 * 遇到正在修改的节点或者记录满时返回false
+	*/
+	bool SuccessorOptimistic(Node* pNode, ScanTrack* pTrack, Node** ppNext);
+
+	/**
+	 * Scan的一段：从pPos继续，或者重新定位到第一个不小于from的key并跳过skip个与from相等的key，
+	 * 拷贝不大于hi的key到out；读到的数据不一致时返回false，由调用方重试
+	*/
+	bool ScanChunk(const Key& from, size_t skip, const Key& hi, Key* out, size_t* pGot, bool* pEnd, ScanPos* pPos);
+
+//private:
+public:
+	bool			m_unique;
+	Compare			m_keyCmp;
+
+	TTreeRelaxed<Node*>	m_pRootNode;	//并发模式下读者不加锁读取
+
+	unsigned int 	m_keySize;
+
+	unsigned int	m_minKeys;	//内部节点最少key数量
+
+	TTreeSplitPolicy	m_splitPolicy;
+	unsigned int		m_splitKeep;	//分裂时原节点保留的key数量
+
+	bool			m_binarySearch;	//节点内是否用二分查找
+	bool			m_simdSearch;	//节点内是否用SIMD查找，优先于m_binarySearch
+
+	//整数key且使用默认比较器时可以用SIMD查找
+	typedef std::integral_constant<bool, TTreeSimdKey<Key>::value && std::is_same<Compare, TTreeCompare<Key> >::value> SimdKey;
+
+	TTreeAllocator*	m_pAllocator;
+	bool			m_ownAllocator;	//分配器是否为本树独占
+
+	KeyPrefix		m_keyPrefix;
+	TTreePrefixMode	m_prefixMode;
+
+	bool					m_concurrent;	//是否并发模式
+	std::mutex				m_writeLock;	//写操作之间互斥
+	std::atomic<uint32_t>	m_rootVersion;	//根节点指针的版本号
+	bool					m_rootLatched;
+
+	std::vector<Node*>		m_latched;		//本次写操作修改过的节点
+	std::vector<Node*>		m_retiring;		//本次写操作摘下的节点
+
+	TTreeEpoch				m_epoch;		//被删除节点的延迟回收
+
+	//目录的一层，从offset开始连续num项，offset按块对齐
+	struct DirLevel
+	{
+		size_t	offset;
+		size_t	num;
+	};
+
+	TTreeLayout				m_layout;
+	std::atomic<bool>		m_dirValid;		//目录与当前的节点集合是否一致
+	std::mutex				m_dirLock;
+	unsigned int			m_dirFanout;	//每块的项数
+	Key*					m_pDirKeys;		//各层的分界key，底层在前
+	uint64_t*				m_pDirPrefixes;	//分界key的前缀，TTREE_PREFIX_NONE时不使用
+	size_t					m_dirCapacity;
+	std::vector<DirLevel>	m_dirLevels;
+	std::vector<Node*>		m_dirNodes;		//底层第i项所属的节点
+
+	Node*					m_pRightmost;	//缓存的最右节点，节点增删后置空
+};
+
+/**
+ * 原地遍历的游标，节点内逐个key往后走，走完后经parent指针找中序后继节点，
+ * 不分配内存；树被修改后游标失效
+*/
+template <typename Key, typename Compare>
+class TTreeCursorT
+{
+public:
+	typedef TTreeNodeT<Key> Node;
+
+	TTreeCursorT() : m_pNode(nullptr), m_index(0), m_pCmp(nullptr), m_bounded(false)
+	{
+	}
+
+	TTreeCursorT(Node* pNode, unsigned int index, const Compare* pCmp, const Key* pHi)
+		: m_pNode(pNode), m_index(index), m_pCmp(pCmp), m_bounded(pHi != nullptr)
+	{
+		if (m_bounded)
+		{
+			m_hi = *pHi;
+		}
+
+		CheckBound();
+	}
+
+	const Key* Get() const
+	{
+		return IsEOF() ? nullptr : &m_pNode->keys[m_index];
+	}
+
+	bool IsEOF() const
+	{
+		return m_pNode == nullptr;
+	}
+
+	bool Next()
+	{
+		if (IsEOF())
+		{
+			return false;
+		}
+
+		if (++m_index >= m_pNode->keyNum)
+		{
+			m_pNode = TTreeT<Key, Compare>::Successor(m_pNode);
+			m_index = 0;
+		}
+
+		CheckBound();
+
+		return !IsEOF();
+	}
+
+	Node* GetNode() const
+	{
+		return m_pNode;
+	}
+
+	unsigned int GetIndex() const
+	{
+		return m_index;
+	}
+
+private:
+	//超过上界即结束
+	void CheckBound()
+	{
+		if (m_pNode && m_bounded && (*m_pCmp)(m_pNode->keys[m_index], m_hi) > 0)
+		{
+			m_pNode = nullptr;
+		}
+	}
+
+private:
+	Node*			m_pNode;
+	unsigned int	m_index;
+
+	const Compare*	m_pCmp;
+	Key				m_hi;
+	bool			m_bounded;
+};
+
+
+template <typename Key, typename Compare, typename KeyPrefix>
+TTreeT<Key, Compare, KeyPrefix>::TTreeT(Compare cmp, bool unique, unsigned int keySize, TTreeAllocator* pAllocator, KeyPrefix prefix)
+	: m_keyCmp(cmp), m_keyPrefix(prefix)
+{
+	m_ownAllocator = (pAllocator == nullptr);
+	m_pAllocator = m_ownAllocator ? new TTreeNodePool() : pAllocator;
+
+	m_unique = unique;
+	m_keySize = keySize;
+	m_minKeys = keySize > 2 ? keySize - 2 : 1;
+
+	m_splitPolicy = TTREE_SPLIT_SHIFT;
+	m_splitKeep = keySize;
+
+	m_pRootNode = nullptr;
+	m_prefixMode = TTREE_PREFIX_NONE;
+
+	m_concurrent = false;
+	m_rootVersion.store(0, std::memory_order_relaxed);
+	m_rootLatched = false;
+
+	m_layout = TTREE_LAYOUT_NODE;
+	m_dirValid.store(false, std::memory_order_relaxed);
+	m_dirFanout = sizeof(Key) * 2 > TTREE_CACHE_LINE ? 2 : TTREE_CACHE_LINE / sizeof(Key);
+	m_pDirKeys = nullptr;
+	m_pDirPrefixes = nullptr;
+	m_dirCapacity = 0;
+
+	m_pRightmost = nullptr;
+
+	SetSearchMode(TTREE_SEARCH_AUTO);
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+void TTreeT<Key, Compare, KeyPrefix>::SetSearchMode(TTreeSearchMode mode)
+{
+	if (mode == TTREE_SEARCH_AUTO || mode == TTREE_SEARCH_SIMD)
+	{
+		m_binarySearch = m_keySize > TTREE_LINEAR_SEARCH_MAX;
+	}
+	else
+	{
+		m_binarySearch = (mode == TTREE_SEARCH_BINARY);
+	}
+
+	m_simdSearch = SimdKey::value && (mode == TTREE_SEARCH_SIMD || (mode == TTREE_SEARCH_AUTO && m_keySize <= TTREE_SIMD_SEARCH_MAX));
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+void TTreeT<Key, Compare, KeyPrefix>::SetLayout(TTreeLayout layout)
+{
+	m_layout = layout;
+	m_dirValid.store(false, std::memory_order_relaxed);
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+void TTreeT<Key, Compare, KeyPrefix>::SetSplitPolicy(TTreeSplitPolicy policy, double fill)
+{
+	unsigned int keep = (unsigned int)(m_keySize * fill + 0.5);
+
+	keep = keep < 1 ? 1 : (keep > m_keySize ? m_keySize : keep);
+
+	m_splitPolicy = policy;
+	m_splitKeep = (policy == TTREE_SPLIT_SHIFT) ? m_keySize : keep;
+	m_minKeys = m_keySize > 2 ? m_keySize - 2 : 1;
+	if (policy != TTREE_SPLIT_SHIFT && keep < m_minKeys)
+	{
+		m_minKeys = keep;
+	}
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+int TTreeT<Key, Compare, KeyPrefix>::SetPrefixMode(TTreePrefixMode mode)
+{
+	if (m_pRootNode)
+	{
+		return -1;
+	}
+
+	m_prefixMode = mode;
+
+	return 0;
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+void TTreeT<Key, Compare, KeyPrefix>::SetConcurrent(bool concurrent)
+{
+	m_concurrent = concurrent;
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+inline uint64_t TTreeT<Key, Compare, KeyPrefix>::PrefixOf(const Key& key)
+{
+	return m_prefixMode == TTREE_PREFIX_NONE ? 0 : m_keyPrefix(key);
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+inline int TTreeT<Key, Compare, KeyPrefix>::CompareFirst(const Key& key, uint64_t prefix, Node* pNode)
+{
+	if (m_prefixMode != TTREE_PREFIX_NONE && prefix != pNode->minPrefix)
+	{
+		return prefix < pNode->minPrefix ? -1 : 1;
+	}
+
+	return m_keyCmp(key, pNode->FirstKey());
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+inline int TTreeT<Key, Compare, KeyPrefix>::CompareLast(const Key& key, uint64_t prefix, Node* pNode)
+{
+	if (m_prefixMode != TTREE_PREFIX_NONE && prefix != pNode->maxPrefix)
+	{
+		return prefix < pNode->maxPrefix ? -1 : 1;
+	}
+
+	return m_keyCmp(key, pNode->LastKey());
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+inline int TTreeT<Key, Compare, KeyPrefix>::CompareSlot(const Key& key, uint64_t prefix, Node* pNode, unsigned int i)
+{
+	if (m_prefixMode == TTREE_PREFIX_SLOTS)
+	{
+		uint64_t slot = pNode->SlotPrefix(m_keySize)[i];
+		if (prefix != slot)
+		{
+			return prefix < slot ? -1 : 1;
+		}
+	}
+
+	return m_keyCmp(key, pNode->keys[i]);
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+inline void TTreeT<Key, Compare, KeyPrefix>::SetKey(Node* pNode, unsigned int pos, const Key& key, uint64_t prefix)
+{
+	LatchNode(pNode);
+
+	//并发模式下读者可能同时在读这个位置
+	if (m_concurrent)
+	{
+		TTreeAtomicCopy(pNode->keys + pos, &key, sizeof(Key));
+	}
+	else
+	{
+		pNode->keys[pos] = key;
+	}
+
+	if (m_prefixMode == TTREE_PREFIX_SLOTS)
+	{
+		__atomic_store_n(pNode->SlotPrefix(m_keySize) + pos, prefix, __ATOMIC_RELAXED);
+	}
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+inline void TTreeT<Key, Compare, KeyPrefix>::MoveKeys(Node* pDst, unsigned int dstPos, Node* pSrc, unsigned int srcPos, unsigned int n)
+{
+	//n为0时调用方随后也会修改keyNum
+	LatchNode(pDst);
+
+	if (n == 0)
+	{
+		return;
+	}
+
+	bool slots = (m_prefixMode == TTREE_PREFIX_SLOTS);
+
+	//并发模式下读者可能同时在读这些位置
+	if (m_concurrent)
+	{
+		TTreeAtomicCopy(pDst->keys + dstPos, pSrc->keys + srcPos, sizeof(Key) * n);
+		if (slots)
+		{
+			TTreeAtomicCopy(pDst->SlotPrefix(m_keySize) + dstPos, pSrc->SlotPrefix(m_keySize) + srcPos, sizeof(uint64_t) * n);
+		}
+
+		return;
+	}
+
+	memmove((void*)(pDst->keys + dstPos), (const void*)(pSrc->keys + srcPos), sizeof(Key) * n);
+
+	if (slots)
+	{
+		memmove(pDst->SlotPrefix(m_keySize) + dstPos, pSrc->SlotPrefix(m_keySize) + srcPos, sizeof(uint64_t) * n);
+	}
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+inline void TTreeT<Key, Compare, KeyPrefix>::UpdateBounds(Node* pNode)
+{
+	if (m_prefixMode == TTREE_PREFIX_NONE || pNode->keyNum == 0)
+	{
+		return;
+	}
+
+	LatchNode(pNode);
+
+	if (m_prefixMode == TTREE_PREFIX_SLOTS)
+	{
+		pNode->minPrefix = pNode->SlotPrefix(m_keySize)[0];
+		pNode->maxPrefix = pNode->SlotPrefix(m_keySize)[pNode->keyNum - 1];
+	}
+	else
+	{
+		pNode->minPrefix = m_keyPrefix(pNode->keys[0]);
+		pNode->maxPrefix = m_keyPrefix(pNode->keys[pNode->keyNum - 1]);
+	}
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+TTreeT<Key, Compare, KeyPrefix>::TTreeT(bool unique, unsigned int keySize, TTreeAllocator* pAllocator) : TTreeT(Compare(), unique, keySize, pAllocator)
+{
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+void TTreeT<Key, Compare, KeyPrefix>::Clear()
+{
+	WriteGuard guard(this);
+
+	m_dirValid.store(false, std::memory_order_relaxed);
+	m_pRightmost = nullptr;
+
+	//读者可能还停留在旧树上，节点全部交给epoch
+	if (m_concurrent)
+	{
+		Node* pRoot = m_pRootNode;
+		if (pRoot)
+		{
+			SetRoot(nullptr);
+			RetireTree(pRoot);
+		}
+
+		return;
+	}
+
+	if (m_pRootNode == nullptr && m_epoch.Pending() == 0)
+	{
+		return;
+	}
+
+	//独占的分配器整体释放slab，不用逐个节点遍历
+	if (m_ownAllocator && m_pAllocator->Reset())
+	{
+		m_epoch.ReclaimAll([](void*) {});
+	}
+	else
+	{
+		if (m_pRootNode)
+		{
+			FreeNode(m_pRootNode);
+		}
+
+		m_epoch.ReclaimAll([this](void* p) { DestroyNode((Node*)p); });
+	}
+
+	SetRoot(nullptr);
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+size_t TTreeT<Key, Compare, KeyPrefix>::Reclaim()
+{
+	WriteGuard guard(this);
+
+	return m_epoch.Reclaim([this](void* p) { DestroyNode((Node*)p); });
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+TTreeT<Key, Compare, KeyPrefix>::~TTreeT()
+{
+	//析构时不会再有读者
+	m_concurrent = false;
+	Clear();
+
+	if (m_ownAllocator)
+	{
+		delete m_pAllocator;
+	}
+
+	free(m_pDirKeys);
+	free(m_pDirPrefixes);
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+void TTreeT<Key, Compare, KeyPrefix>::FreeNode(Node* pNode)
+{
+	PostOrder(pNode, [this](Node* pCur) { DestroyNode(pCur); });
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+inline void TTreeT<Key, Compare, KeyPrefix>::DestroyNode(Node* pNode)
+{
+	Node::Destroy(m_pAllocator, pNode, m_keySize, m_prefixMode == TTREE_PREFIX_SLOTS);
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+void TTreeT<Key, Compare, KeyPrefix>::ReleaseNode(Node* pNode)
+{
+	m_dirValid.store(false, std::memory_order_relaxed);
+	m_pRightmost = nullptr;
+
+	if (!m_concurrent)
+	{
+		DestroyNode(pNode);
+		return;
+	}
+
+	//保持奇数版本号，还停留在这个节点上的读者校验失败后从根节点重试
+	LatchNode(pNode);
+	m_retiring.push_back(pNode);
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+inline TTreeNodeT<Key>* TTreeT<Key, Compare, KeyPrefix>::CreateNode()
+{
+	m_dirValid.store(false, std::memory_order_relaxed);
+	m_pRightmost = nullptr;
+
+	return Node::Create(m_pAllocator, m_keySize, m_prefixMode == TTREE_PREFIX_SLOTS);
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+void TTreeT<Key, Compare, KeyPrefix>::RetireTree(Node* pNode)
+{
+	PostOrder(pNode, [this](Node* pCur) { m_retiring.push_back(pCur); });
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+TTreeNodeT<Key>* TTreeT<Key, Compare, KeyPrefix>::FirstPostOrder(Node* pNode)
+{
+	while (pNode->left || pNode->right)
+	{
+		pNode = pNode->left ? pNode->left : pNode->right;
+	}
+
+	return pNode;
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+template <typename Fn>
+void TTreeT<Key, Compare, KeyPrefix>::PostOrder(Node* pRoot, Fn fn)
+{
+	if (pRoot == nullptr)
+	{
+		return;
+	}
+
+	Node* pNode = FirstPostOrder(pRoot);
+
+	while (true)
+	{
+		//fn可能释放pNode，先记下回溯要用的父节点和方向
+		Node* pParent = (pNode == pRoot) ? nullptr : pNode->parent.Load();
+		bool fromLeft = pParent && pParent->left == pNode;
+
+		fn(pNode);
+
+		if (pParent == nullptr)
+		{
+			return;
+		}
+
+		//从左子树上来且有右子树时先走完右子树，否则轮到父节点
+		pNode = (fromLeft && pParent->right) ? FirstPostOrder(pParent->right) : pParent;
+	}
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+template <typename Fn>
+void TTreeT<Key, Compare, KeyPrefix>::ForEachNode(Fn fn)
+{
+	PostOrder(m_pRootNode, fn);
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+template <typename Fn>
+size_t TTreeT<Key, Compare, KeyPrefix>::ForEach(Fn fn)
+{
+	size_t n = 0;
+
+	for (Node* pNode = m_pRootNode ? GetLeft(m_pRootNode) : nullptr; pNode; pNode = Successor(pNode))
+	{
+		for (unsigned int i = 0; i < pNode->keyNum; i++)
+		{
+			n++;
+
+			if (!fn(pNode->keys[i]))
+			{
+				return n;
+			}
+		}
+	}
+
+	return n;
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+bool TTreeT<Key, Compare, KeyPrefix>::Verify()
+{
+	bool ok = (m_pRootNode == nullptr || m_pRootNode->parent == nullptr);
+
+	//节点自身：子节点先被访问，高度和key数可以直接用
+	PostOrder(m_pRootNode, [this, &ok](Node* pNode)
+	{
+		int diff = TTREE_HEIGHT_OF(pNode->left) - TTREE_HEIGHT_OF(pNode->right);
+
+		if (pNode->keyNum == 0 || pNode->keyNum > m_keySize || diff > 1 || diff < -1 ||
+			pNode->height != MAX(TTREE_HEIGHT_OF(pNode->left), TTREE_HEIGHT_OF(pNode->right)) + 1 ||
+			pNode->count != pNode->keyNum + TTREE_COUNT_OF(pNode->left) + TTREE_COUNT_OF(pNode->right) ||
+			(pNode->left && pNode->left->parent != pNode) || (pNode->right && pNode->right->parent != pNode))
+		{
+			ok = false;
+		}
+	});
+
+	//中序相邻的key有序，唯一索引不能相等
+	bool first = true;
+	Key prev = Key();
+
+	ForEach([this, &ok, &first, &prev](const Key& key)
+	{
+		if (!first)
+		{
+			int cmp = m_keyCmp(prev, key);
+			if (cmp > 0 || (m_unique && cmp == 0))
+			{
+				ok = false;
+			}
+		}
+
+		first = false;
+		prev = key;
+
+		return ok;
+	});
+
+	return ok;
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+inline void TTreeT<Key, Compare, KeyPrefix>::LatchNode(Node* pNode)
+{
+	if (!m_concurrent)
+	{
+		return;
+	}
+
+	uint32_t version = pNode->version.load(std::memory_order_relaxed);
+	if (version & 1)
+	{
+		//本次写操作已经修改过
+		return;
+	}
+
+	pNode->version.store(version + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	m_latched.push_back(pNode);
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+void TTreeT<Key, Compare, KeyPrefix>::UnlatchAll()
+{
+	for (Node* pNode : m_latched)
+	{
+		if (std::find(m_retiring.begin(), m_retiring.end(), pNode) != m_retiring.end())
+		{
+			continue;
+		}
+
+		pNode->version.store(pNode->version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	if (m_rootLatched)
+	{
+		m_rootVersion.store(m_rootVersion.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		m_rootLatched = false;
+	}
+
+	m_latched.clear();
+
+	//节点已经摘下，版本号也已经恢复，此后进入的读者不会再访问到
+	for (Node* pNode : m_retiring)
+	{
+		m_epoch.Retire(pNode);
+	}
+	m_retiring.clear();
+
+	if (m_epoch.Pending() >= TTREE_EPOCH_BATCH)
+	{
+		m_epoch.Reclaim([this](void* p) { DestroyNode((Node*)p); });
+	}
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+inline void TTreeT<Key, Compare, KeyPrefix>::SetRoot(Node* pNode)
+{
+	if (m_pRootNode == pNode)
+	{
+		return;
+	}
+
+	if (m_concurrent && !m_rootLatched)
+	{
+		m_rootVersion.store(m_rootVersion.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		m_rootLatched = true;
+	}
+
+	m_pRootNode = pNode;
+}
+
+
+template <typename Key, typename Compare, typename KeyPrefix>
+int TTreeT<Key, Compare, KeyPrefix>::SearchForward(Node* pNode, const Key& key, int* insertPos)
+{
+	int found = -1;
+	int cmp;
+
+	*insertPos = pNode->keyNum;	//假设在最后面，若for循环了一遍都没有被赋值，假设成立
+
+	for(int i = 0; i < (int)pNode->keyNum; i++)
+	{
+		cmp = m_keyCmp(pNode->keys[i], key);
+		if (cmp == 0)
+		{
+			found = i;
+			*insertPos = i + 1;
+			break;
+		}
+		else if (cmp > 0)
+		{
+			*insertPos = i;
+			break;
+		}
+	}
+
+	return found;
+}
+
+
+template <typename Key, typename Compare, typename KeyPrefix>
+int TTreeT<Key, Compare, KeyPrefix>::SearchBackward(Node* pNode, const Key& key, uint64_t prefix, int* insertPos)
+{
+	int found = -1;
+	int cmp;
+
+	*insertPos = 0;
+
+	for(int i = pNode->keyNum; i > 0; i--)
+	{
+		cmp = CompareSlot(key, prefix, pNode, i - 1);
+		if (cmp == 0)
+		{
+			found = i - 1;
+			*insertPos = i;
+			break;
+		}
+		else if (cmp > 0)
+		{
+			*insertPos = i;
+			break;
+		}
+	}
+
+	return found;
+}
+
+/**
+ * 无分支二分：base始终是最后一个不大于key的位置(或0)，循环内只有条件赋值
+*/
+template <typename Key, typename Compare, typename KeyPrefix>
+int TTreeT<Key, Compare, KeyPrefix>::BinarySeach(Node* pNode, const Key& key, uint64_t prefix, int* insertPos)
+{
+	unsigned int base = 0, n = pNode->keyNum, half;
+
+	if (n == 0)
+	{
+		*insertPos = 0;
+		return -1;
+	}
+
+	while (n > 1)
+	{
+		half = n / 2;
+		base = (CompareSlot(key, prefix, pNode, base + half) >= 0) ? base + half : base;
+		n -= half;
+	}
+
+	int cmp = CompareSlot(key, prefix, pNode, base);
+
+	*insertPos = base + (cmp >= 0);
+
+	return cmp == 0 ? (int)base : -1;
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+inline int TTreeT<Key, Compare, KeyPrefix>::SearchNode(Node* pNode, const Key& key, uint64_t prefix, int* insertPos)
+{
+	//与其他方式一致：insertPos在相等的key之后，找到时返回最后一个相等的key
+	if (m_simdSearch)
+	{
+		unsigned int upper = TTreeSimdRank(pNode->keys, pNode->keyNum, key, true, SimdKey());
+
+		*insertPos = upper;
+		return (upper > 0 && m_keyCmp(pNode->keys[upper - 1], key) == 0) ? (int)upper - 1 : -1;
+	}
+
+	return m_binarySearch ? BinarySeach(pNode, key, prefix, insertPos) : SearchBackward(pNode, key, prefix, insertPos);
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+unsigned int TTreeT<Key, Compare, KeyPrefix>::SearchBound(Node* pNode, const Key& key, uint64_t prefix, bool upper)
+{
+	//upper时找第一个 key < keys[i]，否则找第一个 key <= keys[i]
+	int limit = upper ? 0 : 1;
+	unsigned int i = 0;
+
+	if (m_simdSearch)
+	{
+		return TTreeSimdRank(pNode->keys, pNode->keyNum, key, upper, SimdKey());
+	}
+
+	if (m_binarySearch)
+	{
+		unsigned int n = pNode->keyNum, half;
+
+		if (n == 0)
+		{
+			return 0;
+		}
+
+		while (n > 1)
+		{
+			half = n / 2;
+			i = (CompareSlot(key, prefix, pNode, i + half) >= limit) ? i + half : i;
+			n -= half;
+		}
+
+		return i + (CompareSlot(key, prefix, pNode, i) >= limit);
+	}
+
+	while (i < pNode->keyNum && CompareSlot(key, prefix, pNode, i) >= limit)
+	{
+		i++;
+	}
+
+	return i;
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+Key* TTreeT<Key, Compare, KeyPrefix>::Get(const Key& key)
+{
+	Node* pNode = m_pRootNode;
+	int index, insertPos;
+	Key* pTarget = nullptr;
+
+	uint64_t prefix = PrefixOf(key);
+	int cmpLeft, cmpRight;
+
+	if (m_layout == TTREE_LAYOUT_CST)
+	{
+		pNode = DirectoryLookup(key, prefix);
+		if (pNode == nullptr || CompareFirst(key, prefix, pNode) < 0 || CompareLast(key, prefix, pNode) > 0)
+		{
+			return nullptr;
+		}
+
+		index = SearchNode(pNode, key, prefix, &insertPos);
+
+		return index >= 0 ? &pNode->keys[index] : nullptr;
+	}
+
+	while (pNode)
+	{
+		cmpLeft = CompareFirst(key, prefix, pNode);
+		if (cmpLeft < 0)
+		{
+			pNode = pNode->left;
+			continue;
+		}
+		else if ((cmpRight = CompareLast(key, prefix, pNode)) > 0)
+		{
+			pNode = pNode->right;
+			continue;
+		}
+		else
+		{
+			index = SearchNode(pNode, key, prefix, &insertPos);
+			if (index >= 0)
+				pTarget = &pNode->keys[index];
+
+			break;
+		}
+	}
+
+	return pTarget;
+}
+
+
+template <typename Key, typename Compare, typename KeyPrefix>
+inline int TTreeT<Key, Compare, KeyPrefix>::CompareDirectory(const Key& key, uint64_t prefix, size_t i)
+{
+	if (m_prefixMode != TTREE_PREFIX_NONE && prefix != m_pDirPrefixes[i])
+	{
+		return prefix < m_pDirPrefixes[i] ? -1 : 1;
+	}
+
+	return m_keyCmp(key, m_pDirKeys[i]);
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+TTreeNodeT<Key>* TTreeT<Key, Compare, KeyPrefix>::DirectoryLookup(const Key& key, uint64_t prefix)
+{
+	if (!m_dirValid.load(std::memory_order_acquire))
+	{
+		BuildDirectory();
+	}
+
+	if (m_dirNodes.empty())
+	{
+		return nullptr;
+	}
+
+	//每层在一块内无分支二分，找最后一个不大于key的分界，只访问这一块所在的缓存行
+	size_t pos = 0;
+	for (size_t level = m_dirLevels.size(); level-- > 0;)
+	{
+		const DirLevel& dir = m_dirLevels[level];
+		size_t begin = pos * m_dirFanout;
+		size_t n = (begin + m_dirFanout) < dir.num ? m_dirFanout : dir.num - begin;
+
+		pos = begin;
+		while (n > 1)
+		{
+			size_t half = n / 2;
+			pos = CompareDirectory(key, prefix, dir.offset + pos + half) >= 0 ? pos + half : pos;
+			n -= half;
+		}
+
+		if (level > 0)
+		{
+			TTREE_PREFETCH(m_pDirKeys + m_dirLevels[level - 1].offset + pos * m_dirFanout);
+		}
+	}
+
+	//重建后节点的最小key可能已经变化
+	Node* pNode = m_dirNodes[pos];
+	Node* pNext;
+
+	while (CompareFirst(key, prefix, pNode) < 0 && (pNext = Predecessor(pNode)) != nullptr)
+	{
+		pNode = pNext;
+	}
+
+	while (CompareLast(key, prefix, pNode) > 0 && (pNext = Successor(pNode)) != nullptr && CompareFirst(key, prefix, pNext) >= 0)
+	{
+		pNode = pNext;
+	}
+
+	return pNode;
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+void TTreeT<Key, Compare, KeyPrefix>::BuildDirectory()
+{
+	std::lock_guard<std::mutex> lock(m_dirLock);
+
+	if (m_dirValid.load(std::memory_order_relaxed))
+	{
+		return;
+	}
+
+	m_dirNodes.clear();
+	m_dirLevels.clear();
+
+	for (Node* pNode = m_pRootNode ? GetLeft(m_pRootNode) : nullptr; pNode; pNode = Successor(pNode))
+	{
+		m_dirNodes.push_back(pNode);
+	}
+
+	//每层从块边界开始，直到一块放得下
+	size_t total = 0;
+	for (size_t num = m_dirNodes.size(); num > 0; num = (num + m_dirFanout - 1) / m_dirFanout)
+	{
+		m_dirLevels.push_back(DirLevel{total, num});
+		total += (num + m_dirFanout - 1) / m_dirFanout * m_dirFanout;
+
+		if (num <= m_dirFanout)
+		{
+			break;
+		}
+	}
+
+	if (total > m_dirCapacity)
+	{
+		size_t capacity = total * 2;
+
+		free(m_pDirKeys);
+		free(m_pDirPrefixes);
+		m_pDirKeys = (Key*)aligned_alloc(TTREE_CACHE_LINE, (sizeof(Key) * capacity + TTREE_CACHE_LINE - 1) / TTREE_CACHE_LINE * TTREE_CACHE_LINE);
+		m_pDirPrefixes = (uint64_t*)aligned_alloc(TTREE_CACHE_LINE, (sizeof(uint64_t) * capacity + TTREE_CACHE_LINE - 1) / TTREE_CACHE_LINE * TTREE_CACHE_LINE);
+		if (m_pDirKeys == nullptr || m_pDirPrefixes == nullptr)
+		{
+			free(m_pDirKeys);
+			free(m_pDirPrefixes);
+			m_pDirKeys = nullptr;
+			m_pDirPrefixes = nullptr;
+			m_dirCapacity = 0;
+
+			throw std::bad_alloc();
+		}
+
+		m_dirCapacity = capacity;
+	}
+
+	for (size_t i = 0; i < m_dirNodes.size(); i++)
+	{
+		m_pDirKeys[i] = m_dirNodes[i]->keys[0];
+		m_pDirPrefixes[i] = m_dirNodes[i]->minPrefix;
+	}
+
+	for (size_t level = 1; level < m_dirLevels.size(); level++)
+	{
+		const DirLevel& lower = m_dirLevels[level - 1];
+		const DirLevel& dir = m_dirLevels[level];
+
+		for (size_t i = 0; i < dir.num; i++)
+		{
+			m_pDirKeys[dir.offset + i] = m_pDirKeys[lower.offset + i * m_dirFanout];
+			m_pDirPrefixes[dir.offset + i] = m_pDirPrefixes[lower.offset + i * m_dirFanout];
+		}
+	}
+
+	m_dirValid.store(true, std::memory_order_release);
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+int TTreeT<Key, Compare, KeyPrefix>::InsertIntoNode(Node* pNode, const Key& key, uint64_t prefix)
+{
+	int insertPos, foundIndex;
+	foundIndex = SearchNode(pNode, key, prefix, &insertPos);
+
+	if (m_unique && foundIndex >= 0)
+	{
+		return -1;
+	}
+
+	//往后挪
+	MoveKeys(pNode, insertPos + 1, pNode, insertPos, pNode->keyNum - insertPos);
+	SetKey(pNode, insertPos, key, prefix);
+
+	//插入前就挤满了格子，那么会多出来的一格，多出来的往右子树的最左边插
+	if (pNode->keyNum >= m_keySize)
+	{
+		Node* pMostLeft = pNode->right ? GetLeft(pNode->right) : nullptr;
+		unsigned int moved = SplitCount(pNode, insertPos, pMostLeft);
+
+		if (moved == 1 && pMostLeft && pMostLeft->keyNum < m_keySize)
+		{
+			MoveKeys(pMostLeft, 1, pMostLeft, 0, pMostLeft->keyNum);
+			MoveKeys(pMostLeft, 0, pNode, m_keySize, 1);
+			pMostLeft->keyNum++;
+			AddCount(pMostLeft, 1);
+			UpdateBounds(pMostLeft);
+		}
+		else
+		{
+			//后半段移到新建的后继节点：右子树最左边节点的左孩子，或者没有右子树时的右孩子
+			Node* pNewNode = CreateNode();
+			MoveKeys(pNewNode, 0, pNode, m_keySize + 1 - moved, moved);
+			pNewNode->keyNum = moved;
+			UpdateBounds(pNewNode);
+
+			LatchNode(pNode);
+			pNode->keyNum = m_keySize + 1 - moved;
+			AddCount(pNode, 1 - (int)moved);
+
+			Node* pParent = pMostLeft ? pMostLeft : pNode;
+			LatchNode(pParent);
+			pNewNode->parent = pParent;
+			if (pMostLeft)
+			{
+				pParent->left = pNewNode;
+			}
+			else
+			{
+				pParent->right = pNewNode;
+			}
+			AddCount(pNewNode, moved);
+
+			UpdateBounds(pNode);
+			Rebalance(pParent);
+
+			return 0;
+		}
+	}
+	else
+	{
+		pNode->keyNum++;
+		AddCount(pNode, 1);
+	}
+
+	UpdateBounds(pNode);
+
+	return 0;
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+unsigned int TTreeT<Key, Compare, KeyPrefix>::SplitCount(Node* pNode, int insertPos, Node* pSuccessor)
+{
+	//后继还有空位时只挪一个，不新建节点
+	if (m_splitPolicy == TTREE_SPLIT_SHIFT || (pSuccessor && pSuccessor->keyNum < m_keySize))
+	{
+		return 1;
+	}
+
+	//追加到整棵树的末尾：原节点填满，新节点从新插入的key开始
+	if (m_splitPolicy == TTREE_SPLIT_APPEND && pSuccessor == nullptr && insertPos == (int)m_keySize && pNode == Rightmost())
+	{
+		return 1;
+	}
+
+	return m_keySize + 1 - m_splitKeep;
+}
+
+//取最左边的节点
+template <typename Key, typename Compare, typename KeyPrefix>
+TTreeNodeT<Key>* TTreeT<Key, Compare, KeyPrefix>::GetLeft(Node* pNode)
+{
+	while (pNode->left)
+	{
+		pNode = pNode->left;
+	}
+
+	return pNode;
+}
+
+//取最右边的节点
+template <typename Key, typename Compare, typename KeyPrefix>
+TTreeNodeT<Key>* TTreeT<Key, Compare, KeyPrefix>::GetRight(Node* pNode)
+{
+	while (pNode->right)
+	{
+		pNode = pNode->right;
+	}
+
+	return pNode;
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+TTreeNodeT<Key>* TTreeT<Key, Compare, KeyPrefix>::Predecessor(Node* pNode)
+{
+	if (pNode->left)
+	{
+		return GetRight(pNode->left);
+	}
+
+	//往上找到第一个从右边上来的祖先
+	while (pNode->parent && pNode == pNode->parent->left)
+	{
+		pNode = pNode->parent;
+	}
+
+	return pNode->parent;
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+TTreeNodeT<Key>* TTreeT<Key, Compare, KeyPrefix>::Successor(Node* pNode)
+{
+	if (pNode->right)
+	{
+		return GetLeft(pNode->right);
+	}
+
+	while (pNode->parent && pNode == pNode->parent->right)
+	{
+		pNode = pNode->parent;
+	}
+
+	return pNode->parent;
+}
+
+/**
+ * RR型，直接左旋
+ * 	P
+ * 		R
+ *
+ * 			R
+ *
+ * RL型，先右旋，转化成RR型，再左旋
+ * P
+ * 		R
+ * L
+ *
+ * LL型与RR型类似，LR型与RL型类似
+ *
+*/
+
+template <typename Key, typename Compare, typename KeyPrefix>
+void TTreeT<Key, Compare, KeyPrefix>::Rebalance(Node* pNode)
+{
+	int diff;	//左右子树高度差
+
+	do
+	{
+		pNode->Reheight();
+
+		diff = TTREE_HEIGHT_OF(pNode->left) - TTREE_HEIGHT_OF(pNode->right);
+
+		//右子树过高
+		if (diff < -1)
+		{
+			int subDiff = TTREE_HEIGHT_OF(pNode->right->left) - TTREE_HEIGHT_OF(pNode->right->right);
+			//RL型
+			if (subDiff > 0)
+			{
+				pNode = RightRotate(pNode->right->left);
+				pNode = LeftRotate(pNode);
+			}
+			//RR型
+			else
+			{
+				pNode = LeftRotate(pNode->right);
+			}
+		}
+		//左子树过高
+		else if (diff > 1)
+		{
+			int subDiff = TTREE_HEIGHT_OF(pNode->left->left) - TTREE_HEIGHT_OF(pNode->left->right);
+			//LR型
+			if (subDiff < 0)
+			{
+				pNode = LeftRotate(pNode->left->right);
+				pNode = RightRotate(pNode);
+			}
+			else
+			{
+				pNode = RightRotate(pNode->left);
+			}
+		}
+
+		if(pNode->parent == nullptr)
+		{
+			SetRoot(pNode);
+		}
+
+		pNode = pNode->parent;
+	}
+	while (pNode);
+
+}
+
+
+template <typename Key, typename Compare, typename KeyPrefix>
+int TTreeT<Key, Compare, KeyPrefix>::Insert(const Key& key)
+{
+	WriteGuard guard(this);
+
+	return InsertOne(key);
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+int TTreeT<Key, Compare, KeyPrefix>::InsertOne(const Key& key)
+{
+	uint64_t prefix = PrefixOf(key);
+
+	if (m_pRootNode == nullptr)
+	{
+		Node* pRoot = CreateNode();
+		SetKey(pRoot, 0, key, prefix);
+		pRoot->keyNum++;
+		pRoot->count = 1;
+		UpdateBounds(pRoot);
+
+		SetRoot(pRoot);
+		return 0;
+	}
+
+	//不小于最右节点最大key的key直接插到最右节点，递增的key不用从根节点下降
+	Node* pNode = Rightmost();
+
+	int cmpLeft, cmpRight;
+
+	cmpRight = CompareLast(key, prefix, pNode);
+	if (cmpRight >= 0)
+	{
+		return cmpRight > 0 ? InsertBeside(pNode, key, prefix, 1) : InsertIntoNode(pNode, key, prefix);
+	}
+
+	pNode = m_pRootNode;
+
+	while (true)
+	{
+		cmpLeft = CompareFirst(key, prefix, pNode);
+
+		// key < left
+		if (cmpLeft < 0)
+		{
+			if (pNode->left)
+			{
+				pNode = pNode->left;
+				continue;
+			}
+
+			return InsertBeside(pNode, key, prefix, 0);
+		}
+
+		cmpRight = CompareLast(key, prefix, pNode);
+		// key > right
+		if (cmpRight > 0)
+		{
+			if (pNode->right)
+			{
+				pNode = pNode->right;
+				continue;
+			}
+
+			return InsertBeside(pNode, key, prefix, 1);
+		}
+
+		// left <= key <= right , key应当在这个node
+		return InsertIntoNode(pNode, key, prefix);
+	}
+
+	//不会到这里
+	return -1;
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+int TTreeT<Key, Compare, KeyPrefix>::InsertBeside(Node* pNode, const Key& key, uint64_t prefix, int side)
+{
+	//APPEND策略下最右节点达到填充率后在末尾新建节点，留出的空位给迟到的key
+	bool close = side == 1 && m_splitPolicy == TTREE_SPLIT_APPEND && pNode->keyNum >= m_splitKeep && pNode == Rightmost();
+
+	//这个结点还有空间，或者按分裂策略处理溢出
+	if (!close && (pNode->keyNum < m_keySize || m_splitPolicy != TTREE_SPLIT_SHIFT))
+	{
+		return InsertIntoNode(pNode, key, prefix);
+	}
+
+	Node* pNewNode = CreateNode();
+	pNewNode->parent = pNode;
+	SetKey(pNewNode, 0, key, prefix);
+	pNewNode->keyNum++;
+	UpdateBounds(pNewNode);
+
+	LatchNode(pNode);
+	pNode->children[side] = pNewNode;
+	AddCount(pNewNode, 1);
+	Rebalance(pNode);
+
+	return 0;
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+int TTreeT<Key, Compare, KeyPrefix>::InsertHint(const Cursor& hint, const Key& key)
+{
+	WriteGuard guard(this);
+
+	Node* pNode = hint.GetNode();
+	if (pNode == nullptr || m_pRootNode == nullptr)
+	{
+		return InsertOne(key);
+	}
+
+	uint64_t prefix = PrefixOf(key);
+	Node* pNear;
+
+	//落在前驱和后继之间才能插到这个节点，否则从根节点下降
+	if (CompareFirst(key, prefix, pNode) < 0)
+	{
+		pNear = Predecessor(pNode);
+		if (pNear && CompareLast(key, prefix, pNear) <= 0)
+		{
+			return InsertOne(key);
+		}
+
+		return pNode->left ? InsertIntoNode(pNode, key, prefix) : InsertBeside(pNode, key, prefix, 0);
+	}
+
+	if (CompareLast(key, prefix, pNode) > 0)
+	{
+		pNear = Successor(pNode);
+		if (pNear && CompareFirst(key, prefix, pNear) >= 0)
+		{
+			return InsertOne(key);
+		}
+
+		return pNode->right ? InsertIntoNode(pNode, key, prefix) : InsertBeside(pNode, key, prefix, 1);
+	}
+
+	return InsertIntoNode(pNode, key, prefix);
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+TTreeNodeT<Key>* TTreeT<Key, Compare, KeyPrefix>::Rightmost()
+{
+	if (m_pRightmost == nullptr && m_pRootNode)
+	{
+		m_pRightmost = GetRight(m_pRootNode);
+	}
+
+	return m_pRightmost;
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+size_t TTreeT<Key, Compare, KeyPrefix>::InsertBatch(Key* keys, size_t n)
+{
+	WriteGuard guard(this);
+
+	std::sort(keys, keys + n, [this](const Key& a, const Key& b) { return m_keyCmp(a, b) < 0; });
+
+	std::vector<Key> merged;
+	std::vector<uint64_t> prefixes;
+
+	size_t inserted = 0, i = 0;
+
+	while (i < n)
+	{
+		if (m_unique && i > 0 && m_keyCmp(keys[i - 1], keys[i]) == 0)
+		{
+			i++;
+			continue;
+		}
+
+		if (m_pRootNode == nullptr)
+		{
+			inserted += InsertOne(keys[i]) == 0;
+			i++;
+			continue;
+		}
+
+		Node* pNode = FindInsertNode(keys[i], PrefixOf(keys[i]));
+		Node* pNext = Successor(pNode);
+
+		//小于后继节点最小key的都属于这个节点
+		size_t j = i + 1;
+		while (j < n && (pNext == nullptr || m_keyCmp(keys[j], pNext->FirstKey()) < 0))
+		{
+			j++;
+		}
+
+		inserted += MergeIntoNode(pNode, keys + i, j - i, merged, prefixes);
+		i = j;
+
+		//每合并完一个节点树都是完整的，先让读者看到，不必等整批结束
+		UnlatchAll();
+	}
+
+	return inserted;
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+TTreeNodeT<Key>* TTreeT<Key, Compare, KeyPrefix>::FindInsertNode(const Key& key, uint64_t prefix)
+{
+	Node* pNode = m_pRootNode;
+
+	while (true)
+	{
+		if (CompareFirst(key, prefix, pNode) < 0)
+		{
+			if (pNode->left == nullptr)
+			{
+				return pNode;
+			}
+
+			pNode = pNode->left;
+		}
+		else if (CompareLast(key, prefix, pNode) > 0)
+		{
+			if (pNode->right == nullptr)
+			{
+				return pNode;
+			}
+
+			pNode = pNode->right;
+		}
+		else
+		{
+			return pNode;
+		}
+	}
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+size_t TTreeT<Key, Compare, KeyPrefix>::MergeIntoNode(Node* pNode, const Key* keys, size_t n, std::vector<Key>& merged, std::vector<uint64_t>& prefixes)
+{
+	bool slots = (m_prefixMode == TTREE_PREFIX_SLOTS);
+	size_t a = 0, b = 0, inserted = 0;
+
+	merged.clear();
+	prefixes.clear();
+
+	//相等时节点中原有的key在前，与InsertIntoNode一致
+	while (b < n)
+	{
+		if (m_unique && b > 0 && m_keyCmp(keys[b - 1], keys[b]) == 0)
+		{
+			b++;
+			continue;
+		}
+
+		if (a < pNode->keyNum)
+		{
+			int cmp = m_keyCmp(keys[b], pNode->keys[a]);
+			if (cmp == 0 && m_unique)
+			{
+				b++;
+				continue;
+			}
+
+			if (cmp >= 0)
+			{
+				merged.push_back(pNode->keys[a]);
+				if (slots)
+				{
+					prefixes.push_back(pNode->SlotPrefix(m_keySize)[a]);
+				}
+
+				a++;
+				continue;
+			}
+		}
+
+		merged.push_back(keys[b]);
+		if (slots)
+		{
+			prefixes.push_back(m_keyPrefix(keys[b]));
+		}
+
+		b++;
+		inserted++;
+	}
+
+	if (inserted == 0)
+	{
+		return 0;
+	}
+
+	for (; a < pNode->keyNum; a++)
+	{
+		merged.push_back(pNode->keys[a]);
+		if (slots)
+		{
+			prefixes.push_back(pNode->SlotPrefix(m_keySize)[a]);
+		}
+	}
+
+	size_t total = merged.size();
+	size_t pos = total < m_keySize ? total : m_keySize;
+
+	for (size_t k = 0; k < pos; k++)
+	{
+		SetKey(pNode, k, merged[k], slots ? prefixes[k] : 0);
+	}
+	AddCount(pNode, (int)pos - (int)pNode->keyNum);
+	pNode->keyNum = pos;
+	UpdateBounds(pNode);
+
+	if (pos == total)
+	{
+		return inserted;
+	}
+
+	//放不下的部分，后继节点有空间就放进去，否则按节点容量新建节点依次挂在后面
+	size_t rest = total - pos;
+	Node* pNext = Successor(pNode);
+
+	if (pNext && rest <= m_keySize - pNext->keyNum)
+	{
+		MoveKeys(pNext, rest, pNext, 0, pNext->keyNum);
+		for (size_t k = 0; k < rest; k++)
+		{
+			SetKey(pNext, k, merged[pos + k], slots ? prefixes[pos + k] : 0);
+		}
+		pNext->keyNum += rest;
+		AddCount(pNext, rest);
+		UpdateBounds(pNext);
+
+		return inserted;
+	}
+
+	Node* pPrev = pNode;
+	while (pos < total)
+	{
+		size_t num = (total - pos) < m_keySize ? (total - pos) : m_keySize;
+
+		Node* pNewNode = CreateNode();
+		for (size_t k = 0; k < num; k++)
+		{
+			SetKey(pNewNode, k, merged[pos + k], slots ? prefixes[pos + k] : 0);
+		}
+		pNewNode->keyNum = num;
+		UpdateBounds(pNewNode);
+
+		AttachAfter(pPrev, pNewNode);
+		AddCount(pNewNode, num);
+		Rebalance(pNewNode->parent);
+
+		pPrev = pNewNode;
+		pos += num;
+	}
+
+	return inserted;
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+void TTreeT<Key, Compare, KeyPrefix>::AttachAfter(Node* pNode, Node* pNewNode)
+{
+	if (pNode->right == nullptr)
+	{
+		LatchNode(pNode);
+		pNode->right = pNewNode;
+		pNewNode->parent = pNode;
+	}
+	else
+	{
+		Node* pMostLeft = GetLeft(pNode->right);
+		LatchNode(pMostLeft);
+		pMostLeft->left = pNewNode;
+		pNewNode->parent = pMostLeft;
+	}
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+const Key* TTreeT<Key, Compare, KeyPrefix>::Query(const Key& key)
+{
+	if (m_layout == TTREE_LAYOUT_CST)
+	{
+		return Get(key);
+	}
+
+	Node* pNode = m_pRootNode;
+
+	uint64_t prefix = PrefixOf(key);
+	int cmpLeft, cmpRight, index, pos;
+
+	while (pNode)
+	{
+		cmpLeft = CompareFirst(key, prefix, pNode);
+		if(cmpLeft < 0)
+		{
+			pNode = pNode->left;
+			continue;
+		}
+
+		cmpRight = CompareLast(key, prefix, pNode);
+		if(cmpRight > 0)
+		{
+			pNode = pNode->right;
+			continue;
+		}
+
+		index = SearchNode(pNode, key, prefix, &pos);
+
+		if(index >= 0)
+		{
+			return &pNode->keys[index];
+		}
+		else
+		{
+			return nullptr;
+		}
+	}
+
+	return nullptr;
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+void TTreeT<Key, Compare, KeyPrefix>::QueryBatch(const Key* keys, const Key** out, size_t n)
+{
+	Node* nodes[TTREE_BATCH_GROUP];
+	uint64_t prefixes[TTREE_BATCH_GROUP];
+
+	int cmpLeft, index, pos;
+
+	for (size_t base = 0; base < n; base += TTREE_BATCH_GROUP)
+	{
+		size_t num = (n - base) < TTREE_BATCH_GROUP ? (n - base) : TTREE_BATCH_GROUP;
+		size_t active = m_pRootNode ? num : 0;
+
+		for (size_t i = 0; i < num; i++)
+		{
+			nodes[i] = m_pRootNode;
+			prefixes[i] = PrefixOf(keys[base + i]);
+			out[base + i] = nullptr;
+		}
+
+		while (active > 0)
+		{
+			//节点已在上一轮预取，没有前缀时下降要访问最小、最大key指向的内容，先统一预取
+			if (m_prefixMode == TTREE_PREFIX_NONE)
+			{
+				for (size_t i = 0; i < num; i++)
+				{
+					if (nodes[i])
+					{
+						TTreePrefetchKey(nodes[i]->keys[0]);
+						TTreePrefetchKey(nodes[i]->keys[nodes[i]->keyNum - 1]);
+					}
+				}
+			}
+
+			for (size_t i = 0; i < num; i++)
+			{
+				Node* pNode = nodes[i];
+				if (pNode == nullptr)
+				{
+					continue;
+				}
+
+				const Key& key = keys[base + i];
+
+				cmpLeft = CompareFirst(key, prefixes[i], pNode);
+				if (cmpLeft < 0)
+				{
+					pNode = pNode->left;
+				}
+				else if (CompareLast(key, prefixes[i], pNode) > 0)
+				{
+					pNode = pNode->right;
+				}
+				else
+				{
+					index = SearchNode(pNode, key, prefixes[i], &pos);
+					if (index >= 0)
+					{
+						out[base + i] = &pNode->keys[index];
+					}
+
+					pNode = nullptr;
+				}
+
+				nodes[i] = pNode;
+
+				if (pNode)
+				{
+					PrefetchNode(pNode);
+				}
+				else
+				{
+					active--;
+				}
+			}
+		}
+	}
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+inline void TTreeT<Key, Compare, KeyPrefix>::PrefetchNode(Node* pNode)
+{
+	TTREE_PREFETCH(pNode);
+	TTREE_PREFETCH((char*)pNode + TTREE_CACHE_LINE);
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+inline bool TTreeT<Key, Compare, KeyPrefix>::ReadVersion(const std::atomic<uint32_t>& version, uint32_t* pVersion)
+{
+	*pVersion = version.load(std::memory_order_acquire);
+
+	return (*pVersion & 1) == 0;
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+inline bool TTreeT<Key, Compare, KeyPrefix>::Validate(const std::atomic<uint32_t>& version, uint32_t expected)
+{
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	return version.load(std::memory_order_relaxed) == expected;
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+inline bool TTreeT<Key, Compare, KeyPrefix>::Track(ScanTrack* pTrack, Node* pNode)
+{
+	if (pTrack->num >= TTREE_SCAN_TRACK || !ReadVersion(pNode->version, &pTrack->versions[pTrack->num]))
+	{
+		return false;
+	}
+
+	pTrack->nodes[pTrack->num++] = pNode;
+
+	return true;
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+inline int TTreeT<Key, Compare, KeyPrefix>::CompareOptimistic(const Key& key, uint64_t prefix, Node* pNode, uint32_t version, unsigned int i, const TTreeRelaxed<uint64_t>* pBound, bool* pValid)
+{
+	if (m_prefixMode != TTREE_PREFIX_NONE)
+	{
+		//前缀是整数，读到不一致的值只会走错方向，最终由版本校验发现
+		uint64_t slot = pBound ? pBound->Load() :
+			(m_prefixMode == TTREE_PREFIX_SLOTS ? __atomic_load_n(pNode->SlotPrefix(m_keySize) + i, __ATOMIC_RELAXED) : prefix);
+		if (prefix != slot)
+		{
+			return prefix < slot ? -1 : 1;
+		}
+	}
+
+	Key other = pNode->LoadKey(i);
+	if (!Validate(pNode->version, version))
+	{
+		*pValid = false;
+		return 0;
+	}
+
+	return m_keyCmp(key, other);
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+unsigned int TTreeT<Key, Compare, KeyPrefix>::BoundOptimistic(const Key& key, uint64_t prefix, Node* pNode, uint32_t version, unsigned int keyNum, bool upper, bool* pValid)
+{
+	int limit = upper ? 0 : 1;
+	unsigned int lo = 0, hi = keyNum;
+
+	while (lo < hi)
+	{
+		unsigned int mid = (lo + hi) / 2;
+
+		int cmp = CompareOptimistic(key, prefix, pNode, version, mid, nullptr, pValid);
+		if (!*pValid)
+		{
+			return 0;
+		}
+
+		if (cmp >= limit)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+/**
+ * 乐观锁耦合下降：读子节点指针后先读子节点的版本号，再校验当前节点，
+ * 保证走到的子节点在那一刻确实挂在当前节点下；任何一步校验失败都从根节点重来
+*/
+template <typename Key, typename Compare, typename KeyPrefix>
+bool TTreeT<Key, Compare, KeyPrefix>::Find(const Key& key, Key* pOut)
+{
+	TTreeEpochGuard epoch(m_concurrent ? &m_epoch : nullptr);
+
+	uint64_t prefix = PrefixOf(key);
+
+	while (true)
+	{
+		bool valid = true;
+		uint32_t rootVersion, version = 0;
+
+		if (!ReadVersion(m_rootVersion, &rootVersion))
+		{
+			continue;
+		}
+
+		Node* pNode = m_pRootNode.Load();
+		if (pNode && !ReadVersion(pNode->version, &version))
+		{
+			continue;
+		}
+
+		if (!Validate(m_rootVersion, rootVersion))
+		{
+			continue;
+		}
+
+		while (pNode)
+		{
+			unsigned int keyNum = pNode->keyNum.Load();
+			if (!Validate(pNode->version, version) || keyNum == 0)
+			{
+				valid = false;
+				break;
+			}
+
+			int dir;
+			int cmp = CompareOptimistic(key, prefix, pNode, version, 0, &pNode->minPrefix, &valid);
+			if (!valid)
+			{
+				break;
+			}
+
+			if (cmp < 0)
+			{
+				dir = 0;
+			}
+			else
+			{
+				cmp = CompareOptimistic(key, prefix, pNode, version, keyNum - 1, &pNode->maxPrefix, &valid);
+				if (!valid)
+				{
+					break;
+				}
+
+				if (cmp <= 0)
+				{
+					//key落在这个节点内
+					unsigned int pos = BoundOptimistic(key, prefix, pNode, version, keyNum, false, &valid);
+					if (!valid)
+					{
+						break;
+					}
+
+					//pos不会越界：key不大于最大的key
+					if (CompareOptimistic(key, prefix, pNode, version, pos, nullptr, &valid) != 0)
+					{
+						//槽位前缀能直接区分时没有读key，这里补一次校验
+						if (!valid || !Validate(pNode->version, version))
+						{
+							valid = false;
+							break;
+						}
+
+						return false;
+					}
+
+					if (!valid)
+					{
+						break;
+					}
+
+					*pOut = pNode->LoadKey(pos);
+					if (!Validate(pNode->version, version))
+					{
+						valid = false;
+						break;
+					}
+
+					return true;
+				}
+
+				dir = 1;
+			}
+
+			Node* pChild = pNode->children[dir].Load();
+			uint32_t childVersion = 0;
+			if (pChild && !ReadVersion(pChild->version, &childVersion))
+			{
+				valid = false;
+				break;
+			}
+
+			if (!Validate(pNode->version, version))
+			{
+				valid = false;
+				break;
+			}
+
+			pNode = pChild;
+			version = childVersion;
+		}
+
+		if (valid)
+		{
+			return false;
+		}
+	}
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+template <typename Fn>
+size_t TTreeT<Key, Compare, KeyPrefix>::Scan(const Key& lo, const Key& hi, Fn fn)
+{
+	//段与段之间会保留节点指针，整个Scan期间都要登记
+	TTreeEpochGuard epoch(m_concurrent ? &m_epoch : nullptr);
+
+	Key chunk[TTREE_SCAN_CHUNK];
+	ScanPos pos = {nullptr, 0, 0};
+
+	//已输出的最后一个key，以及已输出的与它相等的key的个数，重新定位时跳过
+	Key last = lo;
+	size_t skip = 0, visited = 0;
+
+	while (true)
+	{
+		size_t got;
+		bool end;
+
+		if (!ScanChunk(last, skip, hi, chunk, &got, &end, &pos))
+		{
+			continue;
+		}
+
+		for (size_t i = 0; i < got; i++)
+		{
+			visited++;
+			if (!fn(chunk[i]))
+			{
+				return visited;
+			}
+
+			if (m_keyCmp(chunk[i], last) == 0)
+			{
+				skip++;
+			}
+			else
+			{
+				last = chunk[i];
+				skip = 1;
+			}
+		}
+
+		if (end)
+		{
+			return visited;
+		}
+	}
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+bool TTreeT<Key, Compare, KeyPrefix>::SuccessorOptimistic(Node* pNode, ScanTrack* pTrack, Node** ppNext)
+{
+	Node* pNext = pNode->right.Load();
+
+	if (pNext)
+	{
+		if (!Track(pTrack, pNext))
+		{
+			return false;
+		}
+
+		Node* pChild;
+		while ((pChild = pNext->left.Load()) != nullptr)
+		{
+			if (!Track(pTrack, pChild))
+			{
+				return false;
+			}
+
+			pNext = pChild;
+		}
+
+		*ppNext = pNext;
+		return true;
+	}
+
+	//往上找到第一个从左边上来的祖先
+	Node* pParent = pNode->parent.Load();
+	while (pParent)
+	{
+		if (!Track(pTrack, pParent))
+		{
+			return false;
+		}
+
+		if (pParent->right.Load() != pNode)
+		{
+			break;
+		}
+
+		pNode = pParent;
+		pParent = pNode->parent.Load();
+	}
+
+	*ppNext = pParent;
+	return true;
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+bool TTreeT<Key, Compare, KeyPrefix>::ScanChunk(const Key& from, size_t skip, const Key& hi, Key* out, size_t* pGot, bool* pEnd, ScanPos* pPos)
+{
+	ScanTrack track;
+	track.num = 0;
+
+	bool valid = true;
+	Node* pNode = nullptr;
+	unsigned int index = 0, keyNum;
+
+	*pGot = 0;
+	*pEnd = false;
+
+	ScanPos resume = *pPos;
+	pPos->pNode = nullptr;
+
+	if (resume.pNode && Validate(resume.pNode->version, resume.version))
+	{
+		//上一段停下的节点没有变化，直接接着往后走
+		pNode = resume.pNode;
+		index = resume.index;
+		track.nodes[track.num] = pNode;
+		track.versions[track.num++] = resume.version;
+		skip = 0;
+	}
+	else
+	{
+		//与Bound相同，找中序第一个 LastKey >= from 的节点，经过的节点都要校验
+		uint64_t prefix = PrefixOf(from);
+		uint32_t rootVersion, targetVersion = 0;
+
+		if (!ReadVersion(m_rootVersion, &rootVersion))
+		{
+			return false;
+		}
+
+		Node* pCur = m_pRootNode.Load();
+		if ((pCur && !Track(&track, pCur)) || !Validate(m_rootVersion, rootVersion))
+		{
+			return false;
+		}
+
+		while (pCur)
+		{
+			uint32_t curVersion = track.versions[track.num - 1];
+
+			keyNum = pCur->keyNum.Load();
+			if (!Validate(pCur->version, curVersion) || keyNum == 0)
+			{
+				return false;
+			}
+
+			int cmp = CompareOptimistic(from, prefix, pCur, curVersion, keyNum - 1, &pCur->maxPrefix, &valid);
+			if (!valid)
+			{
+				return false;
+			}
+
+			Node* pChild;
+			if (cmp > 0)
+			{
+				pChild = pCur->right.Load();
+			}
+			else
+			{
+				pNode = pCur;
+				targetVersion = curVersion;
+				pChild = pCur->left.Load();
+			}
+
+			if ((pChild && !Track(&track, pChild)) || !Validate(pCur->version, curVersion))
+			{
+				return false;
+			}
+
+			pCur = pChild;
+		}
+
+		if (pNode)
+		{
+			index = BoundOptimistic(from, prefix, pNode, targetVersion, pNode->keyNum.Load(), false, &valid);
+			if (!valid)
+			{
+				return false;
+			}
+
+			track.nodes[track.num] = pNode;
+			track.versions[track.num++] = targetVersion;
+		}
+	}
+
+	//定位到的节点总是最后记录的
+	uint32_t version = pNode ? track.versions[track.num - 1] : 0;
+
+	while (pNode && *pGot < TTREE_SCAN_CHUNK)
+	{
+		keyNum = pNode->keyNum.Load();
+		if (!Validate(pNode->version, version))
+		{
+			return false;
+		}
+
+		if (index >= keyNum)
+		{
+			size_t tracked = track.num;
+			Node* pNext;
+
+			//记录满了或者后继正在被修改，这一段先结束，下一段从这里继续
+			if (!SuccessorOptimistic(pNode, &track, &pNext))
+			{
+				track.num = tracked;
+				break;
+			}
+
+			//SuccessorOptimistic最后记录的就是后继节点
+			pNode = pNext;
+			index = 0;
+			version = pNode ? track.versions[track.num - 1] : 0;
+			continue;
+		}
+
+		Key key = pNode->LoadKey(index);
+		if (!Validate(pNode->version, version))
+		{
+			return false;
+		}
+
+		if (skip > 0 && m_keyCmp(key, from) == 0)
+		{
+			skip--;
+			index++;
+			continue;
+		}
+		skip = 0;
+
+		if (m_keyCmp(key, hi) > 0)
+		{
+			pNode = nullptr;
+			break;
+		}
+
+		out[(*pGot)++] = key;
+		index++;
+	}
+
+	for (size_t i = 0; i < track.num; i++)
+	{
+		if (!Validate(track.nodes[i]->version, track.versions[i]))
+		{
+			return false;
+		}
+	}
+
+	if (pNode == nullptr)
+	{
+		*pEnd = true;
+		return true;
+	}
+
+	pPos->pNode = pNode;
+	pPos->index = index;
+	pPos->version = version;
+
+	return true;
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+TTreeNodeT<Key>* TTreeT<Key, Compare, KeyPrefix>::Bound(const Key& key, bool upper, unsigned int* pIndex)
+{
+	Node* pNode = m_pRootNode;
+	Node* pTarget = nullptr;
+
+	uint64_t prefix = PrefixOf(key);
+	int cmp;
+
+	//中序遍历时节点的key整体有序，只需要和LastKey比较
+	while (pNode)
+	{
+		cmp = CompareLast(key, prefix, pNode);
+		if (cmp > 0 || (upper && cmp == 0))
+		{
+			pNode = pNode->right;
+		}
+		else
+		{
+			pTarget = pNode;
+			pNode = pNode->left;
+		}
+	}
+
+	if (pTarget)
+	{
+		*pIndex = SearchBound(pTarget, key, prefix, upper);
+	}
+
+	return pTarget;
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+int TTreeT<Key, Compare, KeyPrefix>::BulkLoad(const Key* sortedKeys, size_t n, double fillFactor)
+{
+	WriteGuard guard(this);
+
+	if (m_pRootNode)
+	{
+		return -1;
+	}
+
+	for (size_t i = 1; i < n; i++)
+	{
+		int cmp = m_keyCmp(sortedKeys[i - 1], sortedKeys[i]);
+		if (cmp > 0 || (m_unique && cmp == 0))
+		{
+			return -1;
+		}
+	}
+
+	if (n == 0)
+	{
+		return 0;
+	}
+
+	unsigned int perNode = (unsigned int)(m_keySize * fillFactor + 0.5);
+	if (perNode < 1)
+	{
+		perNode = 1;
+	}
+	else if (perNode > m_keySize)
+	{
+		perNode = m_keySize;
+	}
+
+	size_t nodeNum = (n + perNode - 1) / perNode;
+
+	SetRoot(BuildBalanced(sortedKeys, n, nodeNum, 0, nodeNum, nullptr));
+
+	return 0;
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+TTreeNodeT<Key>* TTreeT<Key, Compare, KeyPrefix>::BuildBalanced(const Key* keys, size_t n, size_t nodeNum, size_t lo, size_t hi, Node* pParent)
+{
+	if (lo >= hi)
+	{
+		return nullptr;
+	}
+
+	size_t mid = (lo + hi) / 2;
+	size_t begin = mid * n / nodeNum, end = (mid + 1) * n / nodeNum;
+
+	Node* pNode = CreateNode();
+	pNode->parent = pParent;
+
+	for (size_t i = begin; i < end; i++)
+	{
+		SetKey(pNode, i - begin, keys[i], m_prefixMode == TTREE_PREFIX_SLOTS ? m_keyPrefix(keys[i]) : 0);
+	}
+	pNode->keyNum = end - begin;
+	UpdateBounds(pNode);
+
+	//两边节点数最多差1，子树高度最多差1
+	pNode->left = BuildBalanced(keys, n, nodeNum, lo, mid, pNode);
+	pNode->right = BuildBalanced(keys, n, nodeNum, mid + 1, hi, pNode);
+	pNode->Reheight();
+	pNode->Recount();
+
+	return pNode;
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+TTreeCursorT<Key, Compare> TTreeT<Key, Compare, KeyPrefix>::LowerBound(const Key& key)
+{
+	unsigned int index = 0;
+	Node* pNode = Bound(key, false, &index);
+
+	return Cursor(pNode, index, &m_keyCmp, nullptr);
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+TTreeCursorT<Key, Compare> TTreeT<Key, Compare, KeyPrefix>::UpperBound(const Key& key)
+{
+	unsigned int index = 0;
+	Node* pNode = Bound(key, true, &index);
+
+	return Cursor(pNode, index, &m_keyCmp, nullptr);
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+TTreeCursorT<Key, Compare> TTreeT<Key, Compare, KeyPrefix>::Range(const Key& lo, const Key& hi)
+{
+	unsigned int index = 0;
+	Node* pNode = Bound(lo, false, &index);
+
+	return Cursor(pNode, index, &m_keyCmp, &hi);
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+TTreeCursorT<Key, Compare> TTreeT<Key, Compare, KeyPrefix>::Begin()
+{
+	return Cursor(m_pRootNode ? GetLeft(m_pRootNode) : nullptr, 0, &m_keyCmp, nullptr);
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+int TTreeT<Key, Compare, KeyPrefix>::Delete(const Key& key)
+{
+	WriteGuard guard(this);
+
+	Node* pNode = m_pRootNode;
+
+	uint64_t prefix = PrefixOf(key);
+	int index = -1, pos;
+
+	while (pNode)
+	{
+		if (CompareFirst(key, prefix, pNode) < 0)
+		{
+			pNode = pNode->left;
+			continue;
+		}
+
+		if (CompareLast(key, prefix, pNode) > 0)
+		{
+			pNode = pNode->right;
+			continue;
+		}
+
+		index = SearchNode(pNode, key, prefix, &pos);
+		break;
+	}
+
+	if (index < 0)
+	{
+		return -1;
+	}
+
+	//非唯一索引，相等的key可能有多个且跨节点，优先删除完全相同的那个
+	if (!m_unique && !(pNode->keys[index] == key))
+	{
+		LocateExact(&pNode, &index, key);
+	}
+
+	RemoveFromNode(pNode, index);
+
+	return 0;
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+bool TTreeT<Key, Compare, KeyPrefix>::LocateExact(Node** ppNode, int* pIndex, const Key& key)
+{
+	Node* pNode = *ppNode;
+	int i = *pIndex;
+
+	//往前找，直到遇到不相等的key
+	while (pNode)
+	{
+		for (; i >= 0; i--)
+		{
+			if (pNode->keys[i] == key)
+			{
+				*ppNode = pNode;
+				*pIndex = i;
+				return true;
+			}
+
+			if (m_keyCmp(key, pNode->keys[i]) != 0)
+			{
+				break;
+			}
+		}
+
+		if (i >= 0)
+		{
+			break;
+		}
+
+		pNode = Predecessor(pNode);
+		i = pNode ? pNode->keyNum - 1 : 0;
+	}
+
+	//往后找
+	pNode = *ppNode;
+	i = *pIndex + 1;
+
+	while (pNode)
+	{
+		for (; i < (int)pNode->keyNum; i++)
+		{
+			if (pNode->keys[i] == key)
+			{
+				*ppNode = pNode;
+				*pIndex = i;
+				return true;
+			}
+
+			if (m_keyCmp(key, pNode->keys[i]) != 0)
+			{
+				return false;
+			}
+		}
+
+		pNode = Successor(pNode);
+		i = 0;
+	}
+
+	return false;
+}
+
+/**
+ * 删除后的下溢处理：
+ * 内部节点少于m_minKeys时，从左子树最右边的节点(greatest lower bound)借一个key，
+ * 被借的节点必然是叶子或半叶子，转化为对它的处理；
+ * 叶子为空则直接释放；
+ * 半叶子能容纳下子节点(必然是叶子)的key时，合并后释放子节点。
+*/
+template <typename Key, typename Compare, typename KeyPrefix>
+void TTreeT<Key, Compare, KeyPrefix>::RemoveFromNode(Node* pNode, int index)
+{
+	MoveKeys(pNode, index, pNode, index + 1, pNode->keyNum - index - 1);
+	pNode->keyNum--;
+	AddCount(pNode, -1);
+
+	//内部节点
+	if (pNode->left && pNode->right)
+	{
+		if (pNode->keyNum >= m_minKeys)
+		{
+			UpdateBounds(pNode);
+			return;
+		}
+
+		Node* pGlb = GetRight(pNode->left);
+
+		MoveKeys(pNode, 1, pNode, 0, pNode->keyNum);
+		MoveKeys(pNode, 0, pGlb, pGlb->keyNum - 1, 1);
+		pNode->keyNum++;
+		UpdateBounds(pNode);
+
+		LatchNode(pGlb);
+		pGlb->keyNum--;
+
+		//pGlb在pNode的左子树中，pNode及以上已经减过
+		for (Node* pCur = pGlb; pCur != pNode; pCur = pCur->parent)
+		{
+			pCur->count--;
+		}
+
+		pNode = pGlb;
+	}
+
+	//叶子
+	if (pNode->left == nullptr && pNode->right == nullptr)
+	{
+		if (pNode->keyNum > 0)
+		{
+			UpdateBounds(pNode);
+			return;
+		}
+
+		Node* pParent = pNode->parent;
+		if (pParent == nullptr)
+		{
+			SetRoot(nullptr);
+		}
+		else if (pParent->left == pNode)
+		{
+			LatchNode(pParent);
+			pParent->left = nullptr;
+		}
+		else
+		{
+			LatchNode(pParent);
+			pParent->right = nullptr;
+		}
+
+		ReleaseNode(pNode);
+
+		if (pParent)
+		{
+			Rebalance(pParent);
+		}
+
+		return;
+	}
+
+	//半叶子
+	Node* pChild = pNode->left ? pNode->left : pNode->right;
+	if (pNode->keyNum + pChild->keyNum > m_keySize)
+	{
+		UpdateBounds(pNode);
+		return;
+	}
+
+	if (pChild == pNode->left)
+	{
+		MoveKeys(pNode, pChild->keyNum, pNode, 0, pNode->keyNum);
+		MoveKeys(pNode, 0, pChild, 0, pChild->keyNum);
+	}
+	else
+	{
+		MoveKeys(pNode, pNode->keyNum, pChild, 0, pChild->keyNum);
+	}
+
+	pNode->keyNum += pChild->keyNum;
+	pNode->left = pNode->right = nullptr;
+	UpdateBounds(pNode);
+
+	ReleaseNode(pChild);
+
+	Rebalance(pNode);
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+unsigned int TTreeT<Key, Compare, KeyPrefix>::Count()
+{
+	return TTREE_COUNT_OF(m_pRootNode);
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+inline void TTreeT<Key, Compare, KeyPrefix>::AddCount(Node* pNode, int delta)
+{
+	for (; pNode; pNode = pNode->parent)
+	{
+		pNode->count += delta;
+	}
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+unsigned int TTreeT<Key, Compare, KeyPrefix>::RankOf(const Key& key, bool upper)
+{
+	Node* pNode = m_pRootNode;
+	Node* pTarget = nullptr;
+
+	uint64_t prefix = PrefixOf(key);
+	unsigned int rank = 0, targetRank = 0;
+	int cmp;
+
+	//与Bound相同的下降路径，往右走时左子树和本节点的key都排在前面
+	while (pNode)
+	{
+		cmp = CompareLast(key, prefix, pNode);
+		if (cmp > 0 || (upper && cmp == 0))
+		{
+			rank += TTREE_COUNT_OF(pNode->left) + pNode->keyNum;
+			pNode = pNode->right;
+		}
+		else
+		{
+			pTarget = pNode;
+			targetRank = rank + TTREE_COUNT_OF(pNode->left);
+			pNode = pNode->left;
+		}
+	}
+
+	if (pTarget == nullptr)
+	{
+		return rank;
+	}
+
+	return targetRank + SearchBound(pTarget, key, prefix, upper);
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+unsigned int TTreeT<Key, Compare, KeyPrefix>::Rank(const Key& key)
+{
+	return RankOf(key, false);
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+TTreeCursorT<Key, Compare> TTreeT<Key, Compare, KeyPrefix>::Select(unsigned int i)
+{
+	Node* pNode = m_pRootNode;
+
+	while (pNode)
+	{
+		unsigned int leftCount = TTREE_COUNT_OF(pNode->left);
+
+		if (i < leftCount)
+		{
+			pNode = pNode->left;
+		}
+		else if (i < leftCount + pNode->keyNum)
+		{
+			return Cursor(pNode, i - leftCount, &m_keyCmp, nullptr);
+		}
+		else
+		{
+			i -= leftCount + pNode->keyNum;
+			pNode = pNode->right;
+		}
+	}
+
+	return Cursor(nullptr, 0, &m_keyCmp, nullptr);
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+unsigned int TTreeT<Key, Compare, KeyPrefix>::CountRange(const Key& lo, const Key& hi)
+{
+	unsigned int begin = RankOf(lo, false);
+	unsigned int end = RankOf(hi, true);
+
+	return end > begin ? end - begin : 0;
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+unsigned int TTreeT<Key, Compare, KeyPrefix>::Count(Node* pNode)
+{
+	unsigned int count = 0;
+
+	PostOrder(pNode, [&count](Node* pCur) { count += pCur->keyNum; });
+
+	return count;
+}
+/** 左旋，右子树的树高转移到左子树，
+ *
+ *			pParent
+ * 				pNode
+ * 		pLeft		pRight
+ *
+*/
+
+template <typename Key, typename Compare, typename KeyPrefix>
+TTreeNodeT<Key>* TTreeT<Key, Compare, KeyPrefix>::LeftRotate(Node* pNode)
+{
+	Node* pParent = pNode->parent;		//parent 肯定存在
+	Node* pLeft = pNode->left;
+
+	//祖父的子节点指针、三个节点的父子指针都会变
+	if (pParent->parent)
+	{
+		LatchNode(pParent->parent);
+	}
+	LatchNode(pParent);
+	LatchNode(pNode);
+	if (pLeft)
+	{
+		LatchNode(pLeft);
+	}
+
+	//如果存在祖父节点，祖父的孙子(即pNode)变成儿子
+	if (pParent->parent)
+	{
+		if (pParent == pParent->parent->left)
+		{
+			pParent->parent->left = pNode;
+		}
+		else
+		{
+			pParent->parent->right = pNode;
+		}
+	}
+
+	pNode->parent = pParent->parent;
+	pNode->left = pParent;
+	if(pLeft)
+	{
+		pLeft->parent = pParent;
+	}
+
+
+	pParent->parent = pNode;
+	pParent->right = pLeft;
+
+	//pParent和pNode的父子关系互换了，需要子节点先reheight
+	pParent->Reheight();
+	pNode->Reheight();
+	pParent->Recount();
+	pNode->Recount();
+
+	return pNode;
+}
+
+template <typename Key, typename Compare, typename KeyPrefix>
+TTreeNodeT<Key>* TTreeT<Key, Compare, KeyPrefix>::RightRotate(Node* pNode)
+{
+	Node* pParent = pNode->parent;
+	Node* pRight = pNode->right;
+
+	if (pParent->parent)
+	{
+		LatchNode(pParent->parent);
+	}
+	LatchNode(pParent);
+	LatchNode(pNode);
+	if (pRight)
+	{
+		LatchNode(pRight);
+	}
+
+	if (pParent->parent)
+	{
+		if (pParent == pParent->parent->left)
+		{
+			pParent->parent->left = pNode;
+		}
+		else
+		{
+			pParent->parent->right = pNode;
+		}
+	}
+
+	pNode->parent = pParent->parent;
+	pNode->right = pParent;
+	if (pRight)
+	{
+		pRight->parent = pParent;
+	}
+
+	pParent->parent = pNode;
+	pParent->left = pRight;
+
+	pParent->Reheight();
+	pNode->Reheight();
+	pParent->Recount();
+	pNode->Recount();
+
+	return pNode;
+}
+
+#endif
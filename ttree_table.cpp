@@ -0,0 +1,409 @@
+/**
+ * @brief	多索引表，二级索引并行维护
+ * @author	huangxx
+*/
+
+#include "ttree_table.h"
+
+#include <algorithm>
+
+
+TTreeTable::TTreeTable(fnKeyComparator pkFn, unsigned int keySize, unsigned int workerNum)
+	: m_primary(pkFn, true, keySize)
+{
+	m_keySize = keySize;
+
+	m_jobType = JOB_INSERT;
+	m_pJobRecords = nullptr;
+	m_jobNum = 0;
+
+	m_jobSeq.store(0);
+	m_pending.store(0);
+	m_stop = false;
+	m_spin = std::thread::hardware_concurrency() > 1 ? TTREE_TABLE_SPIN : 0;
+
+	for (unsigned int i = 0; i < workerNum; i++)
+	{
+		m_workers.emplace_back(&TTreeTable::WorkerLoop, this, i);
+	}
+}
+
+TTreeTable::~TTreeTable()
+{
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_stop = true;
+		m_jobSeq++;
+	}
+	m_cvJob.notify_all();
+
+	for (std::thread& worker : m_workers)
+	{
+		worker.join();
+	}
+
+	for (TTree* pTree : m_indexes)
+	{
+		delete pTree;
+	}
+}
+
+int TTreeTable::AddIndex(fnKeyComparator fn, bool unique)
+{
+	if (m_primary.m_pRootNode)
+	{
+		return -1;
+	}
+
+	m_indexes.push_back(new TTree(fn, unique, m_keySize));
+	m_failed.resize(m_indexes.size());
+
+	return (int)m_indexes.size() - 1;
+}
+
+int TTreeTable::Insert(void* pRecord)
+{
+	int rc;
+	InsertBatch(&pRecord, 1, &rc);
+
+	return rc;
+}
+
+size_t TTreeTable::InsertBatch(void** pRecords, size_t n, int* results)
+{
+	for (std::vector<size_t>& failed : m_failed)
+	{
+		failed.clear();
+	}
+
+	m_primaryOk.assign(n, 0);
+
+	//二级索引与主键同时进行
+	Post(JOB_INSERT, pRecords, n);
+
+	for (size_t k = 0; k < n; k++)
+	{
+		m_primaryOk[k] = m_primary.Insert(pRecords[k]) == 0;
+	}
+
+	Wait();
+
+	size_t inserted = 0;
+	for (size_t k = 0; k < n; k++)
+	{
+		bool ok = m_primaryOk[k];
+		for (size_t i = 0; ok && i < m_failed.size(); i++)
+		{
+			ok = !std::binary_search(m_failed[i].begin(), m_failed[i].end(), k);
+		}
+
+		if (ok)
+		{
+			inserted++;
+		}
+		else
+		{
+			Rollback(pRecords, k, m_primaryOk[k]);
+		}
+
+		if (results)
+		{
+			results[k] = ok ? 0 : -1;
+		}
+	}
+
+	return inserted;
+}
+
+void TTreeTable::Rollback(void** pRecords, size_t k, bool primaryDone)
+{
+	if (primaryDone)
+	{
+		m_primary.Delete(pRecords[k]);
+	}
+
+	//非唯一索引中Delete优先删除指针相同的那条
+	for (size_t i = 0; i < m_indexes.size(); i++)
+	{
+		if (!std::binary_search(m_failed[i].begin(), m_failed[i].end(), k))
+		{
+			m_indexes[i]->Delete(pRecords[k]);
+		}
+	}
+}
+
+/**
+ * 稳定的并行归并排序：分成threadNum段各自stable_sort，再逐层两两归并，
+ * 每层的归并也并行进行
+*/
+static void ParallelSort(void** keys, size_t n, fnKeyComparator fn, unsigned int threadNum)
+{
+	auto less = [fn](const void* a, const void* b) { return fn(a, b) < 0; };
+
+	if (threadNum <= 1 || n < TTREE_PARALLEL_SORT_MIN)
+	{
+		std::stable_sort(keys, keys + n, less);
+		return;
+	}
+
+	std::vector<size_t> bounds(threadNum + 1);
+	for (unsigned int i = 0; i <= threadNum; i++)
+	{
+		bounds[i] = n * i / threadNum;
+	}
+
+	std::vector<std::thread> threads;
+	for (unsigned int i = 0; i < threadNum; i++)
+	{
+		threads.emplace_back([=]() { std::stable_sort(keys + bounds[i], keys + bounds[i + 1], less); });
+	}
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	std::vector<void*> buffer(n);
+	void** pSrc = keys;
+	void** pDst = buffer.data();
+
+	for (unsigned int width = 1; width < threadNum; width *= 2)
+	{
+		threads.clear();
+
+		for (unsigned int i = 0; i < threadNum; i += width * 2)
+		{
+			size_t lo = bounds[i];
+			size_t mid = bounds[std::min(i + width, threadNum)];
+			size_t hi = bounds[std::min(i + width * 2, threadNum)];
+
+			//相等时取前一段的，保持稳定
+			threads.emplace_back([=]() { std::merge(pSrc + lo, pSrc + mid, pSrc + mid, pSrc + hi, pDst + lo, less); });
+		}
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+
+		std::swap(pSrc, pDst);
+	}
+
+	if (pSrc != keys)
+	{
+		std::copy(pSrc, pSrc + n, keys);
+	}
+}
+
+int TTreeTable::Load(void** pRecords, size_t n, double fillFactor, unsigned int threadNum)
+{
+	if (m_primary.m_pRootNode)
+	{
+		return -1;
+	}
+
+	if (threadNum == 0)
+	{
+		threadNum = std::max(std::thread::hardware_concurrency(), 1u);
+	}
+
+	std::vector<TTree*> trees(1, &m_primary);
+	trees.insert(trees.end(), m_indexes.begin(), m_indexes.end());
+
+	//索引个数多于线程数时每个索引单线程排序，否则把多出来的线程分给各个索引的排序
+	unsigned int builders = std::min<size_t>(threadNum, trees.size());
+	unsigned int sortThreads = std::max<unsigned int>(threadNum / trees.size(), 1);
+
+	std::vector<int> results(trees.size(), 0);
+	std::atomic<size_t> next(0);
+
+	auto build = [&]()
+	{
+		std::vector<void*> keys;
+
+		for (size_t t = next++; t < trees.size(); t = next++)
+		{
+			keys.assign(pRecords, pRecords + n);
+			ParallelSort(keys.data(), n, trees[t]->m_keyCmp.fn, sortThreads);
+
+			results[t] = trees[t]->BulkLoad(keys.data(), n, fillFactor);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (unsigned int i = 1; i < builders; i++)
+	{
+		threads.emplace_back(build);
+	}
+	build();
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	for (int rc : results)
+	{
+		if (rc != 0)
+		{
+			Clear();
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int TTreeTable::Delete(void* pRecord)
+{
+	void* pStored = m_primary.Get(pRecord);
+	if (pStored == nullptr)
+	{
+		return -1;
+	}
+
+	Post(JOB_DELETE, &pStored, 1);
+
+	m_primary.Delete(pStored);
+
+	Wait();
+
+	return 0;
+}
+
+void* TTreeTable::Get(const void* pKey)
+{
+	return m_primary.Get(pKey);
+}
+
+TTree* TTreeTable::Primary()
+{
+	return &m_primary;
+}
+
+TTree* TTreeTable::Index(unsigned int i)
+{
+	return i < m_indexes.size() ? m_indexes[i] : nullptr;
+}
+
+unsigned int TTreeTable::IndexCount()
+{
+	return m_indexes.size();
+}
+
+unsigned int TTreeTable::Count()
+{
+	return m_primary.Count();
+}
+
+void TTreeTable::Clear()
+{
+	m_primary.Clear();
+
+	for (TTree* pTree : m_indexes)
+	{
+		pTree->Clear();
+	}
+}
+
+void TTreeTable::RunIndex(unsigned int i)
+{
+	TTree* pTree = m_indexes[i];
+
+	for (size_t k = 0; k < m_jobNum; k++)
+	{
+		if (m_jobType == JOB_DELETE)
+		{
+			pTree->Delete(m_pJobRecords[k]);
+		}
+		else if (pTree->Insert(m_pJobRecords[k]) != 0)
+		{
+			m_failed[i].push_back(k);
+		}
+	}
+}
+
+void TTreeTable::RunWorker(unsigned int worker)
+{
+	for (size_t i = worker; i < m_indexes.size(); i += m_workers.size())
+	{
+		RunIndex(i);
+	}
+}
+
+void TTreeTable::WorkerLoop(unsigned int worker)
+{
+	uint64_t seen = 0;
+
+	while (true)
+	{
+		uint64_t seq = m_jobSeq.load(std::memory_order_acquire);
+		for (int spin = 0; seq == seen && spin < m_spin; spin++)
+		{
+			seq = m_jobSeq.load(std::memory_order_acquire);
+		}
+
+		if (seq == seen)
+		{
+			std::unique_lock<std::mutex> lock(m_lock);
+			m_cvJob.wait(lock, [&]() { return m_jobSeq.load() != seen; });
+			seq = m_jobSeq.load();
+		}
+
+		seen = seq;
+		if (m_stop)
+		{
+			return;
+		}
+
+		RunWorker(worker);
+
+		if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			m_cvDone.notify_one();
+		}
+	}
+}
+
+void TTreeTable::Post(JobType type, void** pRecords, size_t n)
+{
+	m_jobType = type;
+	m_pJobRecords = pRecords;
+	m_jobNum = n;
+
+	if (m_workers.empty() || m_indexes.empty())
+	{
+		return;
+	}
+
+	m_pending.store(m_workers.size(), std::memory_order_relaxed);
+
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_jobSeq.fetch_add(1, std::memory_order_release);
+	}
+	m_cvJob.notify_all();
+}
+
+void TTreeTable::Wait()
+{
+	if (m_workers.empty() || m_indexes.empty())
+	{
+		for (size_t i = 0; i < m_indexes.size(); i++)
+		{
+			RunIndex(i);
+		}
+
+		return;
+	}
+
+	for (int spin = 0; spin < m_spin; spin++)
+	{
+		if (m_pending.load(std::memory_order_acquire) == 0)
+		{
+			return;
+		}
+	}
+
+	std::unique_lock<std::mutex> lock(m_lock);
+	m_cvDone.wait(lock, [&]() { return m_pending.load(std::memory_order_acquire) == 0; });
+}
@@ -0,0 +1,142 @@
+/**
+ * @brief	多索引表，二级索引并行维护
+ * @author	huangxx
+*/
+
+#ifndef __TTREE_TABLE_H__
+#define __TTREE_TABLE_H__
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+#include "ttree.h"
+
+
+//工作线程、调用方等待时先自旋的次数，逐行插入时避免每次都经过条件变量
+#define TTREE_TABLE_SPIN 4096
+
+//少于这么多个key时不再分段并行排序
+#define TTREE_PARALLEL_SORT_MIN 16384
+
+
+/**
+ * 一张表的全部索引：一个唯一的主键索引加N个二级索引，key都是记录指针。
+ * 主键索引由调用线程修改，同时二级索引按编号分给工作线程并行修改，
+ * 每个索引只由一个线程修改，索引之间不需要加锁。
+ * 主键或唯一二级索引拒绝插入时，撤销这条记录在其他索引上已经完成的插入。
+ * 同一时间只能有一个线程调用修改接口
+*/
+class TTreeTable
+{
+public:
+	/**
+	 * workerNum为0时在调用线程中依次修改所有索引
+	*/
+	TTreeTable(fnKeyComparator pkFn, unsigned int keySize, unsigned int workerNum = 0);
+
+	~TTreeTable();
+
+	TTreeTable(const TTreeTable&) = delete;
+
+	TTreeTable& operator=(const TTreeTable&) = delete;
+
+	/**
+	 * 增加一个二级索引，返回索引编号；表不为空时返回-1
+	*/
+	int AddIndex(fnKeyComparator fn, bool unique);
+
+	/**
+	 * 插入一条记录，任意一个唯一索引上重复时不插入并返回-1
+	*/
+	int Insert(void* pRecord);
+
+	/**
+	 * 批量插入，主键与二级索引流水线式并行；results不为空时返回每条记录的结果，
+	 * 返回成功插入的数量。
+	 * 二级索引不等主键的结果，批内主键重复的记录在唯一二级索引上可能挤掉批内后面的记录
+	*/
+	size_t InsertBatch(void** pRecords, size_t n, int* results = nullptr);
+
+	/**
+	 * 从无序的记录数组构建所有索引：每个索引各自用多线程归并排序后BulkLoad，
+	 * 各个索引同时构建。threadNum为0时使用全部CPU。
+	 * 只能在表为空时调用，唯一索引上有重复时表保持为空并返回-1
+	*/
+	int Load(void** pRecords, size_t n, double fillFactor, unsigned int threadNum = 0);
+
+	/**
+	 * 按主键删除，二级索引中删除的是主键索引里存放的那条记录；找不到返回-1
+	*/
+	int Delete(void* pRecord);
+
+	//按主键查找记录
+	void* Get(const void* pKey);
+
+	TTree* Primary();
+
+	TTree* Index(unsigned int i);
+
+	unsigned int IndexCount();
+
+	unsigned int Count();
+
+	void Clear();
+
+//private:
+public:
+	enum JobType
+	{
+		JOB_INSERT,
+		JOB_DELETE,
+	};
+
+	/**
+	 * 在第i个二级索引上执行当前任务，插入失败的记录位置记入m_failed[i]
+	*/
+	void RunIndex(unsigned int i);
+
+	//第worker个工作线程负责编号为 worker, worker + workerNum, ... 的索引
+	void RunWorker(unsigned int worker);
+
+	void WorkerLoop(unsigned int worker);
+
+	//把任务交给工作线程，workerNum为0时什么都不做
+	void Post(JobType type, void** pRecords, size_t n);
+
+	//等待工作线程完成任务，workerNum为0时在调用线程中执行
+	void Wait();
+
+	//撤销第k条记录在主键(primaryDone)及未失败的二级索引上的插入
+	void Rollback(void** pRecords, size_t k, bool primaryDone);
+
+//private:
+public:
+	TTree				m_primary;
+	std::vector<TTree*>	m_indexes;
+	unsigned int		m_keySize;
+
+	//每个二级索引在当前任务中插入失败的记录位置
+	std::vector<std::vector<size_t> >	m_failed;
+
+	std::vector<char>	m_primaryOk;	//InsertBatch中每条记录主键是否插入成功
+
+	//当前任务，由m_jobSeq发布
+	JobType				m_jobType;
+	void**				m_pJobRecords;
+	size_t				m_jobNum;
+
+	std::vector<std::thread>	m_workers;
+	std::mutex					m_lock;
+	std::condition_variable		m_cvJob;
+	std::condition_variable		m_cvDone;
+	std::atomic<uint64_t>		m_jobSeq;	//每发布一个任务加1
+	std::atomic<unsigned int>	m_pending;	//还没有完成当前任务的工作线程数
+	bool						m_stop;
+	int							m_spin;		//单核时自旋没有意义，为0
+};
+
+#endif
@@ -0,0 +1,652 @@
+/**
+ * @brief	多索引表的预写日志与崩溃恢复
+ * @author	huangxx
+*/
+
+#include "ttree_wal.h"
+
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <chrono>
+
+
+static bool ReadFull(int fd, void* pBuf, size_t n, off_t offset)
+{
+	char* p = (char*)pBuf;
+
+	while (n > 0)
+	{
+		ssize_t got = pread(fd, p, n, offset);
+		if (got < 0 && errno == EINTR)
+		{
+			continue;
+		}
+
+		if (got <= 0)
+		{
+			return false;
+		}
+
+		p += got;
+		n -= got;
+		offset += got;
+	}
+
+	return true;
+}
+
+static bool WriteFull(int fd, const void* pBuf, size_t n)
+{
+	const char* p = (const char*)pBuf;
+
+	while (n > 0)
+	{
+		ssize_t written = write(fd, p, n);
+		if (written < 0 && errno == EINTR)
+		{
+			continue;
+		}
+
+		if (written <= 0)
+		{
+			return false;
+		}
+
+		p += written;
+		n -= written;
+	}
+
+	return true;
+}
+
+
+TTreeWal::TTreeWal(TTreeTable* pTable, unsigned int recordSize)
+{
+	m_pTable = pTable;
+	m_recordSize = recordSize;
+
+	m_fd = -1;
+	m_lsn = 0;
+
+	m_bufferLsn = 0;
+	m_durableLsn = 0;
+	m_syncWaiters = 0;
+	m_stop = false;
+	m_error = false;
+
+	m_pCurBlock = nullptr;
+	m_blockUsed = TTREE_WAL_BLOCK;
+}
+
+TTreeWal::~TTreeWal()
+{
+	Close();
+}
+
+int TTreeWal::Open(const char* logPath, const char* checkpointPath)
+{
+	Close();
+
+	if (m_pTable->Count() != 0)
+	{
+		return -1;
+	}
+
+	m_blocks.clear();
+	m_pCurBlock = nullptr;
+	m_blockUsed = TTREE_WAL_BLOCK;
+
+	m_logPath = logPath;
+	m_checkpointPath = checkpointPath;
+
+	m_fd = open(logPath, O_RDWR | O_CREAT | O_APPEND, 0644);
+	if (m_fd < 0)
+	{
+		return -1;
+	}
+
+	uint64_t checkpointLsn = 0;
+	bool ok = LoadCheckpoint(&checkpointLsn) == 0;
+
+	m_lsn = checkpointLsn;
+	ok = ok && ReplayLog(checkpointLsn) == 0;
+
+	//之后不再往当前块分配，全部删除后可以释放
+	if (m_pCurBlock && m_blocks[m_pCurBlock].live == 0)
+	{
+		m_blocks.erase(m_pCurBlock);
+	}
+	m_pCurBlock = nullptr;
+	m_blockUsed = TTREE_WAL_BLOCK;
+
+	if (!ok)
+	{
+		m_pTable->Clear();
+		m_blocks.clear();
+
+		close(m_fd);
+		m_fd = -1;
+
+		return -1;
+	}
+
+	m_bufferLsn = m_durableLsn = m_lsn;
+	m_stop = false;
+	m_error = false;
+
+	m_flusher = std::thread(&TTreeWal::FlushLoop, this);
+
+	return 0;
+}
+
+void TTreeWal::Close()
+{
+	if (m_flusher.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			m_stop = true;
+		}
+		m_cvFlush.notify_one();
+
+		m_flusher.join();
+	}
+
+	if (m_fd >= 0)
+	{
+		close(m_fd);
+		m_fd = -1;
+	}
+}
+
+int TTreeWal::Insert(void* pRecord)
+{
+	std::lock_guard<std::mutex> guard(m_writeLock);
+
+	if (!Writable())
+	{
+		return -1;
+	}
+
+	int rc = m_pTable->Insert(pRecord);
+	if (rc == 0)
+	{
+		Append(OP_INSERT, pRecord);
+	}
+
+	return rc;
+}
+
+size_t TTreeWal::InsertBatch(void** pRecords, size_t n, int* results)
+{
+	std::lock_guard<std::mutex> guard(m_writeLock);
+
+	if (!Writable())
+	{
+		for (size_t i = 0; results && i < n; i++)
+		{
+			results[i] = -1;
+		}
+
+		return 0;
+	}
+
+	std::vector<int> localResults;
+	if (results == nullptr)
+	{
+		localResults.resize(n);
+		results = localResults.data();
+	}
+
+	size_t inserted = m_pTable->InsertBatch(pRecords, n, results);
+
+	for (size_t i = 0; i < n; i++)
+	{
+		if (results[i] == 0)
+		{
+			Append(OP_INSERT, pRecords[i]);
+		}
+	}
+
+	return inserted;
+}
+
+int TTreeWal::Delete(void* pRecord)
+{
+	std::lock_guard<std::mutex> guard(m_writeLock);
+
+	if (!Writable())
+	{
+		return -1;
+	}
+
+	//pRecord可能就是表中存放的恢复出来的记录，先记日志再释放
+	return DeleteRecord(pRecord, true);
+}
+
+bool TTreeWal::Writable()
+{
+	if (m_fd < 0)
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(m_lock);
+
+	return !m_error;
+}
+
+uint64_t TTreeWal::LastLsn()
+{
+	std::lock_guard<std::mutex> guard(m_writeLock);
+
+	return m_lsn;
+}
+
+uint32_t TTreeWal::Checksum(const TTreeWalEntry& entry, const void* pRecord)
+{
+	//FNV-1a，每次混入8个字节，记录较大时比逐字节快得多
+	uint64_t hash = 14695981039346656037ull;
+
+	auto mix = [&hash](const void* p, size_t n)
+	{
+		const unsigned char* pBytes = (const unsigned char*)p;
+		size_t i = 0;
+
+		for (; i + 8 <= n; i += 8)
+		{
+			uint64_t word;
+			memcpy(&word, pBytes + i, sizeof(word));
+
+			hash = (hash ^ word) * 1099511628211ull;
+		}
+
+		for (; i < n; i++)
+		{
+			hash = (hash ^ pBytes[i]) * 1099511628211ull;
+		}
+	};
+
+	mix(&entry.lsn, sizeof(entry.lsn));
+	mix(&entry.op, sizeof(entry.op));
+	mix(pRecord, m_recordSize);
+
+	return (uint32_t)(hash ^ (hash >> 32));
+}
+
+void TTreeWal::Append(OpType op, const void* pRecord)
+{
+	TTreeWalEntry entry;
+	entry.lsn = ++m_lsn;
+	entry.op = op;
+	entry.checksum = Checksum(entry, pRecord);
+
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	m_cvDurable.wait(lock, [this]() { return m_buffer.size() < TTREE_WAL_BUFFER_MAX || m_error; });
+
+	m_buffer.insert(m_buffer.end(), (const char*)&entry, (const char*)&entry + sizeof(entry));
+	m_buffer.insert(m_buffer.end(), (const char*)pRecord, (const char*)pRecord + m_recordSize);
+	m_bufferLsn = entry.lsn;
+
+	if (m_buffer.size() >= TTREE_WAL_BUFFER)
+	{
+		m_cvFlush.notify_one();
+	}
+}
+
+int TTreeWal::Sync()
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	uint64_t target = m_bufferLsn;
+
+	m_syncWaiters++;
+	m_cvFlush.notify_one();
+
+	m_cvDurable.wait(lock, [&]() { return m_durableLsn >= target || m_error; });
+
+	m_syncWaiters--;
+
+	return m_durableLsn >= target ? 0 : -1;
+}
+
+void TTreeWal::FlushLoop()
+{
+	std::vector<char> flushing;
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	while (true)
+	{
+		//没有人等时攒TTREE_WAL_FLUSH_US再刷，这期间的修改共用一次fdatasync
+		m_cvFlush.wait_for(lock, std::chrono::microseconds(TTREE_WAL_FLUSH_US), [this]() {
+			return m_stop || m_buffer.size() >= TTREE_WAL_BUFFER || (m_syncWaiters > 0 && !m_buffer.empty());
+		});
+
+		if (m_buffer.empty())
+		{
+			if (m_stop)
+			{
+				break;
+			}
+
+			continue;
+		}
+
+		flushing.swap(m_buffer);
+		uint64_t lsn = m_bufferLsn;
+		bool failed = m_error;
+
+		lock.unlock();
+
+		bool ok = !failed && WriteFull(m_fd, flushing.data(), flushing.size()) && fdatasync(m_fd) == 0;
+		flushing.clear();
+
+		lock.lock();
+
+		if (ok)
+		{
+			m_durableLsn = lsn;
+		}
+		else
+		{
+			m_error = true;
+		}
+
+		m_cvDurable.notify_all();
+	}
+}
+
+int TTreeWal::Checkpoint()
+{
+	std::lock_guard<std::mutex> guard(m_writeLock);
+
+	if (m_fd < 0 || Sync() != 0)
+	{
+		return -1;
+	}
+
+	TTreeWalCheckpoint header;
+	header.magic = TTREE_WAL_MAGIC;
+	header.version = TTREE_WAL_VERSION;
+	header.recordSize = m_recordSize;
+	header.lsn = m_lsn;
+	header.count = m_pTable->Count();
+
+	std::string tmpPath = m_checkpointPath + ".tmp";
+
+	int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+	{
+		return -1;
+	}
+
+	std::vector<char> buffer((const char*)&header, (const char*)&header + sizeof(header));
+	bool ok = true;
+
+	for (TTreeIterator it = m_pTable->Primary()->Begin(); ok && !it.IsEOF(); it.Next())
+	{
+		const char* pRecord = (const char*)*it.Get();
+		buffer.insert(buffer.end(), pRecord, pRecord + m_recordSize);
+
+		if (buffer.size() >= TTREE_WAL_BUFFER)
+		{
+			ok = WriteFull(fd, buffer.data(), buffer.size());
+			buffer.clear();
+		}
+	}
+
+	ok = ok && WriteFull(fd, buffer.data(), buffer.size()) && fsync(fd) == 0;
+	ok = (close(fd) == 0) && ok;
+
+	if (!ok || rename(tmpPath.c_str(), m_checkpointPath.c_str()) != 0 || SyncDir(m_checkpointPath) != 0)
+	{
+		unlink(tmpPath.c_str());
+		return -1;
+	}
+
+	//日志中的修改都已经在检查点里。在这之前崩溃时，重放会跳过lsn不大于检查点的项
+	std::lock_guard<std::mutex> lock(m_lock);
+
+	if (ftruncate(m_fd, 0) != 0 || fsync(m_fd) != 0)
+	{
+		m_error = true;
+		return -1;
+	}
+
+	return 0;
+}
+
+int TTreeWal::SyncDir(const std::string& path)
+{
+	size_t slash = path.find_last_of('/');
+	std::string dir = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+
+	int fd = open(dir.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		return -1;
+	}
+
+	int rc = fsync(fd);
+	close(fd);
+
+	return rc == 0 ? 0 : -1;
+}
+
+char* TTreeWal::AllocRecord()
+{
+	if (m_blockUsed == TTREE_WAL_BLOCK)
+	{
+		//上一块不再分配，此时已经全部删除的直接释放
+		if (m_pCurBlock && m_blocks[m_pCurBlock].live == 0)
+		{
+			m_blocks.erase(m_pCurBlock);
+		}
+
+		RecordBlock block;
+		block.data.reset(new char[(size_t)m_recordSize * TTREE_WAL_BLOCK]);
+		block.size = (size_t)m_recordSize * TTREE_WAL_BLOCK;
+		block.live = 0;
+
+		m_pCurBlock = block.data.get();
+		m_blocks[m_pCurBlock] = std::move(block);
+		m_blockUsed = 0;
+	}
+
+	m_blocks[m_pCurBlock].live++;
+
+	return m_pCurBlock + (size_t)m_recordSize * m_blockUsed++;
+}
+
+void TTreeWal::ReleaseRecord(const void* pRecord)
+{
+	auto it = m_blocks.upper_bound((const char*)pRecord);
+	if (it == m_blocks.begin())
+	{
+		return;
+	}
+
+	--it;
+	if ((const char*)pRecord >= it->first + it->second.size)
+	{
+		return;
+	}
+
+	//恢复时正在填充的块还要继续分配，留到填满后再看
+	if (--it->second.live == 0 && it->first != m_pCurBlock)
+	{
+		m_blocks.erase(it);
+	}
+}
+
+int TTreeWal::DeleteRecord(void* pRecord, bool log)
+{
+	void* pStored = m_pTable->Get(pRecord);
+
+	int rc = m_pTable->Delete(pRecord);
+	if (rc != 0)
+	{
+		return rc;
+	}
+
+	if (log)
+	{
+		Append(OP_DELETE, pRecord);
+	}
+
+	if (!m_blocks.empty())
+	{
+		ReleaseRecord(pStored);
+	}
+
+	return 0;
+}
+
+int TTreeWal::LoadCheckpoint(uint64_t* pLsn)
+{
+	*pLsn = 0;
+
+	int fd = open(m_checkpointPath.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		return errno == ENOENT ? 0 : -1;
+	}
+
+	TTreeWalCheckpoint header;
+	struct stat st;
+
+	bool ok = fstat(fd, &st) == 0 && ReadFull(fd, &header, sizeof(header), 0) &&
+		header.magic == TTREE_WAL_MAGIC && header.version == TTREE_WAL_VERSION && header.recordSize == m_recordSize &&
+		header.count <= ((uint64_t)st.st_size - sizeof(header)) / m_recordSize &&
+		(uint64_t)st.st_size == sizeof(header) + header.count * m_recordSize;
+
+	//检查点的记录放在一整块里，之后恢复的记录另起一块
+	std::unique_ptr<char[]> block;
+	if (ok && header.count > 0)
+	{
+		block.reset(new char[(size_t)header.count * m_recordSize]);
+		ok = ReadFull(fd, block.get(), (size_t)header.count * m_recordSize, sizeof(header));
+	}
+
+	close(fd);
+
+	if (!ok)
+	{
+		return -1;
+	}
+
+	std::vector<void*> records(header.count);
+	for (size_t i = 0; i < records.size(); i++)
+	{
+		records[i] = block.get() + (size_t)m_recordSize * i;
+	}
+
+	if (m_pTable->Load(records.data(), records.size(), 1.0) != 0)
+	{
+		return -1;
+	}
+
+	if (block)
+	{
+		RecordBlock recordBlock;
+		recordBlock.size = (size_t)header.count * m_recordSize;
+		recordBlock.live = header.count;
+		recordBlock.data = std::move(block);
+
+		const char* pStart = recordBlock.data.get();
+		m_blocks[pStart] = std::move(recordBlock);
+	}
+
+	*pLsn = header.lsn;
+
+	return 0;
+}
+
+int TTreeWal::ReplayLog(uint64_t checkpointLsn)
+{
+	struct stat st;
+	if (fstat(m_fd, &st) != 0)
+	{
+		return -1;
+	}
+
+	std::vector<char> data(st.st_size);
+	if (!data.empty() && !ReadFull(m_fd, data.data(), data.size(), 0))
+	{
+		return -1;
+	}
+
+	size_t entrySize = sizeof(TTreeWalEntry) + m_recordSize;
+	size_t pos = 0;
+
+	//连续的插入攒起来走InsertBatch，遇到删除时先把之前的插入做完，保持顺序
+	std::vector<void*> inserts;
+	std::vector<int> results;
+	auto flushInserts = [&]()
+	{
+		if (!inserts.empty())
+		{
+			results.resize(inserts.size());
+			m_pTable->InsertBatch(inserts.data(), inserts.size(), results.data());
+
+			//没有插入的副本不在表中
+			for (size_t i = 0; i < inserts.size(); i++)
+			{
+				if (results[i] != 0)
+				{
+					ReleaseRecord(inserts[i]);
+				}
+			}
+
+			inserts.clear();
+		}
+	};
+
+	for (; pos + entrySize <= data.size(); pos += entrySize)
+	{
+		TTreeWalEntry entry;
+		memcpy(&entry, data.data() + pos, sizeof(entry));
+
+		const char* pRecord = data.data() + pos + sizeof(entry);
+
+		if ((entry.op != OP_INSERT && entry.op != OP_DELETE) || entry.checksum != Checksum(entry, pRecord))
+		{
+			break;
+		}
+
+		if (entry.lsn <= checkpointLsn)
+		{
+			continue;
+		}
+
+		m_lsn = entry.lsn;
+
+		if (entry.op == OP_INSERT)
+		{
+			char* pCopy = AllocRecord();
+			memcpy(pCopy, pRecord, m_recordSize);
+
+			inserts.push_back(pCopy);
+		}
+		else
+		{
+			flushInserts();
+			DeleteRecord((void*)pRecord, false);
+		}
+	}
+
+	flushInserts();
+
+	//丢掉崩溃时没写完的尾部，之后的追加接在最后一个完整的项后面
+	if (pos < data.size() && (ftruncate(m_fd, pos) != 0 || fsync(m_fd) != 0))
+	{
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,193 @@
+/**
+ * @brief	多索引表的预写日志与崩溃恢复
+ * @author	huangxx
+*/
+
+#ifndef __TTREE_WAL_H__
+#define __TTREE_WAL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mutex>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ttree_table.h"
+
+
+#define TTREE_WAL_MAGIC			0x4c415745455254ull	//"TREEWAL"
+#define TTREE_WAL_VERSION		1
+
+//后台线程攒日志的最长时间，到点后一次write加一次fdatasync
+#define TTREE_WAL_FLUSH_US		1000
+
+//缓冲的日志达到这么多字节时不等到点，立即刷盘
+#define TTREE_WAL_BUFFER		(1 << 20)
+
+//缓冲超过这么多字节时写操作等待刷盘，磁盘跟不上时限制内存
+#define TTREE_WAL_BUFFER_MAX	(16 << 20)
+
+//恢复出来的记录每块存放的条数
+#define TTREE_WAL_BLOCK			4096
+
+/**
+ * 日志项：头部之后是recordSize字节的记录，checksum覆盖头部其余字段和记录，
+ * 恢复时遇到校验不过的项认为是崩溃时没写完的尾部，从这里截断
+*/
+struct TTreeWalEntry
+{
+	uint64_t	lsn;
+	uint32_t	op;
+	uint32_t	checksum;
+};
+
+/**
+ * 检查点文件：头部之后是count条按主键排序的记录
+*/
+struct TTreeWalCheckpoint
+{
+	uint64_t	magic;
+	uint32_t	version;
+	uint32_t	recordSize;
+	uint64_t	lsn;		//包含到这个lsn为止的所有修改
+	uint64_t	count;
+};
+
+/**
+ * 给TTreeTable加上预写日志：记录是recordSize字节的定长结构，
+ * Insert、Delete修改表成功后把记录追加到内存缓冲，后台线程定时或缓冲满时
+ * 一次写入并fdatasync(组提交)，写操作本身不等待磁盘。
+ * 需要持久化保证时调用Sync，等到此前所有修改都落盘，多个线程的Sync共用一次fdatasync。
+ * Checkpoint把整表写成检查点文件并清空日志；Open时加载检查点、重放日志。
+ * 恢复出来的记录由TTreeWal按块持有，一块中的记录都删除后整块释放，其余的生命周期与TTreeWal相同；
+ * 运行期间插入的记录仍由调用方持有。
+ * 修改接口可以多线程调用，内部串行。
+ * 写盘失败后日志不再可用：缓冲中和之后的修改都不会落盘，Insert、InsertBatch、Delete
+ * 不再修改表，直接返回失败，直到重新Open
+*/
+class TTreeWal
+{
+public:
+	TTreeWal(TTreeTable* pTable, unsigned int recordSize);
+
+	~TTreeWal();
+
+	TTreeWal(const TTreeWal&) = delete;
+
+	TTreeWal& operator=(const TTreeWal&) = delete;
+
+	/**
+	 * 表必须为空且已经建好全部索引。加载检查点(不存在时跳过)，重放日志，
+	 * 然后打开日志等待追加；文件损坏或读写失败返回-1
+	*/
+	int Open(const char* logPath, const char* checkpointPath);
+
+	//刷完缓冲后关闭，析构时自动调用
+	void Close();
+
+	//日志没有打开或者已经写盘失败时返回-1
+	int Insert(void* pRecord);
+
+	/**
+	 * 批量插入，只记录插入成功的记录；results同TTreeTable::InsertBatch。
+	 * 日志不可用时不插入，返回0
+	*/
+	size_t InsertBatch(void** pRecords, size_t n, int* results = nullptr);
+
+	/**
+	 * 按主键删除，pRecord也要有recordSize字节，日志中记录的是它；
+	 * pRecord可以是表中存放的记录本身
+	*/
+	int Delete(void* pRecord);
+
+	/**
+	 * 等待调用前的所有修改落盘，写盘失败返回-1
+	*/
+	int Sync();
+
+	/**
+	 * 把整表写成检查点文件(先写临时文件，fsync后改名)，然后清空日志
+	*/
+	int Checkpoint();
+
+	//最后一次修改的lsn
+	uint64_t LastLsn();
+
+//private:
+public:
+	enum OpType
+	{
+		OP_INSERT = 1,
+		OP_DELETE = 2,
+	};
+
+	//把一条修改追加到缓冲，调用方持有m_writeLock
+	void Append(OpType op, const void* pRecord);
+
+	void FlushLoop();
+
+	int LoadCheckpoint(uint64_t* pLsn);
+
+	//重放lsn大于checkpointLsn的日志项，连续的插入合并成InsertBatch
+	int ReplayLog(uint64_t checkpointLsn);
+
+	//为恢复出来的记录分配空间
+	char* AllocRecord();
+
+	//记录离开了表，是恢复出来的记录时减少所在块的计数，块中的记录都删除后释放整块
+	void ReleaseRecord(const void* pRecord);
+
+	//日志已经打开且没有写盘失败，调用方持有m_writeLock
+	bool Writable();
+
+	//从表中删除，log时追加日志，之后才释放恢复出来的记录(pRecord可能就是它)
+	int DeleteRecord(void* pRecord, bool log);
+
+	uint32_t Checksum(const TTreeWalEntry& entry, const void* pRecord);
+
+	//rename之后fsync所在目录，保证改名本身落盘
+	static int SyncDir(const std::string& path);
+
+//private:
+public:
+	TTreeTable*		m_pTable;
+	unsigned int	m_recordSize;
+
+	std::string		m_logPath;
+	std::string		m_checkpointPath;
+	int				m_fd;
+
+	std::mutex		m_writeLock;		//串行化表的修改和追加
+	uint64_t		m_lsn;				//最后一次修改的lsn，m_writeLock保护
+
+	std::mutex					m_lock;			//保护下面的缓冲和刷盘状态
+	std::condition_variable		m_cvFlush;
+	std::condition_variable		m_cvDurable;
+	std::vector<char>			m_buffer;
+	uint64_t					m_bufferLsn;	//缓冲中最后一项的lsn
+	uint64_t					m_durableLsn;	//已经落盘的lsn
+	unsigned int				m_syncWaiters;
+	bool						m_stop;
+	bool						m_error;
+	std::thread					m_flusher;
+
+	/**
+	 * 一块恢复出来的记录
+	*/
+	struct RecordBlock
+	{
+		std::unique_ptr<char[]>	data;
+		size_t					size;	//字节数
+		size_t					live;	//还在表中的记录数
+	};
+
+	std::map<const char*, RecordBlock>	m_blocks;		//按起始地址，释放时找所在的块
+	char*								m_pCurBlock;	//恢复时正在填充的块
+	size_t								m_blockUsed;
+};
+
+#endif